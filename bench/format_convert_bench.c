@@ -0,0 +1,125 @@
+#include "format_convert.h"
+
+#include <time.h>
+
+// format_convert_bench [element_count]
+// times every conversion kernel at every instruction set the CPU supports, checks each against the scalar kernels and
+// reports throughput over source + destination bytes. without an argument it runs a cache resident and a memory bound size
+
+#define BENCH_MIN_SECONDS 0.25
+
+typedef struct bench_case {
+    const char*         name;
+    transfer_conversion conversion;
+} bench_case;
+
+static const bench_case cases[] = {
+    {"rgb8_to_rgba8", {.type = TRANSFER_CONVERSION_RGB8_TO_RGBA8}},
+    {"f32_to_f16", {.type = TRANSFER_CONVERSION_F32_TO_F16}},
+    {"u16_to_u32", {.type = TRANSFER_CONVERSION_U16_TO_U32}},
+    {"swizzle_bgra8", {.type = TRANSFER_CONVERSION_SWIZZLE_RGBA8, .swizzle = {2, 1, 0, 3}}},
+};
+
+static f64 now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (f64)ts.tv_sec + (f64)ts.tv_nsec * 1e-9;
+}
+
+static void fill_random(u8* data, u64 size) {
+    // xorshift, every bit pattern shows up so f32 inputs cover NaN, inf and subnormals
+    u64 state = 0x9e3779b97f4a7c15ull;
+    for (u64 i = 0; i < size; ++i) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        data[i] = (u8)state;
+    }
+}
+
+static f64 time_kernel(format_convert_isa isa, const transfer_conversion* conversion, const u8* src, u8* dst, u64 element_count,
+                       u64* iterations) {
+    // warm up, faults the destination pages in
+    format_convert_with_isa(isa, conversion, src, dst, element_count);
+
+    u64 count = 0;
+    f64 start = now_seconds();
+    f64 elapsed;
+
+    do {
+        format_convert_with_isa(isa, conversion, src, dst, element_count);
+        count++;
+        elapsed = now_seconds() - start;
+    } while (elapsed < BENCH_MIN_SECONDS);
+
+    *iterations = count;
+    return elapsed;
+}
+
+static b8 run_size(u64 element_count) {
+    b8                 passed   = true;
+    format_convert_isa best_isa = format_convert_best_isa();
+
+    printf("%llu elements\n", (unsigned long long)element_count);
+    printf("  %-14s %-8s %10s %10s\n", "conversion", "isa", "GB/s", "speedup");
+
+    for (u32 c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        const transfer_conversion* conversion = &cases[c].conversion;
+
+        u64 src_size = element_count * format_convert_src_element_size(conversion);
+        u64 dst_size = element_count * format_convert_dst_element_size(conversion);
+
+        u8* src       = malloc(src_size);
+        u8* dst       = malloc(dst_size);
+        u8* reference = malloc(dst_size);
+
+        if (!src || !dst || !reference) {
+            fprintf(stderr, "out of memory\n");
+            free(src);
+            free(dst);
+            free(reference);
+            return false;
+        }
+
+        fill_random(src, src_size);
+        format_convert_with_isa(FORMAT_CONVERT_ISA_SCALAR, conversion, src, reference, element_count);
+
+        f64 scalar_rate = 0.0;
+
+        for (u32 isa = FORMAT_CONVERT_ISA_SCALAR; isa <= best_isa; ++isa) {
+            u64 iterations;
+            f64 elapsed = time_kernel(isa, conversion, src, dst, element_count, &iterations);
+            f64 rate    = (f64)(src_size + dst_size) * (f64)iterations / elapsed / 1e9;
+
+            if (isa == FORMAT_CONVERT_ISA_SCALAR) {
+                scalar_rate = rate;
+            }
+
+            b8 matches = memcmp(dst, reference, dst_size) == 0;
+            passed &= matches;
+
+            printf("  %-14s %-8s %10.2f %9.2fx%s\n", cases[c].name, format_convert_isa_name(isa), rate, rate / scalar_rate,
+                   matches ? "" : "  MISMATCH");
+        }
+
+        free(src);
+        free(dst);
+        free(reference);
+    }
+
+    return passed;
+}
+
+int main(int argc, char** argv) {
+    b8 passed;
+
+    if (argc > 1) {
+        passed = run_size(strtoull(argv[1], NULL, 10));
+    } else {
+        // odd counts so every vector loop also runs its scalar tail
+        passed = run_size(8 * 1024 + 7);
+        passed &= run_size(16 * 1024 * 1024 + 7);
+    }
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,6 @@
+#pragma once
+
+#include "common.h"
+
+// fast non-cryptographic 64 bit hash for upload payloads. consumes 32 bytes per step across two independent multiply lanes
+u64 content_hash64(const void* data, u64 size, u64 seed);
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+b8 decompress_codec_available(transfer_compression compression);
+
+// decompresses one independently compressed block. returns the number of bytes written, or -1 on failure
+i64 decompress_block(transfer_compression compression, const void* src, u32 src_size, void* dst, u32 dst_capacity);
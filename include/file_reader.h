@@ -0,0 +1,55 @@
+#pragma once
+
+#include "common.h"
+
+#define FILE_READER_MAX_COMPLETIONS 16
+
+typedef struct file_read_completion {
+    u64 user_data;
+    // bytes read, or -errno
+    i64 result;
+} file_read_completion;
+
+// asynchronous positional reads. backed by io_uring when the kernel allows it, otherwise by pread, in which case
+// file_reader_submit performs the read before returning and file_reader_wait hands back the stored result.
+typedef struct file_reader {
+    b8 uring_enabled;
+    i32 ring_fd;
+    u32 in_flight;
+    u32 depth;
+
+    // io_uring submission ring
+    void* sq_ring;
+    u64   sq_ring_size;
+    _Atomic u32* sq_head;
+    _Atomic u32* sq_tail;
+    u32*         sq_mask;
+    u32*         sq_array;
+    void*        sqes;
+    u64          sqes_size;
+
+    // io_uring completion ring
+    void* cq_ring;
+    u64   cq_ring_size;
+    _Atomic u32* cq_head;
+    _Atomic u32* cq_tail;
+    u32*         cq_mask;
+    void*        cqes;
+
+    // pread fallback results
+    file_read_completion completions[FILE_READER_MAX_COMPLETIONS];
+    u32                  completion_count;
+} file_reader;
+
+b8 file_reader_create(file_reader* reader, u32 depth);
+
+void file_reader_destroy(file_reader* reader);
+
+// false when depth reads are already in flight
+b8 file_reader_submit(file_reader* reader, i32 fd, void* dst, u32 size, u64 offset, u64 user_data);
+
+// blocks until any submitted read completes
+b8 file_reader_wait(file_reader* reader, file_read_completion* completion);
+
+// synchronous read that retries short reads until size bytes are read or EOF/error is hit
+i64 file_reader_read_all(i32 fd, void* dst, u64 size, u64 offset);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+typedef enum format_convert_isa {
+    FORMAT_CONVERT_ISA_SCALAR,
+    // SSSE3 shuffles and SSE4.1 widening, f32 -> f16 stays scalar without F16C
+    FORMAT_CONVERT_ISA_SSE41,
+    // AVX2 + F16C
+    FORMAT_CONVERT_ISA_AVX2,
+    FORMAT_CONVERT_ISA_COUNT,
+} format_convert_isa;
+
+u32 format_convert_src_element_size(const transfer_conversion* conversion);
+u32 format_convert_dst_element_size(const transfer_conversion* conversion);
+
+// bytes written to dst for src_size bytes of input
+VkDeviceSize format_convert_dst_size(const transfer_conversion* conversion, VkDeviceSize src_size);
+
+// widest instruction set the running CPU supports, detected once
+format_convert_isa format_convert_best_isa(void);
+
+const char* format_convert_isa_name(format_convert_isa isa);
+
+// converts element_count elements from src into dst using the best available kernels. src and dst must not overlap
+void format_convert(const transfer_conversion* conversion, const void* src, void* dst, u64 element_count);
+
+// same as format_convert with the kernels pinned to isa, which must not be wider than format_convert_best_isa
+void format_convert_with_isa(format_convert_isa isa, const transfer_conversion* conversion, const void* src, void* dst,
+                             u64 element_count);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+b8 host_image_copy_create(host_image_copy* copy, VkDevice device, const transfer_host_image_copy_create_info* create_info,
+                          transfer_error* error);
+
+// finishes the copies already running
+void host_image_copy_destroy(host_image_copy* copy);
+
+// whether request should be written by the CPU. queue_possible is false when the staged path would fail it. worker only
+b8 host_image_copy_choose_host(host_image_copy* copy, const transfer_request* request, b8 queue_possible);
+
+// hands the copy of a claimed request to a CPU thread, which completes the handle.
+// returns false, with the handle untouched, if the copy couldn't be started
+b8 host_image_copy_execute(host_image_copy* copy, transfer_handle_pool* handle_pool, const transfer_request* request);
+
+// start time for host_image_copy_record_queue_upload, taken before the staging fill
+u64 host_image_copy_timestamp(void);
+
+// times a queue path upload until its fence signals. worker only
+void host_image_copy_record_queue_upload(host_image_copy* copy, const transfer_request* request, const transfer_submission* submission,
+                                         u64 start_ns);
+
+// turns queue uploads whose fences have signaled into throughput samples. worker only
+void host_image_copy_poll(host_image_copy* copy, const transfer_command_pool* command_pool);
+
+void host_image_copy_get_stats(host_image_copy* copy, transfer_host_image_copy_stats* stats);
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+// fails when the device doesn't expose VK_EXT_external_memory_host, in which case uploads keep using staging
+b8 host_import_cache_create(host_import_cache* cache, VkDevice device, const transfer_host_import_create_info* create_info,
+                            transfer_error* error);
+
+void host_import_cache_destroy(host_import_cache* cache, VkDevice device, const transfer_command_pool* command_pool);
+
+// looks up or imports the page aligned range around [ptr, ptr + size) and copies it to entry. on success the entry is
+// marked in use until host_import_cache_retire so it can't be evicted or released while it's being recorded. worker only
+b8 host_import_cache_acquire(host_import_cache* cache, VkDevice device, const transfer_command_pool* command_pool, const void* ptr,
+                             VkDeviceSize size, host_import_entry* entry);
+
+// records the submission reading from the acquired entry and unpins it. submission may be NULL if nothing was submitted
+void host_import_cache_retire(host_import_cache* cache, const host_import_entry* entry, const transfer_submission* submission);
+
+// drops every import overlapping [ptr, ptr + size), waiting for the worker to retire them and the GPU to stop reading them
+void host_import_cache_release(host_import_cache* cache, VkDevice device, const transfer_command_pool* command_pool, const void* ptr,
+                               VkDeviceSize size);
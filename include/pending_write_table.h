@@ -0,0 +1,22 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+b8 pending_write_table_create(pending_write_table* table);
+
+void pending_write_table_destroy(pending_write_table* table);
+
+// producer side, after the handle got its ticket and before the request is queued. every pending write to the request's
+// buffer whose range the request fully covers is marked superseded, then the request's own range is recorded in
+// request->pending_write. mirror flushes, defrag moves, region copies and images aren't tracked. pending writes to a
+// buffer the request copies from are pinned first, they can't be superseded anymore
+void pending_write_table_track(pending_write_table* table, transfer_handle_pool* handle_pool, transfer_request* request);
+
+// worker: the request left the queue, frees its entry. returns false if it was superseded meanwhile and must be dropped
+b8 pending_write_table_take(pending_write_table* table, u32 write_idx);
+
+// worker: whether pending_write_table_take would succeed right now
+b8 pending_write_table_is_queued(pending_write_table* table, u32 write_idx);
+
+void pending_write_table_get_stats(pending_write_table* table, transfer_latest_wins_stats* stats);
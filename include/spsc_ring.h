@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common.h"
+
+#include <stdalign.h>
+
+#define SPSC_RING_CACHE_LINE_SIZE 64
+
+// lock-free single producer, single consumer ring. capacity is rounded up to a power of two.
+// producer and consumer indices live on separate cache lines so the two threads never write the same line.
+typedef struct spsc_ring {
+    void* memory;
+    u32   element_size;
+    u32   capacity;
+    u32   mask;
+
+    // owned by the producer
+    alignas(SPSC_RING_CACHE_LINE_SIZE) _Atomic u32 back;
+    // producer's last observed value of front, refreshed only when the ring looks full
+    u32 cached_front;
+
+    // owned by the consumer
+    alignas(SPSC_RING_CACHE_LINE_SIZE) _Atomic u32 front;
+    // consumer's last observed value of back, refreshed only when the ring looks empty
+    u32 cached_back;
+} spsc_ring;
+
+b8 spsc_ring_create(spsc_ring* ring, u32 element_size, u32 capacity);
+
+void spsc_ring_destroy(spsc_ring* ring);
+
+// producer thread only
+b8 spsc_ring_push(spsc_ring* ring, const void* element);
+
+// producer thread only: whether the next push would fail. a false answer holds until the producer pushes
+b8 spsc_ring_full(spsc_ring* ring);
+
+// consumer thread only
+b8 spsc_ring_pop(spsc_ring* ring, void* element);
+
+// safe from any thread, but only a snapshot
+u32 spsc_ring_count(spsc_ring* ring);
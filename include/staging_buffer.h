@@ -0,0 +1,21 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+b8 staging_buffer_create(staging_buffer* staging, VkDevice device, const transfer_staging_create_info* create_info, transfer_error* error);
+
+void staging_buffer_destroy(staging_buffer* staging, VkDevice device);
+
+// returns the next chunk round robin, waiting for the GPU to finish reading it if needed
+VkResult staging_buffer_acquire_chunk(staging_buffer* staging, VkDevice device, const transfer_command_pool* command_pool, u32* chunk_idx);
+
+u8* staging_buffer_chunk_memory(staging_buffer* staging, u32 chunk_idx);
+
+VkDeviceSize staging_buffer_chunk_offset(staging_buffer* staging, u32 chunk_idx);
+
+// makes host writes to the first size bytes of the chunk visible to the device. no-op on coherent memory
+VkResult staging_buffer_flush_chunk(staging_buffer* staging, VkDevice device, u32 chunk_idx, VkDeviceSize size);
+
+// marks the chunk as read by submission. it won't be handed out again until that submission's fence signals
+void staging_buffer_retire_chunk(staging_buffer* staging, u32 chunk_idx, const transfer_submission* submission);
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "common.h"
+#include "d_queue.h"
+
+typedef void (*task_fn)(void* user_data);
+
+typedef struct task {
+    task_fn fn;
+    void*   user_data;
+} task;
+
+// fixed set of CPU threads running fire and forget tasks in FIFO order
+typedef struct task_pool {
+    pthread_t*      threads;
+    u32             thread_count;
+    d_queue         tasks;
+    pthread_mutex_t mutex;
+    pthread_cond_t  task_available_cond;
+    // broadcast after every finished task, see task_pool_wait
+    pthread_cond_t task_done_cond;
+    b8             should_close;
+} task_pool;
+
+b8 task_pool_create(task_pool* pool, u32 thread_count);
+
+// finishes queued tasks before returning
+void task_pool_destroy(task_pool* pool);
+
+b8 task_pool_push(task_pool* pool, task_fn fn, void* user_data);
+
+// blocks until *done is set. the task setting it must do so before returning
+void task_pool_wait(task_pool* pool, const atomic_bool* done);
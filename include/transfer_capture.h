@@ -0,0 +1,20 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+b8 transfer_capture_create(transfer_capture* capture);
+
+void transfer_capture_destroy(transfer_capture* capture);
+
+// truncates path and starts writing a transfer_capture_header followed by one transfer_capture_record per event
+b8 transfer_capture_begin(transfer_capture* capture, const char* path, u64 start_frame);
+
+// returns false if any record failed to reach the file
+b8 transfer_capture_end(transfer_capture* capture);
+
+// called by the enqueue paths once the request was queued or completed by the dedup cache. context is NULL for the
+// engine wide queue
+void transfer_capture_record_request(transfer_capture* capture, const transfer_request* request, const transfer_submit_context* context);
+
+void transfer_capture_record_frame_tick(transfer_capture* capture);
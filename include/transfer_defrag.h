@@ -0,0 +1,25 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+b8 transfer_defrag_create(transfer_defrag* defrag);
+
+void transfer_defrag_destroy(transfer_defrag* defrag);
+
+// starts a run over allocations from heap. returns false if a run is still going or out of memory
+b8 transfer_defrag_begin(transfer_defrag* defrag, upload_heap* heap, const transfer_allocation* allocations, u32 count,
+                         const transfer_defrag_create_info* create_info);
+
+// publishes the relocations of a finished step and plans the next one. returns true with request filled in when the
+// step's copy needs enqueueing
+b8 transfer_defrag_step(transfer_defrag* defrag, upload_heap* heap, VkDevice device, const transfer_command_pool* command_pool,
+                        transfer_request* request);
+
+// the step's copy was submitted, or failed to be when submission is NULL
+void transfer_defrag_record_submission(transfer_defrag* defrag, const transfer_submission* submission);
+
+// moves up to max_count published relocations out of the table, returns how many
+u32 transfer_defrag_take_relocations(transfer_defrag* defrag, transfer_relocation* relocations, u32 max_count);
+
+void transfer_defrag_get_stats(transfer_defrag* defrag, transfer_defrag_stats* stats);
@@ -23,6 +23,22 @@ void transfer_handle_pool_set_handle_fence(transfer_handle_pool* handle_pool, tr
 
 void transfer_handle_pool_insert_status_barrier(transfer_handle_pool* handle_pool, transfer_handle handle, transfer_status status);
 
+// moves the handle to TRANSFER_STATUS_PENDING for a new enqueue and returns the enqueue's ticket, which the request carries
+u32 transfer_handle_pool_mark_pending(transfer_handle_pool* handle_pool, transfer_handle handle);
+
+// worker: moves the handle from TRANSFER_STATUS_PENDING to TRANSFER_STATUS_EXECUTING if ticket is still its latest enqueue.
+// false means the request was cancelled or superseded and must be dropped. TRANSFER_HANDLE_INVALID always succeeds
+b8 transfer_handle_pool_claim(transfer_handle_pool* handle_pool, transfer_handle handle, u32 ticket);
+
+// whether transfer_handle_pool_claim would succeed right now
+b8 transfer_handle_pool_is_pending(transfer_handle_pool* handle_pool, transfer_handle handle, u32 ticket);
+
+// moves the handle from TRANSFER_STATUS_PENDING to status if ticket is still its latest enqueue
+b8 transfer_handle_pool_cancel(transfer_handle_pool* handle_pool, transfer_handle handle, u32 ticket, transfer_status status);
+
+// same for whichever enqueue is the latest
+b8 transfer_handle_pool_cancel_current(transfer_handle_pool* handle_pool, transfer_handle handle, transfer_status status);
+
 b8 transfer_handle_pool_get_handle_status(transfer_handle_pool* handle_pool, transfer_handle handle, transfer_status* status);
 
 transfer_handle_fence_ref* transfer_handle_pool_get_handle_fence_ref(transfer_handle_pool* handle_pool, transfer_handle handle);
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+// worker: the flush's copy was recorded and submitted, or failed to be when submission is NULL
+void transfer_mirrored_buffer_record_submission(transfer_mirrored_buffer* mirror, const transfer_submission* submission);
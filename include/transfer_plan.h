@@ -0,0 +1,14 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+b8 transfer_plan_registry_create(transfer_plan_registry* registry);
+
+void transfer_plan_registry_destroy(transfer_plan_registry* registry);
+
+// invalidates every plan copying from or to buffer
+void transfer_plan_registry_buffer_destroyed(transfer_plan_registry* registry, VkBuffer buffer);
+
+// worker: the plan's submit was recorded and submitted, or failed to be (or was dropped) when submission is NULL
+void transfer_plan_record_submission(transfer_plan* plan, const transfer_submission* submission);
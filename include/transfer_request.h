@@ -0,0 +1,24 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+// fill in the queued form of a public request, shared by the engine and submit context entry points. the handle isn't
+// touched, the caller resets it before enqueueing
+void transfer_build_buffer_to_buffer_request(const buffer_to_buffer_request* buffer_transfer, transfer_request* request);
+
+void transfer_build_host_to_buffer_request(const host_to_buffer_request* host_transfer, transfer_request* request);
+
+void transfer_build_compressed_to_buffer_request(const compressed_to_buffer_request* compressed_transfer, transfer_request* request);
+
+void transfer_build_file_to_buffer_request(const file_to_buffer_request* file_transfer, transfer_request* request);
+
+void transfer_build_host_to_image_request(const host_to_image_request* image_transfer, transfer_request* request);
+
+// the host upload of a heap upload into its allocation
+void transfer_build_heap_upload_request(const heap_upload_request* upload, const transfer_allocation* allocation,
+                                        host_to_buffer_request* host_transfer);
+
+// marks the request pending and queues it for the worker, or completes it straight away on an upload dedup hit. false if
+// it couldn't be queued, with the handle failed. lives in vk_transfer.c next to the engine's own entry points
+b8 transfer_engine_enqueue_request(transfer_engine* engine, transfer_request* request);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+typedef enum transfer_scheduler_pop_result {
+    TRANSFER_SCHEDULER_POP_READY,
+    TRANSFER_SCHEDULER_POP_EMPTY,
+    // the earliest deadline request doesn't fit the budget, nothing behind it may overtake it
+    TRANSFER_SCHEDULER_POP_OVER_BUDGET,
+} transfer_scheduler_pop_result;
+
+b8 transfer_scheduler_create(transfer_scheduler* scheduler);
+
+void transfer_scheduler_destroy(transfer_scheduler* scheduler);
+
+// maps a public deadline_frame, where 0 means none, to the key requests are ordered by
+u64 transfer_scheduler_deadline_key(u64 deadline_frame);
+
+// worker only
+b8 transfer_scheduler_push(transfer_scheduler* scheduler, const transfer_request* request);
+
+// worker only: requests waiting in the scheduler
+u32 transfer_scheduler_count(const transfer_scheduler* scheduler);
+
+// worker only: the sequence the next push hands out
+u64 transfer_scheduler_next_sequence(const transfer_scheduler* scheduler);
+
+// worker only: whether the request pushed with this deadline and sequence was handed out or discarded. also true for
+// one whose push failed once anything with a higher key has left
+b8 transfer_scheduler_has_passed(const transfer_scheduler* scheduler, u64 deadline_frame, u64 sequence);
+
+// worker only: hands out the earliest deadline request if the budget allows it. on TRANSFER_SCHEDULER_POP_OVER_BUDGET
+// wait_ns is how long until the rate budget refills enough, or 0 if only a frame tick can help
+transfer_scheduler_pop_result transfer_scheduler_pop(transfer_scheduler* scheduler, transfer_request* request, u64* wait_ns);
+
+// worker only: the request the next pop would hand out, or NULL when empty. the budget isn't checked
+const transfer_request* transfer_scheduler_peek(transfer_scheduler* scheduler);
+
+// worker only: removes the request the next pop would hand out without charging it against the budget or the stats.
+// returns false when empty
+b8 transfer_scheduler_discard(transfer_scheduler* scheduler, transfer_request* request);
+
+// worker only: true if a frame tick or budget change happened since the last pop, so a stalled pop may now succeed
+b8 transfer_scheduler_budget_changed(transfer_scheduler* scheduler);
+
+void transfer_scheduler_frame_tick(transfer_scheduler* scheduler);
+
+void transfer_scheduler_set_budget(transfer_scheduler* scheduler, const transfer_budget* budget);
+
+void transfer_scheduler_get_stats(transfer_scheduler* scheduler, transfer_scheduler_stats* stats);
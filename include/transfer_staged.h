@@ -0,0 +1,18 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+// runs a request whose source has to pass through staging memory. the source is split into chunk sized pieces and
+// the CPU side fill of piece N + 1 overlaps the GPU copy of piece N. worker only
+void transfer_staged_execute(transfer_engine* engine, const transfer_request* request);
+
+// uploads a host request that fits in one chunk together with the host requests queued right behind it for the same
+// destination buffer, as one multi-region copy. the followers are taken from the scheduler and finished here, the first
+// request is left to the caller. returns false if request can't go through this path. worker only
+b8 transfer_staged_execute_batch(transfer_engine* engine, const transfer_request* request);
+
+// uploads a host to image request through one staging chunk: a layout transition to TRANSFER_DST_OPTIMAL, the copy and
+// a transition to the request's new layout in one submission. returns true with submission filled in once it's
+// submitted, otherwise the handle is failed. worker only
+b8 transfer_staged_execute_image(transfer_engine* engine, const transfer_request* request, transfer_submission* submission);
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+// grabs an idle command buffer, resets its fence and begins one time recording. worker only
+VkResult transfer_submission_begin(transfer_engine* engine, b8 ordered, transfer_submission* submission);
+
+// ends recording and submits to the transfer queue, signaling the submission's fence
+VkResult transfer_submission_submit(transfer_engine* engine, transfer_submission* submission);
+
+// gives back a begun submission that won't be submitted, so its fence doesn't stay unsignaled forever
+void transfer_submission_abandon(transfer_engine* engine, transfer_submission* submission);
+
+// points the request's handle at the submission's fence, moves it to TRANSFER_STATUS_EXECUTING and lets the upload dedup
+// cache know the request's content is on its way
+void transfer_submission_track_request(transfer_engine* engine, const transfer_submission* submission, const transfer_request* request);
+
+// worker: false if the request was cancelled or superseded since it was queued. once false it stays false
+b8 transfer_submission_is_request_live(transfer_engine* engine, const transfer_request* request);
+
+// worker: takes a request that left the scheduler, moving its handle to TRANSFER_STATUS_EXECUTING. returns false, with the
+// request already dropped, if it was cancelled or superseded
+b8 transfer_submission_claim_request(transfer_engine* engine, const transfer_request* request);
+
+// worker: drops cancelled and superseded requests from the front of the scheduler without charging them against the budget
+void transfer_submission_discard_dead_requests(transfer_engine* engine);
+
+// worker: gives back what a request that will never run was holding. its handle is left alone
+void transfer_submission_drop_request(transfer_engine* engine, const transfer_request* request);
+
+void transfer_record_ordering_barrier(VkCommandBuffer cmd);
+
+// makes transfer writes to [offset, offset + size) of buffer visible to the request's destination access/stage
+void transfer_record_dst_buffer_barrier(VkCommandBuffer cmd, const transfer_request* request, VkBuffer buffer, VkDeviceSize offset,
+                                        VkDeviceSize size);
+
+// moves the request's image region from its old layout to TRANSFER_DST_OPTIMAL
+void transfer_record_image_upload_barrier(VkCommandBuffer cmd, const transfer_request* request);
+
+// makes transfer writes to the request's image region visible to its destination access/stage, in the request's new layout
+void transfer_record_dst_image_barrier(VkCommandBuffer cmd, const transfer_request* request);
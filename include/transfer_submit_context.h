@@ -0,0 +1,20 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+b8 transfer_submit_context_registry_create(transfer_submit_context_registry* registry);
+
+void transfer_submit_context_registry_destroy(transfer_submit_context_registry* registry);
+
+// worker only: pops one request, visiting contexts round robin so no producer can starve the others. requests of
+// ordered contexts get their deadline raised so they can't sort ahead of the context's previous one in scheduler
+b8 transfer_submit_context_registry_pop(transfer_submit_context_registry* registry, const transfer_scheduler* scheduler,
+                                        transfer_request* request);
+
+b8 transfer_submit_context_registry_has_pending(transfer_submit_context_registry* registry);
+
+// total ring capacity of the registered contexts
+u32 transfer_submit_context_registry_capacity(transfer_submit_context_registry* registry);
+
+void transfer_request_queue_notify_worker(transfer_request_queue* request_queue);
@@ -3,24 +3,120 @@
 #include "common.h"
 #include "d_array.h"
 #include "d_queue.h"
+#include "file_reader.h"
+#include "spsc_ring.h"
+#include "task_pool.h"
 
 #define CMD_BUF_COUNT 5
 #define QUEUE_ENTRIES_COUNT 100
 #define TRANSFER_HANDLE_INVALID UINT32_MAX
+#define SUBMIT_CONTEXT_MAX_COUNT 64
+#define SUBMIT_CONTEXT_DEFAULT_CAPACITY 256
+#define STAGING_DEFAULT_SIZE (64ull * 1024 * 1024)
+#define STAGING_DEFAULT_CHUNK_SIZE (4ull * 1024 * 1024)
+#define FILE_READER_QUEUE_DEPTH 4
+#define HOST_IMPORT_DEFAULT_CACHE_CAPACITY 32
+#define HOST_IMPORT_DEFAULT_MIN_SIZE (256ull * 1024)
+#define UPLOAD_DEDUP_WAYS 4
+#define UPLOAD_DEDUP_DEFAULT_CAPACITY 4096
+#define UPLOAD_DEDUP_DST_BUCKET_COUNT 1024
+#define UPLOAD_DEDUP_NONE UINT32_MAX
+#define TRANSFER_DEADLINE_NONE UINT64_MAX
+#define SCHEDULER_INITIAL_CAPACITY 64
+#define SCHEDULER_BASE_LIMIT 256
+#define SCHEDULER_MAX_BURST_MS 16
+#define TRANSFER_CAPTURE_MAGIC 0x50414358u
+#define TRANSFER_CAPTURE_VERSION 2
+#define TRANSFER_CAPTURE_INITIAL_ID_CAPACITY 256
+#define UPLOAD_HEAP_ALIGNMENT 256ull
+#define UPLOAD_HEAP_DEFAULT_BLOCK_SIZE (64ull * 1024 * 1024)
+#define UPLOAD_HEAP_DEFAULT_MAX_BLOCK_COUNT 64
+#define UPLOAD_HEAP_SL_LOG2 4
+#define UPLOAD_HEAP_SL_COUNT (1u << UPLOAD_HEAP_SL_LOG2)
+#define UPLOAD_HEAP_FL_COUNT 32
+#define UPLOAD_HEAP_NODE_NONE UINT32_MAX
+#define UPLOAD_BATCH_MAX_REGIONS 32
+#define UPLOAD_HEAP_TRIM_BATCH 8
+#define DEFRAG_DEFAULT_BYTES_PER_FRAME (16ull * 1024 * 1024)
+#define MIRROR_DEFAULT_PAGE_SIZE 4096ull
+#define MIRROR_DEFAULT_MERGE_GAP (16ull * 1024)
+#define HOST_IMAGE_COPY_DEFAULT_HOST_SIZE (256ull * 1024)
+#define HOST_IMAGE_COPY_DEFAULT_MAX_HOST_SIZE (16ull * 1024 * 1024)
+#define HOST_IMAGE_COPY_MAX_DST_LAYOUTS 32
+#define HOST_IMAGE_COPY_EXPLORE_INTERVAL 16
 
 typedef enum transfer_type {
     TRANSFER_TYPE_BUFFER_TO_BUFFER,
+    TRANSFER_TYPE_FILE_TO_BUFFER,
+    TRANSFER_TYPE_HOST_TO_BUFFER,
+    TRANSFER_TYPE_COMPRESSED_TO_BUFFER,
+    TRANSFER_TYPE_HOST_TO_IMAGE,
+    TRANSFER_TYPE_PLAN,
 } transfer_type;
 
+typedef enum transfer_compression {
+    TRANSFER_COMPRESSION_LZ4,
+    TRANSFER_COMPRESSION_ZSTD,
+} transfer_compression;
+
+typedef struct transfer_compressed_block {
+    const void* src;
+    u32         compressed_size;
+    u32         decompressed_size;
+} transfer_compressed_block;
+
+typedef struct transfer_compressed_location {
+    const transfer_compressed_block* blocks;
+    u32                              block_count;
+    transfer_compression             compression;
+} transfer_compressed_location;
+
+typedef enum transfer_conversion_type {
+    TRANSFER_CONVERSION_NONE,
+    // 3 byte texels widened to 4, alpha set to 0xff
+    TRANSFER_CONVERSION_RGB8_TO_RGBA8,
+    // round to nearest even, NaN stays NaN
+    TRANSFER_CONVERSION_F32_TO_F16,
+    TRANSFER_CONVERSION_U16_TO_U32,
+    // reorders the 4 byte channels of each texel as described by transfer_conversion.swizzle
+    TRANSFER_CONVERSION_SWIZZLE_RGBA8,
+} transfer_conversion_type;
+
+typedef struct transfer_conversion {
+    transfer_conversion_type type;
+    // TRANSFER_CONVERSION_SWIZZLE_RGBA8 only: source channel (0..3) written to each destination channel
+    u8 swizzle[4];
+} transfer_conversion;
+
+typedef struct transfer_file_location {
+    i32 fd;
+    u64 offset;
+} transfer_file_location;
+
 typedef union transfer_location {
-    VkBuffer buffer;
-    VkImage  image;
+    VkBuffer                     buffer;
+    VkImage                      image;
+    transfer_file_location       file;
+    const void*                  host;
+    transfer_compressed_location compressed;
 } transfer_location;
 
 typedef enum transfer_internal_error {
     TRANSFER_INTERNAL_ERROR_NONE,
     TRANSFER_INTERNAL_ERROR_PTHREAD_CANNOT_CREATE,
     TRANSFER_INTERNAL_ERROR_CANT_POP_REQUEST,
+    TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY,
+    TRANSFER_INTERNAL_ERROR_TOO_MANY_SUBMIT_CONTEXTS,
+    TRANSFER_INTERNAL_ERROR_STAGING_UNAVAILABLE,
+    TRANSFER_INTERNAL_ERROR_NO_SUITABLE_MEMORY_TYPE,
+    TRANSFER_INTERNAL_ERROR_FILE_READ_FAILED,
+    TRANSFER_INTERNAL_ERROR_EXTENSION_NOT_ENABLED,
+    TRANSFER_INTERNAL_ERROR_DECOMPRESSION_UNAVAILABLE,
+    TRANSFER_INTERNAL_ERROR_DECOMPRESSION_FAILED,
+    TRANSFER_INTERNAL_ERROR_BLOCK_TOO_LARGE,
+    TRANSFER_INTERNAL_ERROR_CAPTURE_FILE_FAILED,
+    TRANSFER_INTERNAL_ERROR_IMAGE_TOO_LARGE,
+    TRANSFER_INTERNAL_ERROR_PLAN_INVALIDATED,
 } transfer_internal_error;
 
 typedef enum transfer_error_type {
@@ -41,6 +137,11 @@ typedef enum transfer_status {
     TRANSFER_STATUS_EXECUTING,
     TRANSFER_STATUS_COMPLETE,
     TRANSFER_STATUS_ERROR,
+    // removed from the queue by transfer_handle_cancel before the worker started it
+    TRANSFER_STATUS_CANCELLED,
+    // a later write covering the same destination range took its place while it was still pending, see
+    // transfer_engine_enable_latest_wins
+    TRANSFER_STATUS_SUPERSEDED,
 } transfer_status;
 
 typedef u32 transfer_handle;
@@ -48,29 +149,224 @@ typedef u32 transfer_handle;
 typedef struct buffer_to_buffer_request {
     VkBuffer src;
     VkBuffer dst;
+    // bytes copied from the start of src to the start of dst, both buffers must hold at least this many. ignored when
+    // regions are given
+    VkDeviceSize size;
+    // Optional: copies these regions instead. the array must stay valid until the handle is TRANSFER_STATUS_COMPLETE
+    const VkBufferCopy* regions;
+    u32                 region_count;
     // Optional: Value of 0 indicates safest but possibly the slowest barriers
     VkAccessFlags        dst_access_mask;
     VkPipelineStageFlags dst_stage_mask;
+    // Optional: frame (as counted by transfer_engine_frame_tick) that needs the data. 0 means no deadline, scheduled after
+    // every request that has one
+    u64 deadline_frame;
     // Optional: pass handle if you care to check the status of this transfer.
     // Pass TRANSFER_HANDLE_INVALID to ignore
     transfer_handle handle;
 } buffer_to_buffer_request;
 
-typedef struct transfer_request {
-    transfer_handle      handle;
-    transfer_location    src;
-    transfer_location    dst;
-    transfer_type        type;
+// streams size bytes of fd starting at file_offset into dst through engine staging memory.
+// requires transfer_engine_init_staging. fd must stay open until the handle leaves TRANSFER_STATUS_PENDING
+typedef struct file_to_buffer_request {
+    i32          fd;
+    u64          file_offset;
+    VkDeviceSize size;
+    VkBuffer     dst;
+    VkDeviceSize dst_offset;
+    // Optional: Value of 0 indicates safest but possibly the slowest barriers
     VkAccessFlags        dst_access_mask;
     VkPipelineStageFlags dst_stage_mask;
+    // Optional: frame (as counted by transfer_engine_frame_tick) that needs the data. 0 means no deadline, scheduled after
+    // every request that has one
+    u64 deadline_frame;
+    // Optional: pass handle if you care to check the status of this transfer.
+    // Pass TRANSFER_HANDLE_INVALID to ignore
+    transfer_handle handle;
+} file_to_buffer_request;
+
+// uploads size bytes at src into dst. src must stay valid and unmodified until the handle is TRANSFER_STATUS_COMPLETE,
+// since with host import enabled the GPU reads it in place
+typedef struct host_to_buffer_request {
+    const void* src;
+    // bytes read from src, a multiple of the conversion's source element size
+    VkDeviceSize size;
+    VkBuffer     dst;
+    VkDeviceSize dst_offset;
+    // Optional: converted on the way into staging memory, dst receives the converted elements.
+    // Zero initialized means a plain copy. Requires transfer_engine_init_staging
+    transfer_conversion conversion;
+    // Optional: Value of 0 indicates safest but possibly the slowest barriers
+    VkAccessFlags        dst_access_mask;
+    VkPipelineStageFlags dst_stage_mask;
+    // Optional: frame (as counted by transfer_engine_frame_tick) that needs the data. 0 means no deadline, scheduled after
+    // every request that has one
+    u64 deadline_frame;
+    // Optional: pass handle if you care to check the status of this transfer.
+    // Pass TRANSFER_HANDLE_INVALID to ignore
+    transfer_handle handle;
+} host_to_buffer_request;
+
+// decompresses blocks back to back into dst starting at dst_offset. blocks are decoded in parallel on the engine's
+// decompression threads straight into staging memory, so each block must decompress to at most the staging chunk size.
+// requires transfer_engine_init_staging and transfer_engine_init_decompression. blocks and the memory they point at must
+// stay valid until the handle leaves TRANSFER_STATUS_PENDING
+typedef struct compressed_to_buffer_request {
+    transfer_compression             compression;
+    const transfer_compressed_block* blocks;
+    u32                              block_count;
+    VkBuffer                         dst;
+    VkDeviceSize                     dst_offset;
+    // Optional: Value of 0 indicates safest but possibly the slowest barriers
+    VkAccessFlags        dst_access_mask;
+    VkPipelineStageFlags dst_stage_mask;
+    // Optional: frame (as counted by transfer_engine_frame_tick) that needs the data. 0 means no deadline, scheduled after
+    // every request that has one
+    u64 deadline_frame;
+    // Optional: pass handle if you care to check the status of this transfer.
+    // Pass TRANSFER_HANDLE_INVALID to ignore
+    transfer_handle handle;
+} compressed_to_buffer_request;
+
+// uploads size bytes at src into a region of dst and leaves the region in new_layout. src must stay valid until the handle
+// is TRANSFER_STATUS_COMPLETE. goes through staging, where the whole upload has to fit in one chunk, or with
+// transfer_engine_enable_host_image_copy may be written into the image by the CPU instead
+typedef struct host_to_image_request {
+    const void*  src;
+    VkDeviceSize size;
+    // Optional: row pitch and slice height of src in texels, 0 for tightly packed
+    u32                      row_length;
+    u32                      image_height;
+    VkImage                  dst;
+    VkImageSubresourceLayers subresource;
+    VkOffset3D               offset;
+    VkExtent3D               extent;
+    // layout of the region before the upload, VK_IMAGE_LAYOUT_UNDEFINED discards its contents
+    VkImageLayout old_layout;
+    VkImageLayout new_layout;
+    // usage dst was created with. host copies need VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT
+    VkImageUsageFlags usage;
+    // Optional: Value of 0 indicates safest but possibly the slowest barriers
+    VkAccessFlags        dst_access_mask;
+    VkPipelineStageFlags dst_stage_mask;
+    // Optional: frame (as counted by transfer_engine_frame_tick) that needs the data. 0 means no deadline, scheduled after
+    // every request that has one
+    u64 deadline_frame;
+    // Optional: pass handle if you care to check the status of this transfer.
+    // Pass TRANSFER_HANDLE_INVALID to ignore
+    transfer_handle handle;
+} host_to_image_request;
+
+typedef struct transfer_image_region {
+    VkImageSubresourceLayers subresource;
+    VkOffset3D               offset;
+    VkExtent3D               extent;
+    u32                      row_length;
+    u32                      image_height;
+    VkImageLayout            old_layout;
+    VkImageLayout            new_layout;
+    VkImageUsageFlags        usage;
+} transfer_image_region;
+
+typedef enum transfer_request_flag_bits {
+    TRANSFER_REQUEST_FLAG_NONE = 0,
+    // request must not start before every transfer submitted ahead of it has finished
+    TRANSFER_REQUEST_FLAG_ORDERED = 1 << 0,
+    // a defragmentation move, the defrag service waits on its submission
+    TRANSFER_REQUEST_FLAG_DEFRAG = 1 << 1,
+} transfer_request_flag_bits;
+typedef u32 transfer_request_flags;
+
+typedef struct transfer_request {
+    transfer_handle        handle;
+    transfer_location      src;
+    transfer_location      dst;
+    transfer_type          type;
+    transfer_request_flags flags;
+    VkAccessFlags          dst_access_mask;
+    VkPipelineStageFlags   dst_stage_mask;
+    VkDeviceSize           dst_offset;
+    // bytes written to dst
+    VkDeviceSize size;
+    // TRANSFER_TYPE_HOST_TO_BUFFER only
+    transfer_conversion conversion;
+    // TRANSFER_TYPE_BUFFER_TO_BUFFER only: copies these regions instead of the leading size bytes, size is their total.
+    // the memory belongs to whoever enqueued the request and must outlive it
+    const VkBufferCopy* regions;
+    u32                 region_count;
+    // flush of this mirrored buffer, the worker hands its regions back once they are recorded
+    struct transfer_mirrored_buffer* mirror;
+    // TRANSFER_TYPE_HOST_TO_IMAGE only
+    transfer_image_region image;
+    // TRANSFER_TYPE_PLAN only
+    struct transfer_plan* plan;
+    // TRANSFER_DEADLINE_NONE sorts after every real deadline
+    u64 deadline_frame;
+    // upload dedup cache entry this request will fill, 0 if untracked
+    u64 dedup_id;
+    // which enqueue of handle this is, a cancelled request still sitting in the queue must not claim the handle's next use
+    u32 handle_ticket;
+    // pending write table entry while latest wins is enabled, PENDING_WRITE_NONE if untracked
+    u32 pending_write;
 } transfer_request;
 
 typedef struct transfer_request_queue {
     d_queue         queue;
     pthread_cond_t  worker_notify_cond;
     pthread_mutex_t mutex;
+    // set by the worker while it is (about to be) blocked on worker_notify_cond. lets producers skip the mutex otherwise
+    atomic_bool worker_sleeping;
 } transfer_request_queue;
 
+typedef enum transfer_submit_context_flag_bits {
+    TRANSFER_SUBMIT_CONTEXT_FLAG_NONE = 0,
+    // every request from this context waits on all transfers submitted before it, so writes land in enqueue order
+    TRANSFER_SUBMIT_CONTEXT_FLAG_ORDERED = 1 << 0,
+} transfer_submit_context_flag_bits;
+typedef u32 transfer_submit_context_flags;
+
+typedef struct transfer_submit_context_create_info {
+    transfer_submit_context_flags flags;
+    // Optional: max number of in flight requests. 0 uses SUBMIT_CONTEXT_DEFAULT_CAPACITY
+    u32 capacity;
+} transfer_submit_context_create_info;
+
+typedef struct transfer_submit_context_stats {
+    u64 enqueued_count;
+    // requests the worker has taken off the context's ring
+    u64 dequeued_count;
+    // enqueue attempts rejected because the ring was full
+    u64 full_count;
+} transfer_submit_context_stats;
+
+// per producer thread submission path. only the thread that created the context may enqueue through it
+typedef struct transfer_submit_context {
+    spsc_ring                     ring;
+    struct transfer_engine*       engine;
+    transfer_submit_context_flags flags;
+
+    // written by the producer
+    alignas(SPSC_RING_CACHE_LINE_SIZE) atomic_uint_fast64_t enqueued_count;
+    atomic_uint_fast64_t full_count;
+
+    // written by the worker
+    alignas(SPSC_RING_CACHE_LINE_SIZE) atomic_uint_fast64_t dequeued_count;
+    // TRANSFER_SUBMIT_CONTEXT_FLAG_ORDERED: scheduler key of the last request handed to the scheduler. later ones never
+    // sort ahead of it while it is still queued
+    u64 floor_deadline_frame;
+    u64 floor_sequence;
+} transfer_submit_context;
+
+typedef struct transfer_submit_context_registry {
+    transfer_submit_context* contexts[SUBMIT_CONTEXT_MAX_COUNT];
+    u32                      count;
+    // sum of the registered rings' capacities
+    u32 capacity;
+    // worker only: where the next round robin pass starts
+    u32             next_idx;
+    pthread_mutex_t mutex;
+} transfer_submit_context_registry;
+
 typedef struct transfer_command_pool {
     VkCommandPool        pool;
     VkCommandBuffer      buffers[CMD_BUF_COUNT];
@@ -84,19 +380,682 @@ typedef struct transfer_handle_fence_ref {
     u32     fence_idx;
 } transfer_handle_fence_ref;
 
+typedef struct transfer_staging_create_info {
+    VkPhysicalDevice physical_device;
+    // Optional: total bytes of host visible staging memory. 0 uses STAGING_DEFAULT_SIZE
+    VkDeviceSize size;
+    // Optional: unit the CPU fills and the GPU copies out of, rounded up to nonCoherentAtomSize. 0 uses
+    // STAGING_DEFAULT_CHUNK_SIZE
+    VkDeviceSize chunk_size;
+    // prefer HOST_CACHED memory. worth it when the CPU reads back what it writes, like LZ4 match copies during decompression
+    b8 host_cached;
+} transfer_staging_create_info;
+
+typedef struct transfer_decompression_create_info {
+    // Optional: 0 uses half the online CPUs
+    u32 thread_count;
+} transfer_decompression_create_info;
+
+typedef struct staging_chunk {
+    VkDeviceSize offset;
+    // submission still reading from the chunk. vk_fence is VK_NULL_HANDLE when the chunk is idle
+    transfer_handle_fence_ref fence_ref;
+} staging_chunk;
+
+// persistently mapped host visible buffer split into fixed size chunks that are handed out round robin.
+// only the worker touches it once the engine is running
+typedef struct staging_buffer {
+    VkBuffer       buffer;
+    VkDeviceMemory memory;
+    u8*            mapped;
+    VkDeviceSize   chunk_size;
+    b8             coherent;
+    VkDeviceSize   non_coherent_atom_size;
+    d_array        chunks;
+    u32            next_chunk;
+} staging_buffer;
+
+typedef struct transfer_host_import_create_info {
+    VkPhysicalDevice physical_device;
+    // Optional: max number of imported ranges kept alive. 0 uses HOST_IMPORT_DEFAULT_CACHE_CAPACITY
+    u32 cache_capacity;
+    // Optional: uploads smaller than this go through staging, where a memcpy beats an import. 0 uses HOST_IMPORT_DEFAULT_MIN_SIZE
+    VkDeviceSize min_import_size;
+} transfer_host_import_create_info;
+
+typedef struct host_import_entry {
+    // page aligned range of host memory backing buffer
+    uintptr_t      base;
+    VkDeviceSize   size;
+    VkDeviceMemory memory;
+    VkBuffer       buffer;
+    u64            last_use;
+    // last submission reading from the import
+    transfer_handle_fence_ref fence_ref;
+    // set between host_import_cache_acquire and host_import_cache_retire, the entry can't be dropped meanwhile
+    b8 in_use;
+} host_import_entry;
+
+// host ranges imported through VK_EXT_external_memory_host, keyed by address range and evicted least recently used
+typedef struct host_import_cache {
+    PFN_vkGetMemoryHostPointerPropertiesEXT get_memory_host_pointer_properties;
+    VkPhysicalDevice                        physical_device;
+    VkDeviceSize                            alignment;
+    VkDeviceSize                            min_import_size;
+    u32                                     capacity;
+    u64                                     use_counter;
+    d_array                                 entries;
+    pthread_mutex_t                         mutex;
+} host_import_cache;
+
+typedef struct transfer_upload_dedup_create_info {
+    // Optional: max number of remembered destination ranges, rounded up to a power of two. 0 uses UPLOAD_DEDUP_DEFAULT_CAPACITY
+    u32 capacity;
+    // Optional: uploads smaller than this skip the cache. 0 considers every upload
+    VkDeviceSize min_size;
+} transfer_upload_dedup_create_info;
+
+typedef struct transfer_upload_dedup_stats {
+    u64 hit_count;
+    u64 miss_count;
+    // bytes that never had to be transferred thanks to hits
+    u64 bytes_saved;
+    u64 invalidation_count;
+    u64 eviction_count;
+} transfer_upload_dedup_stats;
+
+typedef struct upload_dedup_entry {
+    // VK_NULL_HANDLE marks an empty slot
+    VkBuffer     dst;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    u64          content_hash;
+    u64          last_use;
+    u64          dedup_id;
+    // submission writing the content. vk_fence is VK_NULL_HANDLE while the upload is still queued
+    transfer_handle_fence_ref fence_ref;
+    // neighbours in the dst bucket's list, only meaningful while dst is set
+    u32 dst_prev;
+    u32 dst_next;
+} upload_dedup_entry;
+
+// remembers what the engine last wrote to (buffer, offset, size) so byte identical re-uploads can complete immediately.
+// set associative with UPLOAD_DEDUP_WAYS ways, so memory stays at capacity entries
+typedef struct upload_dedup_cache {
+    upload_dedup_entry* entries;
+    u32                 set_mask;
+    VkDeviceSize        min_size;
+    u64                 use_counter;
+    u64                 next_dedup_id;
+    // live entries listed by destination buffer hash, so invalidating a range only walks entries that may share its buffer
+    u32             dst_buckets[UPLOAD_DEDUP_DST_BUCKET_COUNT];
+    pthread_mutex_t mutex;
+
+    atomic_uint_fast64_t hit_count;
+    atomic_uint_fast64_t miss_count;
+    atomic_uint_fast64_t bytes_saved;
+    atomic_uint_fast64_t invalidation_count;
+    atomic_uint_fast64_t eviction_count;
+} upload_dedup_cache;
+
+#define PENDING_WRITE_NONE UINT32_MAX
+#define PENDING_WRITE_BUCKET_COUNT 64
+#define PENDING_WRITE_INITIAL_CAPACITY 64
+
+typedef struct transfer_latest_wins_stats {
+    u64 superseded_count;
+    // bytes that never had to be transferred because a later write replaced them
+    u64 superseded_bytes;
+} transfer_latest_wins_stats;
+
+typedef enum pending_write_state {
+    PENDING_WRITE_FREE,
+    PENDING_WRITE_QUEUED,
+    // a later write took over, the request is dropped once it reaches the front of the queue
+    PENDING_WRITE_SUPERSEDED,
+    // a copy queued after it reads the buffer, so it has to land and can't be superseded. no longer in a bucket
+    PENDING_WRITE_PINNED,
+} pending_write_state;
+
+typedef struct pending_write {
+    VkBuffer     dst;
+    VkDeviceSize offset;
+    // exclusive
+    VkDeviceSize    end;
+    VkDeviceSize    size;
+    transfer_handle handle;
+    u32             handle_ticket;
+    // next queued write in the same bucket, or the next free entry
+    u32                 next;
+    pending_write_state state;
+} pending_write;
+
+// destination ranges of the buffer writes still waiting for the worker, chained per destination buffer bucket
+typedef struct pending_write_table {
+    d_array         writes;
+    u32             free_head;
+    u32             buckets[PENDING_WRITE_BUCKET_COUNT];
+    pthread_mutex_t mutex;
+
+    atomic_uint_fast64_t superseded_count;
+    atomic_uint_fast64_t superseded_bytes;
+} pending_write_table;
+
+typedef struct transfer_upload_heap_create_info {
+    VkPhysicalDevice physical_device;
+    // Optional: bytes per device local block, each one a single VkBuffer. 0 uses UPLOAD_HEAP_DEFAULT_BLOCK_SIZE
+    VkDeviceSize block_size;
+    // Optional: blocks are allocated on demand up to this many. 0 uses UPLOAD_HEAP_DEFAULT_MAX_BLOCK_COUNT
+    u32 max_block_count;
+    // Optional: usage the block buffers need beyond TRANSFER_SRC | TRANSFER_DST, e.g. VERTEX_BUFFER | INDEX_BUFFER
+    VkBufferUsageFlags usage;
+} transfer_upload_heap_create_info;
+
+// a range of one heap block. offset is UPLOAD_HEAP_ALIGNMENT aligned
+typedef struct transfer_allocation {
+    VkBuffer     buffer;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    // identifies the allocation to transfer_engine_heap_free
+    u32 node_idx;
+} transfer_allocation;
+
+typedef struct transfer_upload_heap_stats {
+    u32          block_count;
+    u64          allocation_count;
+    VkDeviceSize reserved_bytes;
+    VkDeviceSize allocated_bytes;
+} transfer_upload_heap_stats;
+
+// allocates size bytes from the engine's upload heap and uploads src into them
+typedef struct heap_upload_request {
+    const void* src;
+    // bytes read from src, a multiple of the conversion's source element size
+    VkDeviceSize size;
+    // Optional: as in host_to_buffer_request, the allocation is sized for the converted elements
+    transfer_conversion conversion;
+    // Optional: Value of 0 indicates safest but possibly the slowest barriers
+    VkAccessFlags        dst_access_mask;
+    VkPipelineStageFlags dst_stage_mask;
+    // Optional: frame (as counted by transfer_engine_frame_tick) that needs the data. 0 means no deadline
+    u64 deadline_frame;
+    // Optional: pass handle if you care to check the status of this transfer.
+    // Pass TRANSFER_HANDLE_INVALID to ignore
+    transfer_handle handle;
+} heap_upload_request;
+
+typedef struct upload_heap_node {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    u32          block_idx;
+    // neighbours in address order within the block
+    u32 prev_phys;
+    u32 next_phys;
+    // free list links. next_free also chains nodes that are back in the node pool
+    u32 prev_free;
+    u32 next_free;
+    b8  free;
+} upload_heap_node;
+
+typedef struct upload_heap_block {
+    // VK_NULL_HANDLE once the block was trimmed, the slot is reused by the next block
+    VkBuffer       buffer;
+    VkDeviceMemory memory;
+    VkDeviceSize   size;
+    VkDeviceSize   allocated;
+    // node at offset 0, it keeps its index for the block's lifetime
+    u32 first_node;
+} upload_heap_block;
+
+// one per block slot, size 0 for an empty slot
+typedef struct upload_heap_block_usage {
+    VkDeviceSize size;
+    VkDeviceSize allocated;
+} upload_heap_block_usage;
+
+// TLSF sub-allocator over device local blocks. two level segregated free lists indexed by bitmaps make allocate and free
+// O(1), a mutex makes them safe from any thread
+typedef struct upload_heap {
+    VkDevice           device;
+    VkPhysicalDevice   physical_device;
+    VkDeviceSize       block_size;
+    u32                max_block_count;
+    VkBufferUsageFlags usage;
+
+    d_array blocks;
+    u32     block_count;
+    d_array nodes;
+    u32     unused_nodes;
+
+    u32 fl_bitmap;
+    u32 sl_bitmaps[UPLOAD_HEAP_FL_COUNT];
+    u32 free_heads[UPLOAD_HEAP_FL_COUNT][UPLOAD_HEAP_SL_COUNT];
+
+    u64             allocation_count;
+    VkDeviceSize    allocated_bytes;
+    pthread_mutex_t mutex;
+} upload_heap;
+
+typedef struct transfer_defrag_create_info {
+    // Optional: bytes moved between two transfer_engine_frame_tick calls. 0 uses DEFRAG_DEFAULT_BYTES_PER_FRAME
+    u64 bytes_per_frame;
+} transfer_defrag_create_info;
+
+// the contents of old_allocation are now also in new_allocation. the caller switches over and frees old_allocation
+// once nothing reads it anymore
+typedef struct transfer_relocation {
+    transfer_allocation old_allocation;
+    transfer_allocation new_allocation;
+} transfer_relocation;
+
+typedef struct transfer_defrag_stats {
+    b8 running;
+    // movable allocations not moved yet
+    u32 remaining_count;
+    // relocations published but not taken yet
+    u32 relocation_count;
+    u64 moved_count;
+    u64 moved_bytes;
+} transfer_defrag_stats;
+
+typedef enum defrag_move_state {
+    DEFRAG_MOVE_WAITING,
+    DEFRAG_MOVE_IN_FLIGHT,
+    DEFRAG_MOVE_DONE,
+    // no other block has room for it
+    DEFRAG_MOVE_STUCK,
+} defrag_move_state;
+
+typedef struct defrag_move {
+    transfer_allocation src;
+    transfer_allocation dst;
+    u32                 src_block;
+    defrag_move_state   state;
+} defrag_move;
+
+typedef enum defrag_step_state {
+    DEFRAG_STEP_NONE,
+    // enqueued, the worker hasn't submitted it yet
+    DEFRAG_STEP_QUEUED,
+    DEFRAG_STEP_SUBMITTED,
+    DEFRAG_STEP_FAILED,
+} defrag_step_state;
+
+// drains the emptiest heap blocks into the fullest ones a step at a time. a step is one multi-region buffer_to_buffer
+// copy from one block to another, at most bytes_per_frame big
+typedef struct transfer_defrag {
+    d_array moves;
+    // regions of the step in flight
+    d_array regions;
+    // reserved for every move up front so publishing never fails
+    d_array relocations;
+    // scratch for planning
+    d_array block_usage;
+    d_array targets;
+    // per block slot: 1 once the block was a source, it never becomes a target afterwards
+    d_array drained;
+
+    u64                       bytes_per_frame;
+    b8                        running;
+    defrag_step_state         step_state;
+    transfer_handle_fence_ref step_fence_ref;
+    u64                       moved_count;
+    u64                       moved_bytes;
+    pthread_mutex_t           mutex;
+} transfer_defrag;
+
+typedef struct transfer_mirrored_buffer_create_info {
+    VkPhysicalDevice physical_device;
+    // the device buffer kept in sync with the host mirror
+    VkBuffer     dst;
+    VkDeviceSize dst_offset;
+    VkDeviceSize size;
+    // Optional: granularity of dirty tracking, rounded up to a power of two and nonCoherentAtomSize. 0 uses MIRROR_DEFAULT_PAGE_SIZE
+    VkDeviceSize page_size;
+    // Optional: dirty ranges separated by at most this many clean bytes are copied as one region. 0 uses MIRROR_DEFAULT_MERGE_GAP
+    VkDeviceSize merge_gap;
+    // Optional: Value of 0 indicates safest but possibly the slowest barriers
+    VkAccessFlags        dst_access_mask;
+    VkPipelineStageFlags dst_stage_mask;
+} transfer_mirrored_buffer_create_info;
+
+typedef struct transfer_mirrored_buffer_stats {
+    u64 flush_count;
+    u64 region_count;
+    u64 flushed_bytes;
+} transfer_mirrored_buffer_stats;
+
+// a persistently mapped host copy of (part of) a device buffer. writes mark pages dirty in a bitmap, a flush copies only
+// the dirty pages as one multi-region buffer_to_buffer copy
+typedef struct transfer_mirrored_buffer {
+    struct transfer_engine* engine;
+    VkBuffer         src;
+    VkDeviceMemory   memory;
+    VkDeviceSize     memory_size;
+    u8*              mapped;
+    b8               coherent;
+
+    VkBuffer             dst;
+    VkDeviceSize         dst_offset;
+    VkDeviceSize         size;
+    VkAccessFlags        dst_access_mask;
+    VkPipelineStageFlags dst_stage_mask;
+
+    VkDeviceSize page_size;
+    u32          page_shift;
+    VkDeviceSize merge_gap;
+
+    // one bit per page, set by any writer and swapped out by the flush
+    atomic_uint_fast64_t* dirty_words;
+    u32                   dirty_word_count;
+
+    // regions of the last flush. owned by the worker while flush_queued is set
+    d_array                   regions;
+    atomic_bool               flush_queued;
+    transfer_handle_fence_ref fence_ref;
+
+    u64 flush_count;
+    u64 region_count;
+    u64 flushed_bytes;
+} transfer_mirrored_buffer;
+
+typedef struct transfer_plan_copy {
+    VkBuffer            src;
+    VkBuffer            dst;
+    const VkBufferCopy* regions;
+    u32                 region_count;
+} transfer_plan_copy;
+
+typedef struct transfer_plan_create_info {
+    // only read during transfer_plan_create
+    const transfer_plan_copy* copies;
+    u32                       copy_count;
+    // Optional: Value of 0 indicates safest but possibly the slowest barriers
+    VkAccessFlags        dst_access_mask;
+    VkPipelineStageFlags dst_stage_mask;
+} transfer_plan_create_info;
+
+// a fixed set of buffer copies recorded once into a secondary command buffer. every submit replays it with a single
+// vkCmdExecuteCommands instead of recording the copies again
+typedef struct transfer_plan {
+    struct transfer_engine* engine;
+    VkCommandPool           pool;
+    VkCommandBuffer         cmd;
+    // bytes copied per submit, what the budget is charged
+    VkDeviceSize size;
+
+    // the plan's own copies of create_info's copies and regions
+    transfer_plan_copy* copies;
+    u32                 copy_count;
+    VkBufferCopy*       regions;
+    // every buffer the copies read or write, once each
+    VkBuffer* buffers;
+    u32       buffer_count;
+
+    // cleared once one of buffers is destroyed
+    atomic_bool valid;
+    // submits the worker hasn't recorded yet
+    atomic_uint               queued_count;
+    transfer_handle_fence_ref fence_ref;
+
+    // engine's plan registry
+    struct transfer_plan* prev;
+    struct transfer_plan* next;
+} transfer_plan;
+
+typedef struct transfer_plan_registry {
+    transfer_plan*  head;
+    pthread_mutex_t mutex;
+} transfer_plan_registry;
+
+typedef struct transfer_host_image_copy_create_info {
+    VkPhysicalDevice physical_device;
+    // Optional: CPU threads running host copies. 0 uses half the online CPUs
+    u32 thread_count;
+    // Optional: uploads up to this size always take the host path, a queue submission's fixed cost dominates them.
+    // 0 uses HOST_IMAGE_COPY_DEFAULT_HOST_SIZE
+    VkDeviceSize host_size;
+    // Optional: uploads bigger than this always take the queue path. 0 uses HOST_IMAGE_COPY_DEFAULT_MAX_HOST_SIZE
+    VkDeviceSize max_host_size;
+} transfer_host_image_copy_create_info;
+
+typedef struct transfer_host_image_copy_stats {
+    u64 host_count;
+    u64 host_bytes;
+    // image uploads that went through staging and the queue
+    u64 queue_count;
+    u64 queue_bytes;
+    // measured over uploads between host_size and max_host_size, 0 until the first sample
+    u64 host_bytes_per_ms;
+    u64 queue_bytes_per_ms;
+} transfer_host_image_copy_stats;
+
+// times one queue image upload from the start of its staging fill until its fence signals
+typedef struct host_image_copy_probe {
+    // vk_fence is VK_NULL_HANDLE when the slot is idle
+    transfer_handle_fence_ref fence_ref;
+    VkDeviceSize              size;
+    u64                       start_ns;
+    // the fence was last seen unsignaled at this time, so the copy finished between it and the poll that sees it signaled
+    u64 pending_ns;
+} host_image_copy_probe;
+
+// image uploads written by CPU threads through VK_EXT_host_image_copy, no staging, command buffer or layout barrier.
+// each upload picks the host or the queue path from its size and the throughput both paths were measured at
+typedef struct host_image_copy {
+    PFN_vkCopyMemoryToImageEXT     copy_memory_to_image;
+    PFN_vkTransitionImageLayoutEXT transition_image_layout;
+    VkDevice                       device;
+    VkImageLayout                  dst_layouts[HOST_IMAGE_COPY_MAX_DST_LAYOUTS];
+    u32                            dst_layout_count;
+    VkDeviceSize                   host_size;
+    VkDeviceSize                   max_host_size;
+
+    task_pool            pool;
+    u32                  max_in_flight;
+    atomic_uint_fast32_t in_flight;
+
+    // worker only. probes are indexed by command buffer
+    host_image_copy_probe probes[CMD_BUF_COUNT];
+    u64                   contested_count;
+
+    // moving averages in bytes per ms, the host one is updated from the copy threads
+    u64             host_bytes_per_ms;
+    u64             queue_bytes_per_ms;
+    pthread_mutex_t mutex;
+
+    atomic_uint_fast64_t host_count;
+    atomic_uint_fast64_t host_bytes;
+    atomic_uint_fast64_t queue_count;
+    atomic_uint_fast64_t queue_bytes;
+} host_image_copy;
+
+typedef struct transfer_budget {
+    // Optional: bytes the worker may start between two transfer_engine_frame_tick calls. 0 leaves frames unmetered
+    u64 bytes_per_frame;
+    // Optional: sustained bytes per millisecond, with bursts of up to SCHEDULER_MAX_BURST_MS worth. 0 leaves it unmetered
+    u64 bytes_per_ms;
+} transfer_budget;
+
+typedef struct transfer_scheduler_stats {
+    u64 frame_index;
+    u64 dispatched_count;
+    u64 dispatched_bytes;
+    // dispatched requests that carried a deadline
+    u64 deadline_count;
+    // requests started during or after the frame they were needed by
+    u64 deadline_miss_count;
+    // times the worker went idle with requests queued because the budget was spent
+    u64 budget_stall_count;
+} transfer_scheduler_stats;
+
+typedef struct scheduled_request {
+    // enqueue order, breaks ties between equal deadlines so they stay FIFO
+    u64              sequence;
+    transfer_request request;
+} scheduled_request;
+
+// earliest deadline first queue in front of the worker, metered by a transfer_budget.
+// everything but the atomics is owned by the worker
+typedef struct transfer_scheduler {
+    // binary min heap of scheduled_request
+    d_array heap;
+    u64     next_sequence;
+    // highest key handed out or discarded so far. every request with a lower key that was pushed before has left
+    u64 passed_deadline_frame;
+    u64 passed_sequence;
+
+    // frame the worker last saw and the bytes it started since
+    u64 frame_index;
+    u64 frame_spent;
+    // bytes_per_ms token bucket. goes negative after a request bigger than a full bucket
+    i64 rate_tokens;
+    u64 rate_refill_time_ns;
+    u64 seen_budget_generation;
+    b8  stalled;
+
+    // written by any thread
+    atomic_uint_fast64_t current_frame;
+    atomic_uint_fast64_t bytes_per_frame;
+    atomic_uint_fast64_t bytes_per_ms;
+    atomic_uint_fast64_t budget_generation;
+
+    atomic_uint_fast64_t dispatched_count;
+    atomic_uint_fast64_t dispatched_bytes;
+    atomic_uint_fast64_t deadline_count;
+    atomic_uint_fast64_t deadline_miss_count;
+    atomic_uint_fast64_t budget_stall_count;
+} transfer_scheduler;
+
+typedef enum transfer_capture_event {
+    TRANSFER_CAPTURE_EVENT_REQUEST,
+    TRANSFER_CAPTURE_EVENT_FRAME_TICK,
+} transfer_capture_event;
+
+typedef struct transfer_capture_header {
+    u32 magic;
+    u32 version;
+    u32 record_size;
+    u32 reserved;
+    // engine frame index when the capture began, deadline_frame values are on the same scale
+    u64 start_frame;
+} transfer_capture_header;
+
+// one fixed size record per event, written in host byte order. payloads, pointers and handles are never captured,
+// buffers, fds, contexts and threads are replaced by small ids in order of first appearance
+typedef struct transfer_capture_record {
+    // since transfer_engine_begin_capture
+    u64 timestamp_ns;
+    // bytes written to dst
+    u64 size;
+    // bytes read from the source: host bytes before conversion, file bytes or compressed bytes
+    u64 src_size;
+    // TRANSFER_TYPE_FILE_TO_BUFFER: file offset
+    u64 src_offset;
+    u64 dst_offset;
+    // as passed in, 0 for none
+    u64 deadline_frame;
+    u32 dst_id;
+    // TRANSFER_TYPE_BUFFER_TO_BUFFER: source buffer id, TRANSFER_TYPE_FILE_TO_BUFFER: fd id
+    u32 src_id;
+    u32 producer_id;
+    // 0 for the engine wide queue
+    u32 context_id;
+    u32 block_count;
+    u32 dst_access_mask;
+    u32 dst_stage_mask;
+    // TRANSFER_TYPE_BUFFER_TO_BUFFER: regions copied, size is their total. 0 for a plain copy of size bytes
+    u32 region_count;
+    u8  event;
+    u8  type;
+    u8  context_flags;
+    u8  conversion;
+    u8  compression;
+    u8  swizzle[4];
+    u8  reserved[7];
+} transfer_capture_record;
+
+typedef enum transfer_capture_id_kind {
+    TRANSFER_CAPTURE_ID_BUFFER,
+    TRANSFER_CAPTURE_ID_FILE,
+    TRANSFER_CAPTURE_ID_CONTEXT,
+    TRANSFER_CAPTURE_ID_PRODUCER,
+    TRANSFER_CAPTURE_ID_KIND_COUNT,
+} transfer_capture_id_kind;
+
+typedef struct transfer_capture_id_entry {
+    // 0 marks an empty slot, keys are stored + 1
+    u64 key;
+    u32 kind;
+    u32 id;
+} transfer_capture_id_entry;
+
+typedef struct transfer_capture {
+    FILE* file;
+    u64   start_time_ns;
+    u64   record_count;
+    // a write failed, the file is truncated
+    b8 failed;
+    // open addressing map from (kind, value) to id, sized to a power of two
+    transfer_capture_id_entry* ids;
+    u32                        id_capacity;
+    u32                        id_count;
+    u32                        next_id[TRANSFER_CAPTURE_ID_KIND_COUNT];
+    pthread_mutex_t            mutex;
+} transfer_capture;
+
+typedef struct transfer_submission {
+    i32             cmd_idx;
+    VkCommandBuffer cmd;
+    VkFence         fence;
+    u64             fence_generation;
+} transfer_submission;
+
 typedef struct transfer_handle_pool {
     d_array available_indices;
     d_array handle_slots;
 } transfer_handle_pool;
 
 typedef struct transfer_engine {
-    VkDevice               vk_device;
-    VkQueue                vk_queue;
-    transfer_command_pool  command_pool;
-    transfer_handle_pool   handle_pool;
-    transfer_request_queue request_queue;
+    VkDevice                         vk_device;
+    VkQueue                          vk_queue;
+    u32                              queue_family;
+    transfer_command_pool            command_pool;
+    transfer_handle_pool             handle_pool;
+    transfer_request_queue           request_queue;
+    transfer_submit_context_registry submit_contexts;
+    transfer_plan_registry           plans;
+    transfer_scheduler               scheduler;
+
+    transfer_capture capture;
+    atomic_bool      capture_active;
+
+    upload_heap     upload_heap;
+    atomic_bool     upload_heap_ready;
+    transfer_defrag defrag;
+
+    VkPhysicalDevice vk_physical_device;
+    staging_buffer   staging;
+    file_reader      file_reader;
+    atomic_bool      staging_ready;
+
+    host_import_cache host_import;
+    atomic_bool       host_import_ready;
+
+    host_image_copy host_image_copy;
+    atomic_bool     host_image_copy_ready;
+
+    task_pool   decompression_pool;
+    atomic_bool decompression_ready;
+
+    upload_dedup_cache upload_dedup;
+    atomic_bool        upload_dedup_ready;
+
+    pending_write_table pending_writes;
+    atomic_bool         latest_wins_ready;
 
     pthread_t worker_thread;
+    b8        worker_started;
 
     atomic_bool should_close;
 } transfer_engine;
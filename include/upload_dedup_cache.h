@@ -0,0 +1,28 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+b8 upload_dedup_cache_create(upload_dedup_cache* cache, const transfer_upload_dedup_create_info* create_info);
+
+void upload_dedup_cache_destroy(upload_dedup_cache* cache);
+
+// called for every request before it's queued. returns true if the destination already holds (or an in flight submission
+// is writing) the request's content, in which case hit_fence_ref is that submission and nothing needs to be transferred.
+// any request writing a range invalidates what the cache knew about it
+b8 upload_dedup_cache_filter_request(upload_dedup_cache* cache, transfer_request* request, transfer_handle_fence_ref* hit_fence_ref);
+
+// worker: the request's content is being written by submission
+void upload_dedup_cache_record_submission(upload_dedup_cache* cache, const transfer_request* request, const transfer_submission* submission);
+
+// worker, or the enqueue path when queueing failed: called once the request has been handled. drops its entry if it
+// never got submitted
+void upload_dedup_cache_finish_request(upload_dedup_cache* cache, const transfer_request* request);
+
+// producer side entry point used by every enqueue path. returns true if the request was completed from the cache and must not
+// be queued
+b8 upload_dedup_try_complete_request(transfer_engine* engine, transfer_request* request);
+
+void upload_dedup_cache_invalidate(upload_dedup_cache* cache, VkBuffer dst, VkDeviceSize offset, VkDeviceSize size);
+
+void upload_dedup_cache_get_stats(upload_dedup_cache* cache, transfer_upload_dedup_stats* stats);
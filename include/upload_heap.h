@@ -0,0 +1,29 @@
+#pragma once
+
+#include "common.h"
+#include "transfer_types.h"
+
+b8 upload_heap_create(upload_heap* heap, VkDevice device, const transfer_upload_heap_create_info* create_info);
+
+void upload_heap_destroy(upload_heap* heap);
+
+// returns false once no block has room and max_block_count blocks exist, or the device is out of memory.
+// allocations bigger than block_size get a block of their own
+b8 upload_heap_allocate(upload_heap* heap, VkDeviceSize size, transfer_allocation* allocation);
+
+// first fit by address inside one block, so data packs towards the front. O(ranges in the block), meant for defragmentation
+b8 upload_heap_allocate_in_block(upload_heap* heap, u32 block_idx, VkDeviceSize size, transfer_allocation* allocation);
+
+void upload_heap_free(upload_heap* heap, const transfer_allocation* allocation);
+
+u32 upload_heap_allocation_block(upload_heap* heap, const transfer_allocation* allocation);
+
+// resizes usage to one upload_heap_block_usage per block slot
+b8 upload_heap_get_block_usage(upload_heap* heap, d_array* usage);
+
+// takes up to max_count blocks without allocations out of the heap. the caller releases them with upload_heap_release_block
+u32 upload_heap_detach_empty_blocks(upload_heap* heap, upload_heap_block* blocks, u32 max_count);
+
+void upload_heap_release_block(upload_heap* heap, const upload_heap_block* block);
+
+void upload_heap_get_stats(upload_heap* heap, transfer_upload_heap_stats* stats);
@@ -0,0 +1,7 @@
+#pragma once
+
+#include "common.h"
+
+// picks a memory type allowed by type_bits that has all required flags, preferring one that also has preferred flags
+b8 vk_memory_find_type(VkPhysicalDevice physical_device, u32 type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+                       u32* memory_type_idx, VkMemoryPropertyFlags* memory_type_flags);
@@ -5,10 +5,174 @@
 
 b8 transfer_engine_init(transfer_engine* engine, VkDevice device, u32 transfer_queue_family, transfer_error* error);
 
+// creates the engine's staging memory. required before any request that streams through staging
+b8 transfer_engine_init_staging(transfer_engine* engine, const transfer_staging_create_info* create_info, transfer_error* error);
+
+// starts the CPU threads that decompress compressed_to_buffer_request blocks into staging memory
+b8 transfer_engine_init_decompression(transfer_engine* engine, const transfer_decompression_create_info* create_info,
+                                      transfer_error* error);
+
+// remembers the content hash of host uploads per destination range so byte identical re-uploads complete without a transfer
+b8 transfer_engine_enable_upload_dedup(transfer_engine* engine, const transfer_upload_dedup_create_info* create_info, transfer_error* error);
+
+void transfer_engine_get_upload_dedup_stats(transfer_engine* engine, transfer_upload_dedup_stats* stats);
+
+// from now on a buffer write that fully covers the destination range of a write to the same buffer still waiting for the
+// worker replaces it: the older one is never transferred and its handle goes to TRANSFER_STATUS_SUPERSEDED. the newer one
+// keeps its own deadline. buffer copies cover their leading size bytes, region copies, images and the engine's own writes are
+// neither superseded nor supersede. a copy or plan queued in between that reads the buffer keeps the older write alive
+b8 transfer_engine_enable_latest_wins(transfer_engine* engine, transfer_error* error);
+
+void transfer_engine_get_latest_wins_stats(transfer_engine* engine, transfer_latest_wins_stats* stats);
+
+// tells the engine something outside of it (a shader, a mapped write...) changed the range. pass VK_WHOLE_SIZE for the whole buffer
+void transfer_engine_invalidate_buffer_range(transfer_engine* engine, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size);
+
+// must be called when a buffer the engine has written to is destroyed, before the handle can be reused
+void transfer_engine_notify_buffer_destroyed(transfer_engine* engine, VkBuffer buffer);
+
+// caps how many bytes the worker starts per frame and/or per millisecond. requests run earliest deadline first, and the
+// earliest one waits for budget rather than letting later ones overtake it. requests writing overlapping ranges must
+// carry non decreasing deadlines, or go through a TRANSFER_SUBMIT_CONTEXT_FLAG_ORDERED context, to land in enqueue order.
+// a request costs the bytes it writes. uploads the dedup cache completes without a copy cost nothing
+void transfer_engine_set_budget(transfer_engine* engine, const transfer_budget* budget);
+
+// starts the next frame: refills the per frame budget and advances the frame deadlines are measured against
+void transfer_engine_frame_tick(transfer_engine* engine);
+
+void transfer_engine_get_scheduler_stats(transfer_engine* engine, transfer_scheduler_stats* stats);
+
+// logs every request and frame tick to path so the load can be reproduced with tools/transfer_replay. payload contents
+// are never written
+b8 transfer_engine_begin_capture(transfer_engine* engine, const char* path, transfer_error* error);
+
+// returns false if the capture file is incomplete
+b8 transfer_engine_end_capture(transfer_engine* engine);
+
+// lets large host uploads skip staging by importing the source pages with VK_EXT_external_memory_host. returns false
+// (and uploads keep going through staging) when the device wasn't created with the extension
+b8 transfer_engine_enable_host_import(transfer_engine* engine, const transfer_host_import_create_info* create_info, transfer_error* error);
+
+// must be called before unmapping or freeing memory that was used as an upload source while host import is enabled
+void transfer_engine_release_host_memory(transfer_engine* engine, const void* ptr, VkDeviceSize size);
+
+// lets image uploads into images created with VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT be written by CPU threads through
+// VK_EXT_host_image_copy. each upload picks the host or the queue path from its size and the throughput each path has
+// been measured at. host copies are not ordered against queue transfers, so two uploads to the same region must not be
+// in flight together. returns false when the device wasn't created with the extension
+b8 transfer_engine_enable_host_image_copy(transfer_engine* engine, const transfer_host_image_copy_create_info* create_info,
+                                         transfer_error* error);
+
+void transfer_engine_get_host_image_copy_stats(transfer_engine* engine, transfer_host_image_copy_stats* stats);
+
+// lets the engine own device local blocks that transfer_engine_heap_allocate sub-allocates from. allocate and free are O(1)
+// and safe from any thread. host uploads into the same block queued close together are batched into one multi-region copy
+b8 transfer_engine_enable_upload_heap(transfer_engine* engine, const transfer_upload_heap_create_info* create_info, transfer_error* error);
+
+// returns false if the heap isn't enabled or is full
+b8 transfer_engine_heap_allocate(transfer_engine* engine, VkDeviceSize size, transfer_allocation* allocation);
+
+// the range must not be in use by the GPU or by a pending transfer
+void transfer_engine_heap_free(transfer_engine* engine, const transfer_allocation* allocation);
+
+// allocates room for the converted data and uploads upload->src into it. returns false without enqueueing if the allocation fails
+b8 transfer_engine_heap_upload(transfer_engine* engine, const heap_upload_request* upload, transfer_allocation* allocation);
+
+void transfer_engine_get_upload_heap_stats(transfer_engine* engine, transfer_upload_heap_stats* stats);
+
+// releases heap blocks without allocations back to the driver, returns how many
+u32 transfer_engine_heap_trim(transfer_engine* engine);
+
+// starts compacting the heap in the background: each transfer_engine_frame_tick moves up to bytes_per_frame of
+// allocations out of the emptiest blocks into the fullest ones with a buffer_to_buffer copy. blocks holding any of the
+// allocations are only ever sources, so pass the ones worth evacuating rather than everything. allocations must not be
+// written or freed by the caller until their relocation is taken, reads are fine. returns false if the heap isn't
+// enabled, a run is still going or out of memory
+b8 transfer_engine_defrag_begin(transfer_engine* engine, const transfer_allocation* allocations, u32 count,
+                                const transfer_defrag_create_info* create_info);
+
+// takes relocations whose copies have completed. the caller switches each to new_allocation and frees old_allocation
+// with transfer_engine_heap_free once nothing reads it, then transfer_engine_heap_trim gives drained blocks back
+u32 transfer_engine_defrag_take_relocations(transfer_engine* engine, transfer_relocation* relocations, u32 max_count);
+
+void transfer_engine_get_defrag_stats(transfer_engine* engine, transfer_defrag_stats* stats);
+
+// creates a host visible mirror of create_info->size bytes of dst. the mirror's initial contents are undefined and nothing
+// is dirty, write or mark the ranges the device copy should receive
+b8 transfer_mirrored_buffer_create(transfer_engine* engine, const transfer_mirrored_buffer_create_info* create_info,
+                                   transfer_mirrored_buffer* mirror, transfer_error* error);
+
+// waits for the last flush to finish reading the mirror
+void transfer_mirrored_buffer_destroy(transfer_mirrored_buffer* mirror);
+
+// persistently mapped, call transfer_mirrored_buffer_mark_dirty after writing through it
+void* transfer_mirrored_buffer_data(transfer_mirrored_buffer* mirror);
+
+// safe from any thread
+void transfer_mirrored_buffer_mark_dirty(transfer_mirrored_buffer* mirror, VkDeviceSize offset, VkDeviceSize size);
+
+void transfer_mirrored_buffer_write(transfer_mirrored_buffer* mirror, VkDeviceSize offset, const void* data, VkDeviceSize size);
+
+// copies the pages dirtied since the last flush to dst as one multi-region copy. writes racing the copy are picked up by
+// the next flush. returns false without flushing while the previous flush hasn't been submitted yet, retry next frame
+b8 transfer_mirrored_buffer_flush(transfer_mirrored_buffer* mirror, u64 deadline_frame, transfer_handle handle);
+
+void transfer_mirrored_buffer_get_stats(const transfer_mirrored_buffer* mirror, transfer_mirrored_buffer_stats* stats);
+
+// records create_info's copies once for repeated submits. the plan is invalidated when any buffer it reads or writes goes
+// through transfer_engine_notify_buffer_destroyed, engine owned heap blocks do so on their own
+b8 transfer_plan_create(transfer_engine* engine, const transfer_plan_create_info* create_info, transfer_plan* plan, transfer_error* error);
+
+// waits for the plan's submits to finish on the GPU
+void transfer_plan_destroy(transfer_plan* plan);
+
+// runs the plan's copies once more. handle completes like any other transfer's, with
+// TRANSFER_INTERNAL_ERROR_PLAN_INVALIDATED if a buffer was destroyed before the worker got to it. returns false without
+// queueing anything once the plan is invalid, a new one has to be created then
+b8 transfer_plan_submit(transfer_plan* plan, u64 deadline_frame, transfer_handle handle);
+
+b8 transfer_plan_is_valid(const transfer_plan* plan);
+
 void transfer_engine_copy_buffer_to_buffer(transfer_engine* engine, const buffer_to_buffer_request* buffer_transfer);
 
+void transfer_engine_copy_host_to_buffer(transfer_engine* engine, const host_to_buffer_request* host_transfer);
+
+void transfer_engine_copy_compressed_to_buffer(transfer_engine* engine, const compressed_to_buffer_request* compressed_transfer);
+
+void transfer_engine_copy_file_to_buffer(transfer_engine* engine, const file_to_buffer_request* file_transfer);
+
+void transfer_engine_copy_host_to_image(transfer_engine* engine, const host_to_image_request* image_transfer);
+
 void transfer_engine_deinit(transfer_engine* engine);
 
 void transfer_handle_status(const transfer_engine* engine, transfer_handle handle, transfer_status* status);
 
 void transfer_handle_reset(transfer_handle handle);
+
+// moves a TRANSFER_STATUS_PENDING handle to TRANSFER_STATUS_CANCELLED, its request is never transferred. returns false
+// once the worker has started it, or if it isn't pending at all
+b8 transfer_handle_cancel(transfer_engine* engine, transfer_handle handle);
+
+// registers a submission path owned by the calling thread. the worker drains all contexts round robin
+b8 transfer_submit_context_create(transfer_engine* engine, const transfer_submit_context_create_info* create_info,
+                                  transfer_submit_context* context, transfer_error* error);
+
+// blocks until the worker has drained every request already enqueued through the context
+void transfer_submit_context_destroy(transfer_submit_context* context);
+
+// returns false without blocking if the context's ring is full
+b8 transfer_submit_context_copy_buffer_to_buffer(transfer_submit_context* context, const buffer_to_buffer_request* buffer_transfer);
+
+b8 transfer_submit_context_copy_host_to_buffer(transfer_submit_context* context, const host_to_buffer_request* host_transfer);
+
+b8 transfer_submit_context_copy_compressed_to_buffer(transfer_submit_context*             context,
+                                                    const compressed_to_buffer_request* compressed_transfer);
+
+b8 transfer_submit_context_copy_file_to_buffer(transfer_submit_context* context, const file_to_buffer_request* file_transfer);
+
+b8 transfer_submit_context_copy_host_to_image(transfer_submit_context* context, const host_to_image_request* image_transfer);
+
+// returns false if the allocation fails or the ring is full, nothing stays allocated then
+b8 transfer_submit_context_heap_upload(transfer_submit_context* context, const heap_upload_request* upload, transfer_allocation* allocation);
+
+void transfer_submit_context_get_stats(const transfer_submit_context* context, transfer_submit_context_stats* stats);
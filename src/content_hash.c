@@ -0,0 +1,62 @@
+#include "content_hash.h"
+
+#define CONTENT_HASH_PRIME_0 0xa0761d6478bd642full
+#define CONTENT_HASH_PRIME_1 0xe7037ed1a0b428dbull
+#define CONTENT_HASH_PRIME_2 0x8ebc6af09c88c6e3ull
+#define CONTENT_HASH_PRIME_3 0x589965cc75374cc3ull
+
+// 64x64 -> 128 multiply folded back to 64 bits
+static u64 mix(u64 a, u64 b) {
+    __uint128_t product = (__uint128_t)a * b;
+    return (u64)product ^ (u64)(product >> 64);
+}
+
+static u64 read_u64(const u8* p) {
+    u64 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static u64 read_tail(const u8* p, u64 size) {
+    // size is 1..7
+    u64 value = 0;
+    memcpy(&value, p, size);
+    return value;
+}
+
+u64 content_hash64(const void* data, u64 size, u64 seed) {
+    const u8* p = data;
+
+    u64 lanes[4] = {
+        seed ^ CONTENT_HASH_PRIME_0,
+        seed ^ CONTENT_HASH_PRIME_1,
+        seed ^ CONTENT_HASH_PRIME_2,
+        seed ^ CONTENT_HASH_PRIME_3,
+    };
+
+    u64 remaining = size;
+
+    while (remaining >= 32) {
+        lanes[0] = mix(read_u64(p) ^ CONTENT_HASH_PRIME_0, read_u64(p + 8) ^ lanes[0]);
+        lanes[1] = mix(read_u64(p + 16) ^ CONTENT_HASH_PRIME_1, read_u64(p + 24) ^ lanes[1]);
+        lanes[2] ^= lanes[0];
+        lanes[3] ^= lanes[1];
+
+        p += 32;
+        remaining -= 32;
+    }
+
+    u64 hash = lanes[0] ^ lanes[1] ^ mix(lanes[2], lanes[3]);
+
+    while (remaining >= 8) {
+        hash = mix(read_u64(p) ^ CONTENT_HASH_PRIME_1, hash ^ CONTENT_HASH_PRIME_2);
+        p += 8;
+        remaining -= 8;
+    }
+
+    if (remaining > 0) {
+        hash = mix(read_tail(p, remaining) ^ CONTENT_HASH_PRIME_3, hash ^ CONTENT_HASH_PRIME_0);
+    }
+
+    return mix(hash ^ size, CONTENT_HASH_PRIME_1);
+}
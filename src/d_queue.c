@@ -23,7 +23,7 @@ static b8 d_queue_reserve(d_queue* queue, u32 new_capacity) {
     queue->memory   = temp;
     queue->capacity = new_capacity;
     queue->front    = 0;
-    queue->back     = queue->count > 0 ? queue->count - 1 : 0;
+    queue->back     = queue->count > 0 ? queue->count - 1 : new_capacity - 1;
 
     return true;
 }
@@ -79,7 +79,7 @@ b8 d_queue_pop(d_queue* queue, void* element) {
     memcpy(element, &queue->memory[queue->front * queue->element_size], queue->element_size);
 
     queue->front = (queue->front + 1) % queue->capacity;
-    queue->count++;
+    queue->count--;
 
     return true;
 }
\ No newline at end of file
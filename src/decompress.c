@@ -0,0 +1,54 @@
+#include "decompress.h"
+
+#ifdef TRANSFER_ENABLE_LZ4
+#include <lz4.h>
+#endif
+
+#ifdef TRANSFER_ENABLE_ZSTD
+#include <zstd.h>
+#endif
+
+b8 decompress_codec_available(transfer_compression compression) {
+    switch (compression) {
+    case TRANSFER_COMPRESSION_LZ4:
+#ifdef TRANSFER_ENABLE_LZ4
+        return true;
+#else
+        return false;
+#endif
+    case TRANSFER_COMPRESSION_ZSTD:
+#ifdef TRANSFER_ENABLE_ZSTD
+        return true;
+#else
+        return false;
+#endif
+    default:
+        return false;
+    }
+}
+
+i64 decompress_block(transfer_compression compression, const void* src, u32 src_size, void* dst, u32 dst_capacity) {
+    assert(src);
+    assert(dst);
+
+    switch (compression) {
+    case TRANSFER_COMPRESSION_LZ4: {
+#ifdef TRANSFER_ENABLE_LZ4
+        i32 res = LZ4_decompress_safe(src, dst, (i32)src_size, (i32)dst_capacity);
+        return res < 0 ? -1 : res;
+#else
+        return -1;
+#endif
+    }
+    case TRANSFER_COMPRESSION_ZSTD: {
+#ifdef TRANSFER_ENABLE_ZSTD
+        size_t res = ZSTD_decompress(dst, dst_capacity, src, src_size);
+        return ZSTD_isError(res) ? -1 : (i64)res;
+#else
+        return -1;
+#endif
+    }
+    default:
+        return -1;
+    }
+}
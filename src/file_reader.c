@@ -0,0 +1,219 @@
+#include "file_reader.h"
+
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static i32 io_uring_setup(u32 entries, struct io_uring_params* params) {
+    return (i32)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static i32 io_uring_enter(i32 ring_fd, u32 to_submit, u32 min_complete, u32 flags) {
+    return (i32)syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static b8 create_uring(file_reader* reader, u32 depth) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    i32 ring_fd = io_uring_setup(depth, &params);
+    if (ring_fd < 0) {
+        return false;
+    }
+
+    reader->ring_fd      = ring_fd;
+    reader->depth        = params.sq_entries;
+    reader->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+    reader->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    b8 single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_mmap && reader->cq_ring_size > reader->sq_ring_size) {
+        reader->sq_ring_size = reader->cq_ring_size;
+    }
+
+    reader->sq_ring = mmap(NULL, reader->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (reader->sq_ring == MAP_FAILED) {
+        reader->sq_ring = NULL;
+        return false;
+    }
+
+    if (single_mmap) {
+        reader->cq_ring      = reader->sq_ring;
+        reader->cq_ring_size = 0;
+    } else {
+        reader->cq_ring =
+            mmap(NULL, reader->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (reader->cq_ring == MAP_FAILED) {
+            reader->cq_ring = NULL;
+            return false;
+        }
+    }
+
+    reader->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    reader->sqes      = mmap(NULL, reader->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (reader->sqes == MAP_FAILED) {
+        reader->sqes = NULL;
+        return false;
+    }
+
+    u8* sq = reader->sq_ring;
+    u8* cq = reader->cq_ring;
+
+    reader->sq_head  = (_Atomic u32*)(sq + params.sq_off.head);
+    reader->sq_tail  = (_Atomic u32*)(sq + params.sq_off.tail);
+    reader->sq_mask  = (u32*)(sq + params.sq_off.ring_mask);
+    reader->sq_array = (u32*)(sq + params.sq_off.array);
+    reader->cq_head  = (_Atomic u32*)(cq + params.cq_off.head);
+    reader->cq_tail  = (_Atomic u32*)(cq + params.cq_off.tail);
+    reader->cq_mask  = (u32*)(cq + params.cq_off.ring_mask);
+    reader->cqes     = cq + params.cq_off.cqes;
+
+    return true;
+}
+
+b8 file_reader_create(file_reader* reader, u32 depth) {
+    assert(reader);
+    assert(depth > 0);
+
+    memset(reader, 0, sizeof(file_reader));
+    reader->ring_fd = -1;
+    reader->depth   = depth < FILE_READER_MAX_COMPLETIONS ? depth : FILE_READER_MAX_COMPLETIONS;
+
+    reader->uring_enabled = create_uring(reader, reader->depth);
+
+    if (!reader->uring_enabled) {
+        // io_uring can be missing or blocked by seccomp. pread always works
+        file_reader_destroy(reader);
+        reader->depth = depth < FILE_READER_MAX_COMPLETIONS ? depth : FILE_READER_MAX_COMPLETIONS;
+    }
+
+    return true;
+}
+
+void file_reader_destroy(file_reader* reader) {
+    assert(reader);
+
+    if (reader->sqes) {
+        munmap(reader->sqes, reader->sqes_size);
+    }
+    if (reader->cq_ring && reader->cq_ring != reader->sq_ring) {
+        munmap(reader->cq_ring, reader->cq_ring_size);
+    }
+    if (reader->sq_ring) {
+        munmap(reader->sq_ring, reader->sq_ring_size);
+    }
+    if (reader->ring_fd >= 0) {
+        close(reader->ring_fd);
+    }
+
+    memset(reader, 0, sizeof(file_reader));
+    reader->ring_fd = -1;
+}
+
+i64 file_reader_read_all(i32 fd, void* dst, u64 size, u64 offset) {
+    u64 total = 0;
+
+    while (total < size) {
+        ssize_t res = pread(fd, (u8*)dst + total, size - total, (off_t)(offset + total));
+
+        if (res < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -errno;
+        }
+
+        if (res == 0) {
+            break;
+        }
+
+        total += (u64)res;
+    }
+
+    return (i64)total;
+}
+
+b8 file_reader_submit(file_reader* reader, i32 fd, void* dst, u32 size, u64 offset, u64 user_data) {
+    assert(reader);
+    assert(dst);
+
+    if (reader->in_flight == reader->depth) {
+        return false;
+    }
+
+    if (!reader->uring_enabled) {
+        file_read_completion* completion = &reader->completions[reader->completion_count++];
+        completion->user_data            = user_data;
+        completion->result               = file_reader_read_all(fd, dst, size, offset);
+        reader->in_flight++;
+        return true;
+    }
+
+    u32 tail = atomic_load_explicit(reader->sq_tail, memory_order_relaxed);
+    u32 idx  = tail & *reader->sq_mask;
+
+    struct io_uring_sqe* sqe = &((struct io_uring_sqe*)reader->sqes)[idx];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    sqe->opcode    = IORING_OP_READ;
+    sqe->fd        = fd;
+    sqe->addr      = (u64)(uintptr_t)dst;
+    sqe->len       = size;
+    sqe->off       = offset;
+    sqe->user_data = user_data;
+
+    reader->sq_array[idx] = idx;
+    atomic_store_explicit(reader->sq_tail, tail + 1, memory_order_release);
+
+    i32 res;
+    do {
+        res = io_uring_enter(reader->ring_fd, 1, 0, 0);
+    } while (res < 0 && errno == EINTR);
+
+    if (res != 1) {
+        // the kernel didn't consume the entry, take it back
+        atomic_store_explicit(reader->sq_tail, tail, memory_order_release);
+        return false;
+    }
+
+    reader->in_flight++;
+
+    return true;
+}
+
+b8 file_reader_wait(file_reader* reader, file_read_completion* completion) {
+    assert(reader);
+    assert(completion);
+
+    if (reader->in_flight == 0) {
+        return false;
+    }
+
+    if (!reader->uring_enabled) {
+        // hand results back in submission order
+        *completion = reader->completions[0];
+        memmove(&reader->completions[0], &reader->completions[1], (reader->completion_count - 1) * sizeof(file_read_completion));
+        reader->completion_count--;
+        reader->in_flight--;
+        return true;
+    }
+
+    u32 head = atomic_load_explicit(reader->cq_head, memory_order_relaxed);
+
+    while (head == atomic_load_explicit(reader->cq_tail, memory_order_acquire)) {
+        i32 res = io_uring_enter(reader->ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (res < 0 && errno != EINTR) {
+            return false;
+        }
+    }
+
+    struct io_uring_cqe* cqe = &((struct io_uring_cqe*)reader->cqes)[head & *reader->cq_mask];
+    completion->user_data    = cqe->user_data;
+    completion->result       = cqe->res;
+
+    atomic_store_explicit(reader->cq_head, head + 1, memory_order_release);
+    reader->in_flight--;
+
+    return true;
+}
@@ -0,0 +1,361 @@
+#include "format_convert.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FORMAT_CONVERT_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*format_convert_fn)(const transfer_conversion* conversion, const u8* src, u8* dst, u64 count);
+
+// scalar kernels, also used for the tails the vector loops leave behind
+
+static void rgb8_to_rgba8_scalar(const transfer_conversion* conversion, const u8* src, u8* dst, u64 count) {
+    // only the swizzle kernels read the conversion, the rest share their signature through format_convert_fn
+    (void)conversion;
+
+    for (u64 i = 0; i < count; ++i) {
+        dst[i * 4 + 0] = src[i * 3 + 0];
+        dst[i * 4 + 1] = src[i * 3 + 1];
+        dst[i * 4 + 2] = src[i * 3 + 2];
+        dst[i * 4 + 3] = 0xff;
+    }
+}
+
+static u16 f32_to_f16(u32 bits) {
+    u16 sign = (bits >> 16) & 0x8000;
+    u32 abs  = bits & 0x7fffffff;
+
+    if (abs >= 0x7f800000) {
+        // inf stays inf, NaN is quieted and keeps its top payload bits like vcvtps2ph does
+        u32 mantissa = abs & 0x7fffff;
+        return sign | 0x7c00 | (mantissa ? 0x200 | (mantissa >> 13) : 0);
+    }
+
+    if (abs >= 0x47800000) {
+        // beyond the largest finite half even before rounding
+        return sign | 0x7c00;
+    }
+
+    if (abs < 0x38800000) {
+        // half subnormal or zero. anything under 2^-25 rounds to zero
+        if (abs < 0x33000000) {
+            return sign;
+        }
+
+        u32 exponent = abs >> 23;
+        u32 mantissa = (abs & 0x7fffff) | 0x800000;
+        u32 shift    = 126 - exponent;
+        u32 result   = mantissa >> shift;
+        u32 rest     = mantissa & ((1u << shift) - 1);
+        u32 half     = 1u << (shift - 1);
+
+        if (rest > half || (rest == half && (result & 1))) {
+            result++;
+        }
+
+        return sign | (u16)result;
+    }
+
+    // rebias the exponent from 127 to 15, a carry out of the mantissa correctly rounds up to the next exponent or inf
+    u32 result = (abs - 0x38000000) >> 13;
+    u32 rest   = abs & 0x1fff;
+
+    if (rest > 0x1000 || (rest == 0x1000 && (result & 1))) {
+        result++;
+    }
+
+    return sign | (u16)result;
+}
+
+static void f32_to_f16_scalar(const transfer_conversion* conversion, const u8* src, u8* dst, u64 count) {
+    (void)conversion;
+
+    for (u64 i = 0; i < count; ++i) {
+        u32 bits;
+        memcpy(&bits, src + i * 4, sizeof(bits));
+
+        u16 half = f32_to_f16(bits);
+        memcpy(dst + i * 2, &half, sizeof(half));
+    }
+}
+
+static void u16_to_u32_scalar(const transfer_conversion* conversion, const u8* src, u8* dst, u64 count) {
+    (void)conversion;
+
+    for (u64 i = 0; i < count; ++i) {
+        u16 value;
+        memcpy(&value, src + i * 2, sizeof(value));
+
+        u32 wide = value;
+        memcpy(dst + i * 4, &wide, sizeof(wide));
+    }
+}
+
+static void swizzle_rgba8_scalar(const transfer_conversion* conversion, const u8* src, u8* dst, u64 count) {
+    const u8* swizzle = conversion->swizzle;
+
+    for (u64 i = 0; i < count; ++i) {
+        dst[i * 4 + 0] = src[i * 4 + swizzle[0]];
+        dst[i * 4 + 1] = src[i * 4 + swizzle[1]];
+        dst[i * 4 + 2] = src[i * 4 + swizzle[2]];
+        dst[i * 4 + 3] = src[i * 4 + swizzle[3]];
+    }
+}
+
+#ifdef FORMAT_CONVERT_X86
+
+// SSE4.1 kernels. vector loads are unaligned, staging chunks and caller memory carry no alignment guarantees
+
+__attribute__((target("sse4.1"))) static void rgb8_to_rgba8_sse41(const transfer_conversion* conversion, const u8* src, u8* dst,
+                                                                     u64 count) {
+    const __m128i shuffle = _mm_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1);
+    const __m128i alpha   = _mm_set1_epi32((i32)0xff000000);
+
+    u64 i = 0;
+
+    // 4 texels use 12 of the 16 bytes loaded, stop while the full load is still in bounds
+    for (; i + 6 <= count; i += 4) {
+        __m128i texels = _mm_loadu_si128((const __m128i*)(src + i * 3));
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_or_si128(_mm_shuffle_epi8(texels, shuffle), alpha));
+    }
+
+    rgb8_to_rgba8_scalar(conversion, src + i * 3, dst + i * 4, count - i);
+}
+
+__attribute__((target("sse4.1"))) static void u16_to_u32_sse41(const transfer_conversion* conversion, const u8* src, u8* dst,
+                                                                  u64 count) {
+    u64 i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m128i values = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_cvtepu16_epi32(values));
+        _mm_storeu_si128((__m128i*)(dst + i * 4 + 16), _mm_cvtepu16_epi32(_mm_srli_si128(values, 8)));
+    }
+
+    u16_to_u32_scalar(conversion, src + i * 2, dst + i * 4, count - i);
+}
+
+__attribute__((target("sse4.1"))) static __m128i swizzle_shuffle_sse41(const u8* swizzle) {
+    u8 mask[16];
+    for (u32 i = 0; i < 16; ++i) {
+        mask[i] = (u8)((i & ~3u) + swizzle[i & 3]);
+    }
+
+    return _mm_loadu_si128((const __m128i*)mask);
+}
+
+__attribute__((target("sse4.1"))) static void swizzle_rgba8_sse41(const transfer_conversion* conversion, const u8* src, u8* dst,
+                                                                    u64 count) {
+    const __m128i shuffle = swizzle_shuffle_sse41(conversion->swizzle);
+
+    u64 i = 0;
+
+    for (; i + 4 <= count; i += 4) {
+        __m128i texels = _mm_loadu_si128((const __m128i*)(src + i * 4));
+        _mm_storeu_si128((__m128i*)(dst + i * 4), _mm_shuffle_epi8(texels, shuffle));
+    }
+
+    swizzle_rgba8_scalar(conversion, src + i * 4, dst + i * 4, count - i);
+}
+
+// AVX2 kernels
+
+__attribute__((target("avx2"))) static void rgb8_to_rgba8_avx2(const transfer_conversion* conversion, const u8* src, u8* dst,
+                                                                 u64 count) {
+    // move texels 4..7 into the upper lane so the in-lane byte shuffle sees 12 source bytes per lane
+    const __m256i spread  = _mm256_setr_epi32(0, 1, 2, 2, 3, 4, 5, 5);
+    const __m256i shuffle = _mm256_setr_epi8(0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11, -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7,
+                                             8, -1, 9, 10, 11, -1);
+    const __m256i alpha   = _mm256_set1_epi32((i32)0xff000000);
+
+    u64 i = 0;
+
+    // 8 texels use 24 of the 32 bytes loaded
+    for (; i + 11 <= count; i += 8) {
+        __m256i texels = _mm256_loadu_si256((const __m256i*)(src + i * 3));
+        texels         = _mm256_permutevar8x32_epi32(texels, spread);
+        _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_or_si256(_mm256_shuffle_epi8(texels, shuffle), alpha));
+    }
+
+    rgb8_to_rgba8_sse41(conversion, src + i * 3, dst + i * 4, count - i);
+}
+
+__attribute__((target("avx2,f16c"))) static void f32_to_f16_avx2(const transfer_conversion* conversion, const u8* src, u8* dst,
+                                                                   u64 count) {
+    u64 i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m256 values_0 = _mm256_loadu_ps((const f32*)(src + i * 4));
+        __m256 values_1 = _mm256_loadu_ps((const f32*)(src + i * 4 + 32));
+        _mm_storeu_si128((__m128i*)(dst + i * 2), _mm256_cvtps_ph(values_0, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        _mm_storeu_si128((__m128i*)(dst + i * 2 + 16), _mm256_cvtps_ph(values_1, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+    }
+
+    f32_to_f16_scalar(conversion, src + i * 4, dst + i * 2, count - i);
+}
+
+__attribute__((target("avx2"))) static void u16_to_u32_avx2(const transfer_conversion* conversion, const u8* src, u8* dst,
+                                                              u64 count) {
+    u64 i = 0;
+
+    for (; i + 16 <= count; i += 16) {
+        __m128i values_0 = _mm_loadu_si128((const __m128i*)(src + i * 2));
+        __m128i values_1 = _mm_loadu_si128((const __m128i*)(src + i * 2 + 16));
+        _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_cvtepu16_epi32(values_0));
+        _mm256_storeu_si256((__m256i*)(dst + i * 4 + 32), _mm256_cvtepu16_epi32(values_1));
+    }
+
+    u16_to_u32_scalar(conversion, src + i * 2, dst + i * 4, count - i);
+}
+
+__attribute__((target("avx2"))) static void swizzle_rgba8_avx2(const transfer_conversion* conversion, const u8* src, u8* dst,
+                                                                 u64 count) {
+    __m128i       lane    = swizzle_shuffle_sse41(conversion->swizzle);
+    const __m256i shuffle = _mm256_broadcastsi128_si256(lane);
+
+    u64 i = 0;
+
+    for (; i + 8 <= count; i += 8) {
+        __m256i texels = _mm256_loadu_si256((const __m256i*)(src + i * 4));
+        _mm256_storeu_si256((__m256i*)(dst + i * 4), _mm256_shuffle_epi8(texels, shuffle));
+    }
+
+    swizzle_rgba8_scalar(conversion, src + i * 4, dst + i * 4, count - i);
+}
+
+#endif
+
+// indexed by [isa][conversion type]
+static const format_convert_fn kernels[FORMAT_CONVERT_ISA_COUNT][TRANSFER_CONVERSION_SWIZZLE_RGBA8 + 1] = {
+    [FORMAT_CONVERT_ISA_SCALAR] =
+        {
+            [TRANSFER_CONVERSION_RGB8_TO_RGBA8] = rgb8_to_rgba8_scalar,
+            [TRANSFER_CONVERSION_F32_TO_F16]    = f32_to_f16_scalar,
+            [TRANSFER_CONVERSION_U16_TO_U32]    = u16_to_u32_scalar,
+            [TRANSFER_CONVERSION_SWIZZLE_RGBA8] = swizzle_rgba8_scalar,
+        },
+#ifdef FORMAT_CONVERT_X86
+    [FORMAT_CONVERT_ISA_SSE41] =
+        {
+            [TRANSFER_CONVERSION_RGB8_TO_RGBA8] = rgb8_to_rgba8_sse41,
+            [TRANSFER_CONVERSION_F32_TO_F16]    = f32_to_f16_scalar,
+            [TRANSFER_CONVERSION_U16_TO_U32]    = u16_to_u32_sse41,
+            [TRANSFER_CONVERSION_SWIZZLE_RGBA8] = swizzle_rgba8_sse41,
+        },
+    [FORMAT_CONVERT_ISA_AVX2] =
+        {
+            [TRANSFER_CONVERSION_RGB8_TO_RGBA8] = rgb8_to_rgba8_avx2,
+            [TRANSFER_CONVERSION_F32_TO_F16]    = f32_to_f16_avx2,
+            [TRANSFER_CONVERSION_U16_TO_U32]    = u16_to_u32_avx2,
+            [TRANSFER_CONVERSION_SWIZZLE_RGBA8] = swizzle_rgba8_avx2,
+        },
+#endif
+};
+
+u32 format_convert_src_element_size(const transfer_conversion* conversion) {
+    assert(conversion);
+
+    switch (conversion->type) {
+    case TRANSFER_CONVERSION_NONE:
+        return 1;
+    case TRANSFER_CONVERSION_RGB8_TO_RGBA8:
+        return 3;
+    case TRANSFER_CONVERSION_F32_TO_F16:
+        return 4;
+    case TRANSFER_CONVERSION_U16_TO_U32:
+        return 2;
+    case TRANSFER_CONVERSION_SWIZZLE_RGBA8:
+        return 4;
+    default:
+        assert(0 && "unhandled conversion type");
+        return 1;
+    }
+}
+
+u32 format_convert_dst_element_size(const transfer_conversion* conversion) {
+    assert(conversion);
+
+    switch (conversion->type) {
+    case TRANSFER_CONVERSION_NONE:
+        return 1;
+    case TRANSFER_CONVERSION_RGB8_TO_RGBA8:
+        return 4;
+    case TRANSFER_CONVERSION_F32_TO_F16:
+        return 2;
+    case TRANSFER_CONVERSION_U16_TO_U32:
+        return 4;
+    case TRANSFER_CONVERSION_SWIZZLE_RGBA8:
+        return 4;
+    default:
+        assert(0 && "unhandled conversion type");
+        return 1;
+    }
+}
+
+VkDeviceSize format_convert_dst_size(const transfer_conversion* conversion, VkDeviceSize src_size) {
+    u32 src_element_size = format_convert_src_element_size(conversion);
+
+    assert(src_size % src_element_size == 0 && "size must be a whole number of source elements");
+
+    return src_size / src_element_size * format_convert_dst_element_size(conversion);
+}
+
+format_convert_isa format_convert_best_isa(void) {
+    static atomic_int best_isa = -1;
+
+    int isa = atomic_load_explicit(&best_isa, memory_order_relaxed);
+    if (isa >= 0) {
+        return (format_convert_isa)isa;
+    }
+
+    isa = FORMAT_CONVERT_ISA_SCALAR;
+
+#ifdef FORMAT_CONVERT_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("f16c")) {
+        isa = FORMAT_CONVERT_ISA_AVX2;
+    } else if (__builtin_cpu_supports("sse4.1")) {
+        isa = FORMAT_CONVERT_ISA_SSE41;
+    }
+#endif
+
+    // racing detections agree, whoever stores last is fine
+    atomic_store_explicit(&best_isa, isa, memory_order_relaxed);
+
+    return (format_convert_isa)isa;
+}
+
+const char* format_convert_isa_name(format_convert_isa isa) {
+    switch (isa) {
+    case FORMAT_CONVERT_ISA_SCALAR:
+        return "scalar";
+    case FORMAT_CONVERT_ISA_SSE41:
+        return "sse4.1";
+    case FORMAT_CONVERT_ISA_AVX2:
+        return "avx2";
+    default:
+        return "unknown";
+    }
+}
+
+void format_convert_with_isa(format_convert_isa isa, const transfer_conversion* conversion, const void* src, void* dst,
+                             u64 element_count) {
+    assert(conversion);
+    assert(isa <= format_convert_best_isa());
+
+    if (conversion->type == TRANSFER_CONVERSION_NONE) {
+        memcpy(dst, src, element_count);
+        return;
+    }
+
+    if (conversion->type == TRANSFER_CONVERSION_SWIZZLE_RGBA8) {
+        assert(conversion->swizzle[0] < 4 && conversion->swizzle[1] < 4 && conversion->swizzle[2] < 4 && conversion->swizzle[3] < 4);
+    }
+
+    kernels[isa][conversion->type](conversion, src, dst, element_count);
+}
+
+void format_convert(const transfer_conversion* conversion, const void* src, void* dst, u64 element_count) {
+    format_convert_with_isa(format_convert_best_isa(), conversion, src, dst, element_count);
+}
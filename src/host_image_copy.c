@@ -0,0 +1,356 @@
+#include "host_image_copy.h"
+#include "transfer_handle_pool.h"
+
+#include <time.h>
+#include <unistd.h>
+
+#define NS_PER_MS 1000000ull
+
+typedef struct host_image_copy_task {
+    host_image_copy*      copy;
+    transfer_handle_pool* handle_pool;
+    transfer_request      request;
+} host_image_copy_task;
+
+static transfer_error fill_internal_err(transfer_internal_error internal_error) {
+    transfer_error err;
+    err.type           = TRANSFER_ERROR_TYPE_INTERNAL;
+    err.vk_error       = VK_SUCCESS;
+    err.internal_error = internal_error;
+    return err;
+}
+
+static u64 monotonic_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+// only uploads in the range where the choice is actually made feed the averages, small ones would mostly measure
+// fixed costs and big ones never take the host path
+static b8 is_contested(const host_image_copy* copy, VkDeviceSize size) {
+    return size > copy->host_size && size <= copy->max_host_size;
+}
+
+static void record_sample(host_image_copy* copy, u64* bytes_per_ms, VkDeviceSize size, u64 elapsed_ns) {
+    u64 sample = size * NS_PER_MS / (elapsed_ns > 0 ? elapsed_ns : 1);
+
+    pthread_mutex_lock(&copy->mutex);
+    *bytes_per_ms = *bytes_per_ms == 0 ? sample : *bytes_per_ms - *bytes_per_ms / 8 + sample / 8;
+    pthread_mutex_unlock(&copy->mutex);
+}
+
+static b8 dst_layout_supported(const host_image_copy* copy, VkImageLayout layout) {
+    for (u32 i = 0; i < copy->dst_layout_count; ++i) {
+        if (copy->dst_layouts[i] == layout) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void run_host_image_copy_task(void* user_data) {
+    host_image_copy_task*        task    = user_data;
+    host_image_copy*             copy    = task->copy;
+    const transfer_request*      request = &task->request;
+    const transfer_image_region* image   = &request->image;
+
+    u64      start_ns = monotonic_time_ns();
+    VkResult vk_res   = VK_SUCCESS;
+
+    if (image->old_layout != image->new_layout) {
+        VkHostImageLayoutTransitionInfoEXT transition = {
+            .sType     = VK_STRUCTURE_TYPE_HOST_IMAGE_LAYOUT_TRANSITION_INFO_EXT,
+            .pNext     = NULL,
+            .image     = request->dst.image,
+            .oldLayout = image->old_layout,
+            .newLayout = image->new_layout,
+            .subresourceRange =
+                {
+                    .aspectMask     = image->subresource.aspectMask,
+                    .baseMipLevel   = image->subresource.mipLevel,
+                    .levelCount     = 1,
+                    .baseArrayLayer = image->subresource.baseArrayLayer,
+                    .layerCount     = image->subresource.layerCount,
+                },
+        };
+
+        vk_res = copy->transition_image_layout(copy->device, 1, &transition);
+    }
+
+    if (vk_res == VK_SUCCESS) {
+        VkMemoryToImageCopyEXT region = {
+            .sType             = VK_STRUCTURE_TYPE_MEMORY_TO_IMAGE_COPY_EXT,
+            .pNext             = NULL,
+            .pHostPointer      = request->src.host,
+            .memoryRowLength   = image->row_length,
+            .memoryImageHeight = image->image_height,
+            .imageSubresource  = image->subresource,
+            .imageOffset       = image->offset,
+            .imageExtent       = image->extent,
+        };
+
+        VkCopyMemoryToImageInfoEXT copy_info = {
+            .sType          = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_IMAGE_INFO_EXT,
+            .pNext          = NULL,
+            .flags          = 0,
+            .dstImage       = request->dst.image,
+            .dstImageLayout = image->new_layout,
+            .regionCount    = 1,
+            .pRegions       = &region,
+        };
+
+        vk_res = copy->copy_memory_to_image(copy->device, &copy_info);
+    }
+
+    if (vk_res == VK_SUCCESS) {
+        if (is_contested(copy, request->size)) {
+            record_sample(copy, &copy->host_bytes_per_ms, request->size, monotonic_time_ns() - start_ns);
+        }
+
+        atomic_fetch_add_explicit(&copy->host_count, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&copy->host_bytes, request->size, memory_order_relaxed);
+
+        // host writes are visible to any queue submission made after this
+        transfer_handle_pool_insert_status_barrier(task->handle_pool, request->handle, TRANSFER_STATUS_COMPLETE);
+    } else {
+        transfer_handle_pool_set_handle_error_vulkan(task->handle_pool, request->handle, vk_res);
+    }
+
+    atomic_fetch_sub(&copy->in_flight, 1);
+    free(task);
+}
+
+b8 host_image_copy_create(host_image_copy* copy, VkDevice device, const transfer_host_image_copy_create_info* create_info,
+                          transfer_error* error) {
+    assert(copy);
+    assert(create_info);
+    assert(create_info->physical_device != VK_NULL_HANDLE);
+
+    memset(copy, 0, sizeof(host_image_copy));
+
+    // only resolve if the device was created with the extension enabled
+    copy->copy_memory_to_image    = (PFN_vkCopyMemoryToImageEXT)vkGetDeviceProcAddr(device, "vkCopyMemoryToImageEXT");
+    copy->transition_image_layout = (PFN_vkTransitionImageLayoutEXT)vkGetDeviceProcAddr(device, "vkTransitionImageLayoutEXT");
+
+    if (!copy->copy_memory_to_image || !copy->transition_image_layout) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_EXTENSION_NOT_ENABLED);
+        }
+        return false;
+    }
+
+    VkPhysicalDeviceHostImageCopyPropertiesEXT host_image_copy_properties = {
+        .sType              = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_HOST_IMAGE_COPY_PROPERTIES_EXT,
+        .pNext              = NULL,
+        .copyDstLayoutCount = HOST_IMAGE_COPY_MAX_DST_LAYOUTS,
+        .pCopyDstLayouts    = copy->dst_layouts,
+    };
+
+    VkPhysicalDeviceProperties2 properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &host_image_copy_properties,
+    };
+
+    vkGetPhysicalDeviceProperties2(create_info->physical_device, &properties);
+
+    u32 thread_count = create_info->thread_count;
+    if (thread_count == 0) {
+        i64 cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count  = cpu_count > 1 ? (u32)(cpu_count / 2) : 1;
+    }
+
+    copy->device           = device;
+    copy->dst_layout_count = host_image_copy_properties.copyDstLayoutCount;
+    copy->host_size        = create_info->host_size > 0 ? create_info->host_size : HOST_IMAGE_COPY_DEFAULT_HOST_SIZE;
+    copy->max_host_size    = create_info->max_host_size > 0 ? create_info->max_host_size : HOST_IMAGE_COPY_DEFAULT_MAX_HOST_SIZE;
+    // a little queued work per thread keeps them busy, more would just wait while the queue sits idle
+    copy->max_in_flight = thread_count * 2;
+
+    if (pthread_mutex_init(&copy->mutex, NULL) != 0) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_PTHREAD_CANNOT_CREATE);
+        }
+        return false;
+    }
+
+    if (!task_pool_create(&copy->pool, thread_count)) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_PTHREAD_CANNOT_CREATE);
+        }
+        pthread_mutex_destroy(&copy->mutex);
+        return false;
+    }
+
+    return true;
+}
+
+void host_image_copy_destroy(host_image_copy* copy) {
+    assert(copy);
+
+    task_pool_destroy(&copy->pool);
+    pthread_mutex_destroy(&copy->mutex);
+
+    memset(copy, 0, sizeof(host_image_copy));
+}
+
+b8 host_image_copy_choose_host(host_image_copy* copy, const transfer_request* request, b8 queue_possible) {
+    assert(copy);
+    assert(request);
+    assert(request->type == TRANSFER_TYPE_HOST_TO_IMAGE);
+
+    // the CPU can't wait on transfers submitted ahead of an ordered request
+    if (!(request->image.usage & VK_IMAGE_USAGE_HOST_TRANSFER_BIT_EXT) || (request->flags & TRANSFER_REQUEST_FLAG_ORDERED) ||
+        !dst_layout_supported(copy, request->image.new_layout)) {
+        return false;
+    }
+
+    if (!queue_possible) {
+        return true;
+    }
+
+    if (request->size > copy->max_host_size || atomic_load(&copy->in_flight) >= copy->max_in_flight) {
+        return false;
+    }
+
+    if (request->size <= copy->host_size) {
+        return true;
+    }
+
+    pthread_mutex_lock(&copy->mutex);
+    u64 host_bytes_per_ms  = copy->host_bytes_per_ms;
+    u64 queue_bytes_per_ms = copy->queue_bytes_per_ms;
+    pthread_mutex_unlock(&copy->mutex);
+
+    // a path without a sample yet gets the next upload
+    if (host_bytes_per_ms == 0) {
+        return true;
+    }
+
+    if (queue_bytes_per_ms == 0) {
+        return false;
+    }
+
+    b8 host_faster = host_bytes_per_ms >= queue_bytes_per_ms;
+
+    // every so often the slower path gets an upload anyway, so its average keeps up with the load
+    copy->contested_count++;
+    if (copy->contested_count % HOST_IMAGE_COPY_EXPLORE_INTERVAL == 0) {
+        return !host_faster;
+    }
+
+    return host_faster;
+}
+
+b8 host_image_copy_execute(host_image_copy* copy, transfer_handle_pool* handle_pool, const transfer_request* request) {
+    assert(copy);
+    assert(handle_pool);
+    assert(request);
+
+    host_image_copy_task* task = malloc(sizeof(host_image_copy_task));
+    if (!task) {
+        return false;
+    }
+
+    task->copy        = copy;
+    task->handle_pool = handle_pool;
+    task->request     = *request;
+
+    atomic_fetch_add(&copy->in_flight, 1);
+
+    // the handle was claimed as TRANSFER_STATUS_EXECUTING and stays there without a fence until the task completes it,
+    // see _transfer_handle_pool_get_handle_status
+    if (!task_pool_push(&copy->pool, run_host_image_copy_task, task)) {
+        atomic_fetch_sub(&copy->in_flight, 1);
+        free(task);
+        return false;
+    }
+
+    return true;
+}
+
+u64 host_image_copy_timestamp(void) {
+    return monotonic_time_ns();
+}
+
+void host_image_copy_record_queue_upload(host_image_copy* copy, const transfer_request* request, const transfer_submission* submission,
+                                         u64 start_ns) {
+    assert(copy);
+    assert(request);
+    assert(submission);
+
+    atomic_fetch_add_explicit(&copy->queue_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&copy->queue_bytes, request->size, memory_order_relaxed);
+
+    if (!is_contested(copy, request->size)) {
+        return;
+    }
+
+    // the command buffer was free, so whatever its probe was timing has finished and the sample is lost
+    host_image_copy_probe* probe = &copy->probes[submission->cmd_idx];
+
+    probe->fence_ref.vk_fence         = submission->fence;
+    probe->fence_ref.fence_generation = submission->fence_generation;
+    probe->fence_ref.fence_idx        = (u32)submission->cmd_idx;
+    probe->size                       = request->size;
+    probe->start_ns                   = start_ns;
+    probe->pending_ns                 = monotonic_time_ns();
+}
+
+void host_image_copy_poll(host_image_copy* copy, const transfer_command_pool* command_pool) {
+    assert(copy);
+    assert(command_pool);
+
+    u64 now_ns = 0;
+
+    for (u32 i = 0; i < CMD_BUF_COUNT; ++i) {
+        host_image_copy_probe* probe = &copy->probes[i];
+
+        if (probe->fence_ref.vk_fence == VK_NULL_HANDLE) {
+            continue;
+        }
+
+        now_ns = now_ns > 0 ? now_ns : monotonic_time_ns();
+
+        if (probe->fence_ref.fence_generation == command_pool->fence_generations[probe->fence_ref.fence_idx]) {
+            VkResult vk_res = vkGetFenceStatus(copy->device, probe->fence_ref.vk_fence);
+
+            if (vk_res == VK_NOT_READY) {
+                probe->pending_ns = now_ns;
+                continue;
+            }
+
+            if (vk_res != VK_SUCCESS) {
+                probe->fence_ref.vk_fence = VK_NULL_HANDLE;
+                continue;
+            }
+        }
+
+        // place the completion in the middle of the window it must have happened in. if the window is wide compared to
+        // the copy, the worker wasn't looking and the sample would mostly measure its idle time
+        u64 window_ns  = now_ns - probe->pending_ns;
+        u64 elapsed_ns = probe->pending_ns + window_ns / 2 - probe->start_ns;
+
+        if (window_ns <= elapsed_ns / 2) {
+            record_sample(copy, &copy->queue_bytes_per_ms, probe->size, elapsed_ns);
+        }
+
+        probe->fence_ref.vk_fence = VK_NULL_HANDLE;
+    }
+}
+
+void host_image_copy_get_stats(host_image_copy* copy, transfer_host_image_copy_stats* stats) {
+    assert(copy);
+    assert(stats);
+
+    stats->host_count  = atomic_load_explicit(&copy->host_count, memory_order_relaxed);
+    stats->host_bytes  = atomic_load_explicit(&copy->host_bytes, memory_order_relaxed);
+    stats->queue_count = atomic_load_explicit(&copy->queue_count, memory_order_relaxed);
+    stats->queue_bytes = atomic_load_explicit(&copy->queue_bytes, memory_order_relaxed);
+
+    pthread_mutex_lock(&copy->mutex);
+    stats->host_bytes_per_ms  = copy->host_bytes_per_ms;
+    stats->queue_bytes_per_ms = copy->queue_bytes_per_ms;
+    pthread_mutex_unlock(&copy->mutex);
+}
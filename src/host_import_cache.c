@@ -0,0 +1,303 @@
+#include "host_import_cache.h"
+#include "vk_memory.h"
+
+#include <sched.h>
+
+static transfer_error fill_internal_err(transfer_internal_error internal_error) {
+    transfer_error err;
+    err.type           = TRANSFER_ERROR_TYPE_INTERNAL;
+    err.vk_error       = VK_SUCCESS;
+    err.internal_error = internal_error;
+    return err;
+}
+
+static void destroy_entry(VkDevice device, const transfer_command_pool* command_pool, host_import_entry* entry) {
+    transfer_handle_fence_ref* fence_ref = &entry->fence_ref;
+
+    if (fence_ref->vk_fence != VK_NULL_HANDLE && fence_ref->fence_generation == command_pool->fence_generations[fence_ref->fence_idx]) {
+        vkWaitForFences(device, 1, &fence_ref->vk_fence, VK_TRUE, UINT64_MAX);
+    }
+
+    vkDestroyBuffer(device, entry->buffer, NULL);
+    vkFreeMemory(device, entry->memory, NULL);
+}
+
+static void remove_entry(host_import_cache* cache, u32 idx) {
+    host_import_entry last;
+    d_array_pop_back(&cache->entries, &last);
+
+    if (idx < cache->entries.count) {
+        *(host_import_entry*)d_array_at(&cache->entries, idx) = last;
+    }
+}
+
+static b8 import_range(host_import_cache* cache, VkDevice device, uintptr_t base, VkDeviceSize size, host_import_entry* entry) {
+    VkMemoryHostPointerPropertiesEXT pointer_properties = {
+        .sType          = VK_STRUCTURE_TYPE_MEMORY_HOST_POINTER_PROPERTIES_EXT,
+        .pNext          = NULL,
+        .memoryTypeBits = 0,
+    };
+
+    VkResult vk_res = cache->get_memory_host_pointer_properties(device, VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+                                                                (const void*)base, &pointer_properties);
+    if (vk_res != VK_SUCCESS || pointer_properties.memoryTypeBits == 0) {
+        return false;
+    }
+
+    VkExternalMemoryBufferCreateInfo external_buffer_ci = {
+        .sType       = VK_STRUCTURE_TYPE_EXTERNAL_MEMORY_BUFFER_CREATE_INFO,
+        .pNext       = NULL,
+        .handleTypes = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+    };
+
+    VkBufferCreateInfo buffer_ci = {
+        .sType                 = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext                 = &external_buffer_ci,
+        .flags                 = 0,
+        .size                  = size,
+        .usage                 = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode           = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 0,
+        .pQueueFamilyIndices   = NULL,
+    };
+
+    VkBuffer buffer;
+    if (vkCreateBuffer(device, &buffer_ci, NULL, &buffer) != VK_SUCCESS) {
+        return false;
+    }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, buffer, &memory_requirements);
+
+    u32 memory_type_idx;
+    if (memory_requirements.size > size ||
+        !vk_memory_find_type(cache->physical_device, memory_requirements.memoryTypeBits & pointer_properties.memoryTypeBits, 0, 0,
+                             &memory_type_idx, NULL)) {
+        vkDestroyBuffer(device, buffer, NULL);
+        return false;
+    }
+
+    VkImportMemoryHostPointerInfoEXT import_info = {
+        .sType        = VK_STRUCTURE_TYPE_IMPORT_MEMORY_HOST_POINTER_INFO_EXT,
+        .pNext        = NULL,
+        .handleType   = VK_EXTERNAL_MEMORY_HANDLE_TYPE_HOST_ALLOCATION_BIT_EXT,
+        .pHostPointer = (void*)base,
+    };
+
+    VkMemoryAllocateInfo memory_ai = {
+        .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext           = &import_info,
+        .allocationSize  = size,
+        .memoryTypeIndex = memory_type_idx,
+    };
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(device, &memory_ai, NULL, &memory) != VK_SUCCESS) {
+        vkDestroyBuffer(device, buffer, NULL);
+        return false;
+    }
+
+    if (vkBindBufferMemory(device, buffer, memory, 0) != VK_SUCCESS) {
+        vkDestroyBuffer(device, buffer, NULL);
+        vkFreeMemory(device, memory, NULL);
+        return false;
+    }
+
+    entry->base      = base;
+    entry->size      = size;
+    entry->memory    = memory;
+    entry->buffer    = buffer;
+    entry->last_use  = 0;
+    entry->fence_ref = (transfer_handle_fence_ref){.vk_fence = VK_NULL_HANDLE, .fence_generation = 0, .fence_idx = 0};
+    entry->in_use    = false;
+
+    return true;
+}
+
+b8 host_import_cache_create(host_import_cache* cache, VkDevice device, const transfer_host_import_create_info* create_info,
+                            transfer_error* error) {
+    assert(cache);
+    assert(create_info);
+    assert(create_info->physical_device != VK_NULL_HANDLE);
+
+    memset(cache, 0, sizeof(host_import_cache));
+
+    // only resolves if the device was created with the extension enabled
+    cache->get_memory_host_pointer_properties =
+        (PFN_vkGetMemoryHostPointerPropertiesEXT)vkGetDeviceProcAddr(device, "vkGetMemoryHostPointerPropertiesEXT");
+
+    if (!cache->get_memory_host_pointer_properties) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_EXTENSION_NOT_ENABLED);
+        }
+        return false;
+    }
+
+    VkPhysicalDeviceExternalMemoryHostPropertiesEXT host_properties = {
+        .sType                           = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_MEMORY_HOST_PROPERTIES_EXT,
+        .pNext                           = NULL,
+        .minImportedHostPointerAlignment = 0,
+    };
+
+    VkPhysicalDeviceProperties2 properties = {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
+        .pNext = &host_properties,
+    };
+
+    vkGetPhysicalDeviceProperties2(create_info->physical_device, &properties);
+
+    cache->physical_device = create_info->physical_device;
+    cache->alignment       = host_properties.minImportedHostPointerAlignment > 0 ? host_properties.minImportedHostPointerAlignment : 4096;
+    cache->capacity        = create_info->cache_capacity > 0 ? create_info->cache_capacity : HOST_IMPORT_DEFAULT_CACHE_CAPACITY;
+    cache->min_import_size = create_info->min_import_size > 0 ? create_info->min_import_size : HOST_IMPORT_DEFAULT_MIN_SIZE;
+
+    if (!d_array_create(&cache->entries, sizeof(host_import_entry), cache->capacity)) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY);
+        }
+        return false;
+    }
+
+    if (pthread_mutex_init(&cache->mutex, NULL) != 0) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_PTHREAD_CANNOT_CREATE);
+        }
+        d_array_destroy(&cache->entries);
+        return false;
+    }
+
+    return true;
+}
+
+void host_import_cache_destroy(host_import_cache* cache, VkDevice device, const transfer_command_pool* command_pool) {
+    assert(cache);
+
+    for (u32 i = 0; i < cache->entries.count; ++i) {
+        destroy_entry(device, command_pool, d_array_at(&cache->entries, i));
+    }
+
+    d_array_destroy(&cache->entries);
+    pthread_mutex_destroy(&cache->mutex);
+
+    memset(cache, 0, sizeof(host_import_cache));
+}
+
+b8 host_import_cache_acquire(host_import_cache* cache, VkDevice device, const transfer_command_pool* command_pool, const void* ptr,
+                             VkDeviceSize size, host_import_entry* entry) {
+    assert(cache);
+    assert(entry);
+
+    // rounding out to whole pages stays inside the caller's mapping, since the pages holding the range are mapped
+    uintptr_t base = (uintptr_t)ptr & ~(uintptr_t)(cache->alignment - 1);
+    uintptr_t end  = ((uintptr_t)ptr + size + cache->alignment - 1) & ~(uintptr_t)(cache->alignment - 1);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    cache->use_counter++;
+
+    u32 lru_idx = 0;
+    for (u32 i = 0; i < cache->entries.count; ++i) {
+        host_import_entry* candidate = d_array_at(&cache->entries, i);
+
+        if (candidate->base <= base && end <= candidate->base + candidate->size) {
+            candidate->last_use = cache->use_counter;
+            candidate->in_use   = true;
+            *entry              = *candidate;
+
+            pthread_mutex_unlock(&cache->mutex);
+            return true;
+        }
+
+        host_import_entry* lru = d_array_at(&cache->entries, lru_idx);
+        if (candidate->last_use < lru->last_use) {
+            lru_idx = i;
+        }
+    }
+
+    if (cache->entries.count == cache->capacity) {
+        destroy_entry(device, command_pool, d_array_at(&cache->entries, lru_idx));
+        remove_entry(cache, lru_idx);
+    }
+
+    host_import_entry new_entry;
+    if (!import_range(cache, device, base, end - base, &new_entry) || !d_array_push_back(&cache->entries, &new_entry)) {
+        pthread_mutex_unlock(&cache->mutex);
+        return false;
+    }
+
+    host_import_entry* inserted = d_array_at(&cache->entries, cache->entries.count - 1);
+    inserted->last_use          = cache->use_counter;
+    inserted->in_use            = true;
+    *entry                      = *inserted;
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    return true;
+}
+
+void host_import_cache_retire(host_import_cache* cache, const host_import_entry* entry, const transfer_submission* submission) {
+    assert(cache);
+    assert(entry);
+
+    pthread_mutex_lock(&cache->mutex);
+
+    // releases may have moved it around the array, the buffer is what identifies it
+    for (u32 i = 0; i < cache->entries.count; ++i) {
+        host_import_entry* candidate = d_array_at(&cache->entries, i);
+
+        if (candidate->buffer != entry->buffer) {
+            continue;
+        }
+
+        if (submission) {
+            candidate->fence_ref.vk_fence         = submission->fence;
+            candidate->fence_ref.fence_generation = submission->fence_generation;
+            candidate->fence_ref.fence_idx        = (u32)submission->cmd_idx;
+        }
+        candidate->in_use = false;
+        break;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void host_import_cache_release(host_import_cache* cache, VkDevice device, const transfer_command_pool* command_pool, const void* ptr,
+                               VkDeviceSize size) {
+    assert(cache);
+
+    uintptr_t begin = (uintptr_t)ptr;
+    uintptr_t end   = begin + size;
+
+    while (1) {
+        b8 pinned = false;
+
+        pthread_mutex_lock(&cache->mutex);
+
+        for (u32 i = 0; i < cache->entries.count;) {
+            host_import_entry* entry = d_array_at(&cache->entries, i);
+
+            if (entry->base < end && begin < entry->base + entry->size) {
+                // the worker is recording a copy out of it, its fence isn't known yet
+                if (entry->in_use) {
+                    pinned = true;
+                    ++i;
+                    continue;
+                }
+
+                destroy_entry(device, command_pool, entry);
+                remove_entry(cache, i);
+                continue;
+            }
+
+            ++i;
+        }
+
+        pthread_mutex_unlock(&cache->mutex);
+
+        if (!pinned) {
+            return;
+        }
+
+        sched_yield();
+    }
+}
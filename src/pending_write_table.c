@@ -0,0 +1,228 @@
+#include "pending_write_table.h"
+#include "transfer_handle_pool.h"
+
+static u32 bucket_index(VkBuffer dst) {
+    u64 h = (u64)(uintptr_t)dst * 0x9e3779b97f4a7c15ull;
+    return (u32)(h >> 58) % PENDING_WRITE_BUCKET_COUNT;
+}
+
+static pending_write* write_at(pending_write_table* table, u32 idx) {
+    return d_array_at(&table->writes, idx);
+}
+
+// [offset, end) of dst the request overwrites, false if it isn't tracked
+static b8 write_range(const transfer_request* request, VkDeviceSize* offset, VkDeviceSize* end) {
+    // mirror flushes and defrag moves are the engine's own writes, nobody supersedes those
+    if (request->mirror || (request->flags & TRANSFER_REQUEST_FLAG_DEFRAG)) {
+        return false;
+    }
+
+    switch (request->type) {
+    case TRANSFER_TYPE_BUFFER_TO_BUFFER:
+        // scattered regions don't describe one range
+        if (request->region_count > 0) {
+            return false;
+        }
+        *offset = 0;
+        *end    = request->size;
+        return true;
+    case TRANSFER_TYPE_HOST_TO_BUFFER:
+    case TRANSFER_TYPE_FILE_TO_BUFFER:
+    case TRANSFER_TYPE_COMPRESSED_TO_BUFFER:
+        if (request->size == 0) {
+            return false;
+        }
+        *offset = request->dst_offset;
+        *end    = request->dst_offset + request->size;
+        return true;
+    default:
+        return false;
+    }
+}
+
+// takes every queued write to src out of reach of later writes
+static void pin_writes_locked(pending_write_table* table, VkBuffer src) {
+    u32* link = &table->buckets[bucket_index(src)];
+
+    while (*link != PENDING_WRITE_NONE) {
+        pending_write* write = write_at(table, *link);
+
+        if (write->dst != src) {
+            link = &write->next;
+            continue;
+        }
+
+        *link        = write->next;
+        write->state = PENDING_WRITE_PINNED;
+    }
+}
+
+static void pin_reads_locked(pending_write_table* table, const transfer_request* request) {
+    if (request->type == TRANSFER_TYPE_BUFFER_TO_BUFFER) {
+        pin_writes_locked(table, request->src.buffer);
+    } else if (request->type == TRANSFER_TYPE_PLAN) {
+        for (u32 i = 0; i < request->plan->copy_count; ++i) {
+            pin_writes_locked(table, request->plan->copies[i].src);
+        }
+    }
+}
+
+b8 pending_write_table_create(pending_write_table* table) {
+    assert(table);
+
+    memset(table, 0, sizeof(pending_write_table));
+
+    if (!d_array_create(&table->writes, sizeof(pending_write), PENDING_WRITE_INITIAL_CAPACITY)) {
+        return false;
+    }
+
+    if (pthread_mutex_init(&table->mutex, NULL) != 0) {
+        d_array_destroy(&table->writes);
+        return false;
+    }
+
+    table->free_head = PENDING_WRITE_NONE;
+    for (u32 i = 0; i < PENDING_WRITE_BUCKET_COUNT; ++i) {
+        table->buckets[i] = PENDING_WRITE_NONE;
+    }
+
+    return true;
+}
+
+void pending_write_table_destroy(pending_write_table* table) {
+    assert(table);
+
+    d_array_destroy(&table->writes);
+    pthread_mutex_destroy(&table->mutex);
+
+    memset(table, 0, sizeof(pending_write_table));
+}
+
+void pending_write_table_track(pending_write_table* table, transfer_handle_pool* handle_pool, transfer_request* request) {
+    assert(table);
+    assert(handle_pool);
+    assert(request);
+
+    request->pending_write = PENDING_WRITE_NONE;
+
+    VkDeviceSize offset;
+    VkDeviceSize end;
+    b8           writes = write_range(request, &offset, &end);
+    b8           reads  = request->type == TRANSFER_TYPE_BUFFER_TO_BUFFER || request->type == TRANSFER_TYPE_PLAN;
+
+    if (!writes && !reads) {
+        return;
+    }
+
+    pthread_mutex_lock(&table->mutex);
+
+    // dropping a write this request still has to read would hand it older contents
+    if (reads) {
+        pin_reads_locked(table, request);
+    }
+
+    if (!writes) {
+        pthread_mutex_unlock(&table->mutex);
+        return;
+    }
+
+    VkBuffer dst = request->dst.buffer;
+
+    u32* link = &table->buckets[bucket_index(dst)];
+    while (*link != PENDING_WRITE_NONE) {
+        pending_write* write = write_at(table, *link);
+
+        if (write->dst != dst || write->offset < offset || write->end > end) {
+            link = &write->next;
+            continue;
+        }
+
+        // the entry stays allocated until the worker takes the old request out of the queue
+        *link        = write->next;
+        write->state = PENDING_WRITE_SUPERSEDED;
+
+        transfer_handle_pool_cancel(handle_pool, write->handle, write->handle_ticket, TRANSFER_STATUS_SUPERSEDED);
+
+        atomic_fetch_add_explicit(&table->superseded_count, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&table->superseded_bytes, write->size, memory_order_relaxed);
+    }
+
+    u32 idx = table->free_head;
+    if (idx != PENDING_WRITE_NONE) {
+        table->free_head = write_at(table, idx)->next;
+    } else {
+        pending_write empty = {0};
+        if (!d_array_push_back(&table->writes, &empty)) {
+            // goes untracked, it just can't be superseded
+            pthread_mutex_unlock(&table->mutex);
+            return;
+        }
+        idx = table->writes.count - 1;
+    }
+
+    u32* bucket = &table->buckets[bucket_index(dst)];
+
+    pending_write* write = write_at(table, idx);
+    write->dst           = dst;
+    write->offset        = offset;
+    write->end           = end;
+    write->size          = request->size;
+    write->handle        = request->handle;
+    write->handle_ticket = request->handle_ticket;
+    write->next          = *bucket;
+    write->state         = PENDING_WRITE_QUEUED;
+
+    *bucket = idx;
+
+    pthread_mutex_unlock(&table->mutex);
+
+    request->pending_write = idx;
+}
+
+b8 pending_write_table_take(pending_write_table* table, u32 write_idx) {
+    assert(table);
+    assert(write_idx != PENDING_WRITE_NONE);
+
+    pthread_mutex_lock(&table->mutex);
+
+    pending_write* write  = write_at(table, write_idx);
+    b8             queued = write->state != PENDING_WRITE_SUPERSEDED;
+
+    // superseded and pinned entries were already unlinked
+    if (write->state == PENDING_WRITE_QUEUED) {
+        u32* link = &table->buckets[bucket_index(write->dst)];
+        while (*link != write_idx) {
+            link = &write_at(table, *link)->next;
+        }
+        *link = write->next;
+    }
+
+    write->state     = PENDING_WRITE_FREE;
+    write->next      = table->free_head;
+    table->free_head = write_idx;
+
+    pthread_mutex_unlock(&table->mutex);
+
+    return queued;
+}
+
+b8 pending_write_table_is_queued(pending_write_table* table, u32 write_idx) {
+    assert(table);
+    assert(write_idx != PENDING_WRITE_NONE);
+
+    pthread_mutex_lock(&table->mutex);
+
+    b8 queued = write_at(table, write_idx)->state != PENDING_WRITE_SUPERSEDED;
+
+    pthread_mutex_unlock(&table->mutex);
+
+    return queued;
+}
+
+void pending_write_table_get_stats(pending_write_table* table, transfer_latest_wins_stats* stats) {
+    assert(table);
+    assert(stats);
+
+    stats->superseded_count = atomic_load_explicit(&table->superseded_count, memory_order_relaxed);
+    stats->superseded_bytes = atomic_load_explicit(&table->superseded_bytes, memory_order_relaxed);
+}
@@ -0,0 +1,103 @@
+#include "spsc_ring.h"
+
+static u32 round_up_pow2(u32 value) {
+    u32 result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+b8 spsc_ring_create(spsc_ring* ring, u32 element_size, u32 capacity) {
+    assert(ring);
+    assert(element_size > 0);
+
+    memset(ring, 0, sizeof(spsc_ring));
+
+    ring->element_size = element_size;
+    ring->capacity     = round_up_pow2(capacity > 0 ? capacity : 1);
+    ring->mask         = ring->capacity - 1;
+
+    ring->memory = malloc((size_t)ring->capacity * element_size);
+    if (!ring->memory) {
+        return false;
+    }
+
+    atomic_init(&ring->back, 0);
+    atomic_init(&ring->front, 0);
+
+    return true;
+}
+
+void spsc_ring_destroy(spsc_ring* ring) {
+    assert(ring);
+
+    free(ring->memory);
+
+    memset(ring, 0, sizeof(spsc_ring));
+}
+
+b8 spsc_ring_push(spsc_ring* ring, const void* element) {
+    assert(ring);
+    assert(element);
+
+    u32 back = atomic_load_explicit(&ring->back, memory_order_relaxed);
+
+    if (back - ring->cached_front == ring->capacity) {
+        ring->cached_front = atomic_load_explicit(&ring->front, memory_order_acquire);
+
+        if (back - ring->cached_front == ring->capacity) {
+            return false;
+        }
+    }
+
+    u32 memory_pos = (back & ring->mask) * ring->element_size;
+    memcpy(&ring->memory[memory_pos], element, ring->element_size);
+
+    atomic_store_explicit(&ring->back, back + 1, memory_order_release);
+
+    return true;
+}
+
+b8 spsc_ring_full(spsc_ring* ring) {
+    assert(ring);
+
+    u32 back = atomic_load_explicit(&ring->back, memory_order_relaxed);
+
+    if (back - ring->cached_front == ring->capacity) {
+        ring->cached_front = atomic_load_explicit(&ring->front, memory_order_acquire);
+    }
+
+    return back - ring->cached_front == ring->capacity;
+}
+
+b8 spsc_ring_pop(spsc_ring* ring, void* element) {
+    assert(ring);
+    assert(element);
+
+    u32 front = atomic_load_explicit(&ring->front, memory_order_relaxed);
+
+    if (front == ring->cached_back) {
+        ring->cached_back = atomic_load_explicit(&ring->back, memory_order_acquire);
+
+        if (front == ring->cached_back) {
+            return false;
+        }
+    }
+
+    u32 memory_pos = (front & ring->mask) * ring->element_size;
+    memcpy(element, &ring->memory[memory_pos], ring->element_size);
+
+    atomic_store_explicit(&ring->front, front + 1, memory_order_release);
+
+    return true;
+}
+
+u32 spsc_ring_count(spsc_ring* ring) {
+    assert(ring);
+
+    u32 back  = atomic_load_explicit(&ring->back, memory_order_acquire);
+    u32 front = atomic_load_explicit(&ring->front, memory_order_acquire);
+
+    return back - front;
+}
@@ -0,0 +1,228 @@
+#include "staging_buffer.h"
+#include "vk_memory.h"
+
+static transfer_error fill_vulkan_err(VkResult vk_error) {
+    transfer_error err;
+    err.type           = TRANSFER_ERROR_TYPE_VULKAN;
+    err.vk_error       = vk_error;
+    err.internal_error = TRANSFER_INTERNAL_ERROR_NONE;
+    return err;
+}
+
+static transfer_error fill_internal_err(transfer_internal_error internal_error) {
+    transfer_error err;
+    err.type           = TRANSFER_ERROR_TYPE_INTERNAL;
+    err.vk_error       = VK_SUCCESS;
+    err.internal_error = internal_error;
+    return err;
+}
+
+b8 staging_buffer_create(staging_buffer* staging, VkDevice device, const transfer_staging_create_info* create_info, transfer_error* error) {
+    assert(staging);
+    assert(create_info);
+    assert(create_info->physical_device != VK_NULL_HANDLE);
+
+    memset(staging, 0, sizeof(staging_buffer));
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(create_info->physical_device, &properties);
+    staging->non_coherent_atom_size = properties.limits.nonCoherentAtomSize;
+
+    VkDeviceSize atom       = staging->non_coherent_atom_size > 0 ? staging->non_coherent_atom_size : 1;
+    VkDeviceSize chunk_size = create_info->chunk_size > 0 ? create_info->chunk_size : STAGING_DEFAULT_CHUNK_SIZE;
+    VkDeviceSize size       = create_info->size > 0 ? create_info->size : STAGING_DEFAULT_SIZE;
+
+    // flushes start at chunk offsets, which have to be multiples of the atom size on non coherent memory
+    chunk_size = (chunk_size + atom - 1) / atom * atom;
+
+    // file reads take a u32 length
+    if (chunk_size > UINT32_MAX) {
+        chunk_size = UINT32_MAX / atom * atom;
+    }
+
+    // at least two chunks, otherwise CPU fill and GPU copy can never overlap
+    if (size < chunk_size * 2) {
+        size = chunk_size * 2;
+    }
+
+    u32 chunk_count     = (u32)(size / chunk_size);
+    staging->chunk_size = chunk_size;
+
+    VkBufferCreateInfo buffer_ci = {
+        .sType                 = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext                 = NULL,
+        .flags                 = 0,
+        .size                  = chunk_size * chunk_count,
+        .usage                 = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode           = VK_SHARING_MODE_EXCLUSIVE,
+        .queueFamilyIndexCount = 0,
+        .pQueueFamilyIndices   = NULL,
+    };
+
+    VkResult vk_res = vkCreateBuffer(device, &buffer_ci, NULL, &staging->buffer);
+    if (vk_res != VK_SUCCESS) {
+        if (error) {
+            *error = fill_vulkan_err(vk_res);
+        }
+        staging_buffer_destroy(staging, device);
+        return false;
+    }
+
+    VkMemoryRequirements memory_requirements;
+    vkGetBufferMemoryRequirements(device, staging->buffer, &memory_requirements);
+
+    VkMemoryPropertyFlags preferred_flags = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    if (create_info->host_cached) {
+        preferred_flags |= VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+    }
+
+    u32                   memory_type_idx;
+    VkMemoryPropertyFlags memory_type_flags;
+    if (!vk_memory_find_type(create_info->physical_device, memory_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                             preferred_flags, &memory_type_idx, &memory_type_flags)) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_NO_SUITABLE_MEMORY_TYPE);
+        }
+        staging_buffer_destroy(staging, device);
+        return false;
+    }
+
+    // cached but non coherent (flushed per chunk) still beats uncached when the CPU reads staging back
+    if (create_info->host_cached && !(memory_type_flags & VK_MEMORY_PROPERTY_HOST_CACHED_BIT)) {
+        vk_memory_find_type(create_info->physical_device, memory_requirements.memoryTypeBits,
+                            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT, 0, &memory_type_idx,
+                            &memory_type_flags);
+    }
+
+    staging->coherent = memory_type_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+    VkMemoryAllocateInfo memory_ai = {
+        .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext           = NULL,
+        .allocationSize  = memory_requirements.size,
+        .memoryTypeIndex = memory_type_idx,
+    };
+
+    vk_res = vkAllocateMemory(device, &memory_ai, NULL, &staging->memory);
+    if (vk_res == VK_SUCCESS) {
+        vk_res = vkBindBufferMemory(device, staging->buffer, staging->memory, 0);
+    }
+    if (vk_res == VK_SUCCESS) {
+        vk_res = vkMapMemory(device, staging->memory, 0, VK_WHOLE_SIZE, 0, (void**)&staging->mapped);
+    }
+
+    if (vk_res != VK_SUCCESS) {
+        if (error) {
+            *error = fill_vulkan_err(vk_res);
+        }
+        staging_buffer_destroy(staging, device);
+        return false;
+    }
+
+    if (!d_array_create(&staging->chunks, sizeof(staging_chunk), chunk_count) || !d_array_resize(&staging->chunks, chunk_count)) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY);
+        }
+        staging_buffer_destroy(staging, device);
+        return false;
+    }
+
+    for (u32 i = 0; i < chunk_count; ++i) {
+        staging_chunk* chunk = d_array_at(&staging->chunks, i);
+        chunk->offset        = i * chunk_size;
+        chunk->fence_ref     = (transfer_handle_fence_ref){.vk_fence = VK_NULL_HANDLE, .fence_generation = 0, .fence_idx = 0};
+    }
+
+    return true;
+}
+
+void staging_buffer_destroy(staging_buffer* staging, VkDevice device) {
+    assert(staging);
+
+    if (staging->mapped) {
+        vkUnmapMemory(device, staging->memory);
+    }
+
+    vkDestroyBuffer(device, staging->buffer, NULL);
+    vkFreeMemory(device, staging->memory, NULL);
+
+    d_array_destroy(&staging->chunks);
+
+    memset(staging, 0, sizeof(staging_buffer));
+}
+
+VkResult staging_buffer_acquire_chunk(staging_buffer* staging, VkDevice device, const transfer_command_pool* command_pool, u32* chunk_idx) {
+    assert(staging);
+    assert(chunk_idx);
+
+    u32            idx   = staging->next_chunk;
+    staging_chunk* chunk = d_array_at(&staging->chunks, idx);
+
+    transfer_handle_fence_ref* fence_ref = &chunk->fence_ref;
+
+    // a bumped generation means the fence was seen signaled and recycled since the chunk was submitted
+    if (fence_ref->vk_fence != VK_NULL_HANDLE && fence_ref->fence_generation == command_pool->fence_generations[fence_ref->fence_idx]) {
+        VkResult vk_res = vkWaitForFences(device, 1, &fence_ref->vk_fence, VK_TRUE, UINT64_MAX);
+        if (vk_res != VK_SUCCESS) {
+            return vk_res;
+        }
+    }
+
+    fence_ref->vk_fence = VK_NULL_HANDLE;
+
+    staging->next_chunk = (idx + 1) % staging->chunks.count;
+    *chunk_idx          = idx;
+
+    return VK_SUCCESS;
+}
+
+u8* staging_buffer_chunk_memory(staging_buffer* staging, u32 chunk_idx) {
+    assert(staging);
+
+    staging_chunk* chunk = d_array_at(&staging->chunks, chunk_idx);
+    return staging->mapped + chunk->offset;
+}
+
+VkDeviceSize staging_buffer_chunk_offset(staging_buffer* staging, u32 chunk_idx) {
+    assert(staging);
+
+    staging_chunk* chunk = d_array_at(&staging->chunks, chunk_idx);
+    return chunk->offset;
+}
+
+VkResult staging_buffer_flush_chunk(staging_buffer* staging, VkDevice device, u32 chunk_idx, VkDeviceSize size) {
+    assert(staging);
+
+    if (staging->coherent) {
+        return VK_SUCCESS;
+    }
+
+    staging_chunk* chunk = d_array_at(&staging->chunks, chunk_idx);
+
+    VkDeviceSize atom         = staging->non_coherent_atom_size > 0 ? staging->non_coherent_atom_size : 1;
+    VkDeviceSize aligned_size = (size + atom - 1) / atom * atom;
+    if (aligned_size > staging->chunk_size) {
+        aligned_size = staging->chunk_size;
+    }
+
+    VkMappedMemoryRange range = {
+        .sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+        .pNext  = NULL,
+        .memory = staging->memory,
+        .offset = chunk->offset,
+        .size   = aligned_size,
+    };
+
+    return vkFlushMappedMemoryRanges(device, 1, &range);
+}
+
+void staging_buffer_retire_chunk(staging_buffer* staging, u32 chunk_idx, const transfer_submission* submission) {
+    assert(staging);
+    assert(submission);
+
+    staging_chunk* chunk = d_array_at(&staging->chunks, chunk_idx);
+
+    chunk->fence_ref.vk_fence         = submission->fence;
+    chunk->fence_ref.fence_generation = submission->fence_generation;
+    chunk->fence_ref.fence_idx        = (u32)submission->cmd_idx;
+}
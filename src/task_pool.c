@@ -0,0 +1,126 @@
+#include "task_pool.h"
+
+static void* task_pool_thread(void* arg) {
+    task_pool* pool = arg;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (1) {
+        while (pool->tasks.count == 0 && !pool->should_close) {
+            pthread_cond_wait(&pool->task_available_cond, &pool->mutex);
+        }
+
+        task next;
+        if (!d_queue_pop(&pool->tasks, &next)) {
+            // queue is empty, so we're closing
+            break;
+        }
+
+        pthread_mutex_unlock(&pool->mutex);
+
+        next.fn(next.user_data);
+
+        pthread_mutex_lock(&pool->mutex);
+        pthread_cond_broadcast(&pool->task_done_cond);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+b8 task_pool_create(task_pool* pool, u32 thread_count) {
+    assert(pool);
+    assert(thread_count > 0);
+
+    memset(pool, 0, sizeof(task_pool));
+
+    if (!d_queue_create(&pool->tasks, sizeof(task), 64)) {
+        return false;
+    }
+
+    pool->threads = malloc(thread_count * sizeof(pthread_t));
+    if (!pool->threads) {
+        d_queue_destroy(&pool->tasks);
+        return false;
+    }
+
+    i32 mutex_create_res          = pthread_mutex_init(&pool->mutex, NULL);
+    i32 task_available_create_res = pthread_cond_init(&pool->task_available_cond, NULL);
+    i32 task_done_create_res      = pthread_cond_init(&pool->task_done_cond, NULL);
+
+    if (mutex_create_res + task_available_create_res + task_done_create_res > 0) {
+        task_pool_destroy(pool);
+        return false;
+    }
+
+    for (u32 i = 0; i < thread_count; ++i) {
+        if (pthread_create(&pool->threads[i], NULL, task_pool_thread, pool) != 0) {
+            task_pool_destroy(pool);
+            return false;
+        }
+        pool->thread_count++;
+    }
+
+    return true;
+}
+
+void task_pool_destroy(task_pool* pool) {
+    assert(pool);
+
+    if (pool->threads) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->should_close = true;
+        pthread_cond_broadcast(&pool->task_available_cond);
+        pthread_mutex_unlock(&pool->mutex);
+
+        for (u32 i = 0; i < pool->thread_count; ++i) {
+            pthread_join(pool->threads[i], NULL);
+        }
+
+        free(pool->threads);
+    }
+
+    pthread_cond_destroy(&pool->task_done_cond);
+    pthread_cond_destroy(&pool->task_available_cond);
+    pthread_mutex_destroy(&pool->mutex);
+    d_queue_destroy(&pool->tasks);
+
+    memset(pool, 0, sizeof(task_pool));
+}
+
+b8 task_pool_push(task_pool* pool, task_fn fn, void* user_data) {
+    assert(pool);
+    assert(fn);
+
+    task new_task = {
+        .fn        = fn,
+        .user_data = user_data,
+    };
+
+    pthread_mutex_lock(&pool->mutex);
+
+    b8 push_successful = d_queue_push(&pool->tasks, &new_task);
+
+    pthread_cond_signal(&pool->task_available_cond);
+    pthread_mutex_unlock(&pool->mutex);
+
+    return push_successful;
+}
+
+void task_pool_wait(task_pool* pool, const atomic_bool* done) {
+    assert(pool);
+    assert(done);
+
+    if (atomic_load(done)) {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while (!atomic_load(done)) {
+        pthread_cond_wait(&pool->task_done_cond, &pool->mutex);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+}
@@ -0,0 +1,259 @@
+#include "transfer_capture.h"
+#include "format_convert.h"
+
+#include <time.h>
+
+static u64 monotonic_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static u64 hash_id_key(u64 key, u32 kind) {
+    u64 hash = (key ^ ((u64)kind << 59)) * 0x9e3779b97f4a7c15ull;
+    return hash ^ (hash >> 32);
+}
+
+static void insert_id(transfer_capture_id_entry* ids, u32 capacity, u64 key, u32 kind, u32 id) {
+    u32 mask = capacity - 1;
+    u32 slot = (u32)hash_id_key(key, kind) & mask;
+
+    while (ids[slot].key != 0) {
+        slot = (slot + 1) & mask;
+    }
+
+    ids[slot] = (transfer_capture_id_entry){.key = key, .kind = kind, .id = id};
+}
+
+static b8 grow_ids(transfer_capture* capture) {
+    u32                        new_capacity = capture->id_capacity * 2;
+    transfer_capture_id_entry* new_ids      = calloc(new_capacity, sizeof(transfer_capture_id_entry));
+
+    if (!new_ids) {
+        return false;
+    }
+
+    for (u32 i = 0; i < capture->id_capacity; ++i) {
+        if (capture->ids[i].key != 0) {
+            insert_id(new_ids, new_capacity, capture->ids[i].key, capture->ids[i].kind, capture->ids[i].id);
+        }
+    }
+
+    free(capture->ids);
+    capture->ids         = new_ids;
+    capture->id_capacity = new_capacity;
+
+    return true;
+}
+
+// ids start at 1 per kind in order of first appearance, 0 is left for "none"
+static u32 get_id_locked(transfer_capture* capture, transfer_capture_id_kind kind, u64 value) {
+    u64 key  = value + 1;
+    u32 mask = capture->id_capacity - 1;
+
+    for (u32 slot = (u32)hash_id_key(key, kind) & mask; capture->ids[slot].key != 0; slot = (slot + 1) & mask) {
+        if (capture->ids[slot].key == key && capture->ids[slot].kind == kind) {
+            return capture->ids[slot].id;
+        }
+    }
+
+    // keep the load factor under one half
+    if ((capture->id_count + 1) * 2 > capture->id_capacity && !grow_ids(capture)) {
+        return 0;
+    }
+
+    u32 id = ++capture->next_id[kind];
+    insert_id(capture->ids, capture->id_capacity, key, kind, id);
+    capture->id_count++;
+
+    return id;
+}
+
+static void write_record_locked(transfer_capture* capture, transfer_capture_record* record) {
+    record->timestamp_ns = monotonic_time_ns() - capture->start_time_ns;
+    record->producer_id  = get_id_locked(capture, TRANSFER_CAPTURE_ID_PRODUCER, (u64)pthread_self());
+
+    if (fwrite(record, sizeof(transfer_capture_record), 1, capture->file) != 1) {
+        capture->failed = true;
+        return;
+    }
+
+    capture->record_count++;
+}
+
+b8 transfer_capture_create(transfer_capture* capture) {
+    assert(capture);
+
+    memset(capture, 0, sizeof(transfer_capture));
+
+    return pthread_mutex_init(&capture->mutex, NULL) == 0;
+}
+
+void transfer_capture_destroy(transfer_capture* capture) {
+    assert(capture);
+
+    transfer_capture_end(capture);
+    pthread_mutex_destroy(&capture->mutex);
+
+    memset(capture, 0, sizeof(transfer_capture));
+}
+
+b8 transfer_capture_begin(transfer_capture* capture, const char* path, u64 start_frame) {
+    assert(capture);
+    assert(path);
+
+    pthread_mutex_lock(&capture->mutex);
+
+    if (capture->file) {
+        pthread_mutex_unlock(&capture->mutex);
+        return false;
+    }
+
+    capture->ids = calloc(TRANSFER_CAPTURE_INITIAL_ID_CAPACITY, sizeof(transfer_capture_id_entry));
+    if (!capture->ids) {
+        pthread_mutex_unlock(&capture->mutex);
+        return false;
+    }
+
+    capture->file = fopen(path, "wb");
+    if (!capture->file) {
+        free(capture->ids);
+        capture->ids = NULL;
+        pthread_mutex_unlock(&capture->mutex);
+        return false;
+    }
+
+    capture->id_capacity  = TRANSFER_CAPTURE_INITIAL_ID_CAPACITY;
+    capture->id_count     = 0;
+    capture->record_count = 0;
+    capture->failed       = false;
+    memset(capture->next_id, 0, sizeof(capture->next_id));
+
+    transfer_capture_header header = {
+        .magic       = TRANSFER_CAPTURE_MAGIC,
+        .version     = TRANSFER_CAPTURE_VERSION,
+        .record_size = sizeof(transfer_capture_record),
+        .start_frame = start_frame,
+    };
+
+    capture->failed        = fwrite(&header, sizeof(header), 1, capture->file) != 1;
+    capture->start_time_ns = monotonic_time_ns();
+
+    pthread_mutex_unlock(&capture->mutex);
+
+    return true;
+}
+
+b8 transfer_capture_end(transfer_capture* capture) {
+    assert(capture);
+
+    pthread_mutex_lock(&capture->mutex);
+
+    if (!capture->file) {
+        pthread_mutex_unlock(&capture->mutex);
+        return true;
+    }
+
+    b8 succeeded = !capture->failed;
+    succeeded &= fclose(capture->file) == 0;
+
+    capture->file = NULL;
+    free(capture->ids);
+    capture->ids = NULL;
+
+    pthread_mutex_unlock(&capture->mutex);
+
+    return succeeded;
+}
+
+void transfer_capture_record_request(transfer_capture* capture, const transfer_request* request, const transfer_submit_context* context) {
+    assert(capture);
+    assert(request);
+
+    transfer_capture_record record = {
+        .event           = TRANSFER_CAPTURE_EVENT_REQUEST,
+        .type            = (u8)request->type,
+        .size            = request->size,
+        .dst_offset      = request->dst_offset,
+        .deadline_frame  = request->deadline_frame == TRANSFER_DEADLINE_NONE ? 0 : request->deadline_frame,
+        .dst_access_mask = request->dst_access_mask,
+        .dst_stage_mask  = request->dst_stage_mask,
+        .context_flags   = context ? (u8)context->flags : 0,
+    };
+
+    // sizes are worked out before taking the lock
+    switch (request->type) {
+    case TRANSFER_TYPE_BUFFER_TO_BUFFER:
+        // the regions themselves aren't captured, replay lays out as many back to back
+        record.region_count = request->region_count;
+        break;
+    case TRANSFER_TYPE_FILE_TO_BUFFER:
+        record.src_size   = request->size;
+        record.src_offset = request->src.file.offset;
+        break;
+    case TRANSFER_TYPE_HOST_TO_BUFFER:
+        record.src_size   = request->size / format_convert_dst_element_size(&request->conversion) *
+                          format_convert_src_element_size(&request->conversion);
+        record.conversion = (u8)request->conversion.type;
+        memcpy(record.swizzle, request->conversion.swizzle, sizeof(record.swizzle));
+        break;
+    case TRANSFER_TYPE_COMPRESSED_TO_BUFFER:
+        record.compression = (u8)request->src.compressed.compression;
+        record.block_count = request->src.compressed.block_count;
+        for (u32 i = 0; i < request->src.compressed.block_count; ++i) {
+            record.src_size += request->src.compressed.blocks[i].compressed_size;
+        }
+        break;
+    case TRANSFER_TYPE_HOST_TO_IMAGE:
+        // the region isn't captured, replay stands a buffer of the same size in for the image
+        record.src_size = request->size;
+        break;
+    case TRANSFER_TYPE_PLAN:
+        // neither are the copies, replay stands one host upload of the plan's total size in for each submit
+        record.src_size = request->size;
+        break;
+    default:
+        assert(0 && "unhandled transfer type");
+    }
+
+    pthread_mutex_lock(&capture->mutex);
+
+    if (!capture->file) {
+        pthread_mutex_unlock(&capture->mutex);
+        return;
+    }
+
+    u64 dst_key = (u64)(uintptr_t)request->dst.buffer;
+    if (request->type == TRANSFER_TYPE_HOST_TO_IMAGE) {
+        dst_key = (u64)(uintptr_t)request->dst.image;
+    } else if (request->type == TRANSFER_TYPE_PLAN) {
+        dst_key = (u64)(uintptr_t)request->plan;
+    }
+
+    record.dst_id     = get_id_locked(capture, TRANSFER_CAPTURE_ID_BUFFER, dst_key);
+    record.context_id = context ? get_id_locked(capture, TRANSFER_CAPTURE_ID_CONTEXT, (u64)(uintptr_t)context) : 0;
+
+    if (request->type == TRANSFER_TYPE_BUFFER_TO_BUFFER) {
+        record.src_id = get_id_locked(capture, TRANSFER_CAPTURE_ID_BUFFER, (u64)(uintptr_t)request->src.buffer);
+    } else if (request->type == TRANSFER_TYPE_FILE_TO_BUFFER) {
+        record.src_id = get_id_locked(capture, TRANSFER_CAPTURE_ID_FILE, (u64)request->src.file.fd);
+    }
+
+    write_record_locked(capture, &record);
+
+    pthread_mutex_unlock(&capture->mutex);
+}
+
+void transfer_capture_record_frame_tick(transfer_capture* capture) {
+    assert(capture);
+
+    transfer_capture_record record = {.event = TRANSFER_CAPTURE_EVENT_FRAME_TICK};
+
+    pthread_mutex_lock(&capture->mutex);
+
+    if (capture->file) {
+        write_record_locked(capture, &record);
+    }
+
+    pthread_mutex_unlock(&capture->mutex);
+}
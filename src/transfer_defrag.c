@@ -0,0 +1,412 @@
+#include "transfer_defrag.h"
+#include "upload_heap.h"
+
+static defrag_move* move_at(transfer_defrag* defrag, u32 idx) {
+    return d_array_at(&defrag->moves, idx);
+}
+
+static upload_heap_block_usage* usage_at(transfer_defrag* defrag, u32 block_idx) {
+    return d_array_at(&defrag->block_usage, block_idx);
+}
+
+static u8* drained_at(transfer_defrag* defrag, u32 block_idx) {
+    return d_array_at(&defrag->drained, block_idx);
+}
+
+static void finish_step(transfer_defrag* defrag) {
+    for (u32 i = 0; i < defrag->moves.count; ++i) {
+        defrag_move* move = move_at(defrag, i);
+
+        if (move->state != DEFRAG_MOVE_IN_FLIGHT) {
+            continue;
+        }
+
+        transfer_relocation relocation = {.old_allocation = move->src, .new_allocation = move->dst};
+
+        // capacity was reserved in transfer_defrag_begin
+        d_array_push_back(&defrag->relocations, &relocation);
+
+        move->state = DEFRAG_MOVE_DONE;
+        defrag->moved_count++;
+        defrag->moved_bytes += move->src.size;
+    }
+
+    defrag->step_state = DEFRAG_STEP_NONE;
+}
+
+static void abandon_step(transfer_defrag* defrag, upload_heap* heap) {
+    // the data never arrived, the destinations go back and the sources stay where they are
+    for (u32 i = 0; i < defrag->moves.count; ++i) {
+        defrag_move* move = move_at(defrag, i);
+
+        if (move->state == DEFRAG_MOVE_IN_FLIGHT) {
+            upload_heap_free(heap, &move->dst);
+            move->state = DEFRAG_MOVE_STUCK;
+        }
+    }
+
+    defrag->step_state = DEFRAG_STEP_NONE;
+}
+
+// the emptiest block that still holds something to move
+static u32 pick_source(transfer_defrag* defrag) {
+    u32 src_block = UPLOAD_HEAP_NODE_NONE;
+
+    for (u32 i = 0; i < defrag->moves.count; ++i) {
+        defrag_move* move = move_at(defrag, i);
+
+        if (move->state != DEFRAG_MOVE_WAITING) {
+            continue;
+        }
+
+        if (src_block == UPLOAD_HEAP_NODE_NONE || usage_at(defrag, move->src_block)->allocated < usage_at(defrag, src_block)->allocated) {
+            src_block = move->src_block;
+        }
+    }
+
+    return src_block;
+}
+
+// blocks that still have allocations waiting to leave or on their way out get emptied later, anything moved into them
+// would have to move again
+static b8 has_pending_moves(transfer_defrag* defrag, u32 block_idx) {
+    for (u32 i = 0; i < defrag->moves.count; ++i) {
+        defrag_move* move = move_at(defrag, i);
+
+        if (move->src_block == block_idx && (move->state == DEFRAG_MOVE_WAITING || move->state == DEFRAG_MOVE_IN_FLIGHT)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// every block with free space that was never a source and has nothing left to move out, fullest first
+static b8 collect_targets(transfer_defrag* defrag) {
+    if (!d_array_resize(&defrag->targets, 0)) {
+        return false;
+    }
+
+    for (u32 i = 0; i < defrag->block_usage.count; ++i) {
+        upload_heap_block_usage* usage = usage_at(defrag, i);
+
+        if (*drained_at(defrag, i) || usage->allocated >= usage->size || has_pending_moves(defrag, i)) {
+            continue;
+        }
+
+        if (!d_array_push_back(&defrag->targets, &i)) {
+            return false;
+        }
+
+        // a handful of blocks, insertion sort is plenty
+        for (u32 j = defrag->targets.count - 1; j > 0; --j) {
+            u32* a = d_array_at(&defrag->targets, j - 1);
+            u32* b = d_array_at(&defrag->targets, j);
+
+            if (usage_at(defrag, *a)->allocated >= usage_at(defrag, *b)->allocated) {
+                break;
+            }
+
+            u32 temp = *a;
+            *a       = *b;
+            *b       = temp;
+        }
+    }
+
+    return true;
+}
+
+// moves as much of src_block as the budget allows into the first target that takes any of it. moves that fit no
+// target at all are given up on, so each call either places something or retires the block's leftovers
+static b8 fill_step(transfer_defrag* defrag, upload_heap* heap, u32 src_block, VkDeviceSize* step_bytes) {
+    u32 target = UPLOAD_HEAP_NODE_NONE;
+
+    *step_bytes = 0;
+    d_array_resize(&defrag->regions, 0);
+
+    for (u32 i = 0; i < defrag->moves.count; ++i) {
+        defrag_move* move = move_at(defrag, i);
+
+        if (move->state != DEFRAG_MOVE_WAITING || move->src_block != src_block) {
+            continue;
+        }
+
+        if (defrag->regions.count > 0 && *step_bytes + move->src.size > defrag->bytes_per_frame) {
+            break;
+        }
+
+        b8 placed = false;
+
+        if (target != UPLOAD_HEAP_NODE_NONE) {
+            placed = upload_heap_allocate_in_block(heap, target, move->src.size, &move->dst);
+        } else {
+            for (u32 j = 0; j < defrag->targets.count && !placed; ++j) {
+                u32 candidate = *(u32*)d_array_at(&defrag->targets, j);
+
+                if (upload_heap_allocate_in_block(heap, candidate, move->src.size, &move->dst)) {
+                    target = candidate;
+                    placed = true;
+                }
+            }
+        }
+
+        if (!placed) {
+            if (target == UPLOAD_HEAP_NODE_NONE) {
+                move->state = DEFRAG_MOVE_STUCK;
+            }
+            continue;
+        }
+
+        VkBufferCopy region = {
+            .srcOffset = move->src.offset,
+            .dstOffset = move->dst.offset,
+            .size      = move->src.size,
+        };
+
+        if (!d_array_push_back(&defrag->regions, &region)) {
+            upload_heap_free(heap, &move->dst);
+            break;
+        }
+
+        move->state = DEFRAG_MOVE_IN_FLIGHT;
+        *step_bytes += move->src.size;
+    }
+
+    return defrag->regions.count > 0;
+}
+
+static b8 plan_step(transfer_defrag* defrag, upload_heap* heap, transfer_request* request) {
+    if (!upload_heap_get_block_usage(heap, &defrag->block_usage)) {
+        return false;
+    }
+
+    u32 drained_count = defrag->drained.count;
+    if (!d_array_resize(&defrag->drained, defrag->block_usage.count)) {
+        return false;
+    }
+
+    for (u32 i = drained_count; i < defrag->drained.count; ++i) {
+        *drained_at(defrag, i) = 0;
+    }
+
+    VkDeviceSize step_bytes = 0;
+
+    while (1) {
+        u32 src_block = pick_source(defrag);
+
+        if (src_block == UPLOAD_HEAP_NODE_NONE || !collect_targets(defrag)) {
+            return false;
+        }
+
+        *drained_at(defrag, src_block) = 1;
+
+        if (fill_step(defrag, heap, src_block, &step_bytes)) {
+            break;
+        }
+    }
+
+    VkBuffer src_buffer = VK_NULL_HANDLE;
+    VkBuffer dst_buffer = VK_NULL_HANDLE;
+
+    for (u32 i = 0; i < defrag->moves.count && src_buffer == VK_NULL_HANDLE; ++i) {
+        defrag_move* move = move_at(defrag, i);
+
+        if (move->state == DEFRAG_MOVE_IN_FLIGHT) {
+            src_buffer = move->src.buffer;
+            dst_buffer = move->dst.buffer;
+        }
+    }
+
+    // ordered so uploads still in flight into the moved ranges land before they're copied
+    *request = (transfer_request){
+        .handle         = TRANSFER_HANDLE_INVALID,
+        .src.buffer     = src_buffer,
+        .dst.buffer     = dst_buffer,
+        .type           = TRANSFER_TYPE_BUFFER_TO_BUFFER,
+        .flags          = TRANSFER_REQUEST_FLAG_ORDERED | TRANSFER_REQUEST_FLAG_DEFRAG,
+        .size           = step_bytes,
+        .regions        = defrag->regions.memory,
+        .region_count   = defrag->regions.count,
+        .deadline_frame = TRANSFER_DEADLINE_NONE,
+    };
+
+    return true;
+}
+
+b8 transfer_defrag_create(transfer_defrag* defrag) {
+    assert(defrag);
+
+    memset(defrag, 0, sizeof(transfer_defrag));
+
+    if (!d_array_create(&defrag->moves, sizeof(defrag_move), 64) || !d_array_create(&defrag->regions, sizeof(VkBufferCopy), 64) ||
+        !d_array_create(&defrag->relocations, sizeof(transfer_relocation), 64) ||
+        !d_array_create(&defrag->block_usage, sizeof(upload_heap_block_usage), 16) || !d_array_create(&defrag->targets, sizeof(u32), 16) ||
+        !d_array_create(&defrag->drained, sizeof(u8), 16) || pthread_mutex_init(&defrag->mutex, NULL) != 0) {
+        d_array_destroy(&defrag->moves);
+        d_array_destroy(&defrag->regions);
+        d_array_destroy(&defrag->relocations);
+        d_array_destroy(&defrag->block_usage);
+        d_array_destroy(&defrag->targets);
+        d_array_destroy(&defrag->drained);
+        return false;
+    }
+
+    return true;
+}
+
+void transfer_defrag_destroy(transfer_defrag* defrag) {
+    assert(defrag);
+
+    d_array_destroy(&defrag->moves);
+    d_array_destroy(&defrag->regions);
+    d_array_destroy(&defrag->relocations);
+    d_array_destroy(&defrag->block_usage);
+    d_array_destroy(&defrag->targets);
+    d_array_destroy(&defrag->drained);
+    pthread_mutex_destroy(&defrag->mutex);
+
+    memset(defrag, 0, sizeof(transfer_defrag));
+}
+
+b8 transfer_defrag_begin(transfer_defrag* defrag, upload_heap* heap, const transfer_allocation* allocations, u32 count,
+                         const transfer_defrag_create_info* create_info) {
+    assert(defrag);
+    assert(heap);
+    assert(allocations || count == 0);
+
+    pthread_mutex_lock(&defrag->mutex);
+
+    if (defrag->running || defrag->step_state != DEFRAG_STEP_NONE) {
+        pthread_mutex_unlock(&defrag->mutex);
+        return false;
+    }
+
+    // relocations the caller hasn't taken yet stay, room for one per new move is reserved behind them
+    u32 published = defrag->relocations.count;
+    b8  reserved  = d_array_resize(&defrag->relocations, published + count);
+
+    defrag->relocations.count = published;
+
+    if (!reserved || !d_array_resize(&defrag->moves, count) || !d_array_resize(&defrag->drained, 0)) {
+        pthread_mutex_unlock(&defrag->mutex);
+        return false;
+    }
+
+    for (u32 i = 0; i < count; ++i) {
+        defrag_move* move = move_at(defrag, i);
+
+        move->src       = allocations[i];
+        move->src_block = upload_heap_allocation_block(heap, &allocations[i]);
+        // an empty copy region isn't valid
+        move->state = allocations[i].size > 0 ? DEFRAG_MOVE_WAITING : DEFRAG_MOVE_STUCK;
+    }
+
+    defrag->bytes_per_frame = create_info && create_info->bytes_per_frame > 0 ? create_info->bytes_per_frame : DEFRAG_DEFAULT_BYTES_PER_FRAME;
+    defrag->running         = count > 0;
+
+    pthread_mutex_unlock(&defrag->mutex);
+
+    return true;
+}
+
+b8 transfer_defrag_step(transfer_defrag* defrag, upload_heap* heap, VkDevice device, const transfer_command_pool* command_pool,
+                        transfer_request* request) {
+    assert(defrag);
+    assert(heap);
+    assert(command_pool);
+    assert(request);
+
+    pthread_mutex_lock(&defrag->mutex);
+
+    if (defrag->step_state == DEFRAG_STEP_SUBMITTED) {
+        transfer_handle_fence_ref* fence_ref = &defrag->step_fence_ref;
+        VkResult                   vk_res    = VK_SUCCESS;
+
+        // a moved on generation means the fence already signaled and was reused
+        if (fence_ref->fence_generation == command_pool->fence_generations[fence_ref->fence_idx]) {
+            vk_res = vkGetFenceStatus(device, fence_ref->vk_fence);
+        }
+
+        if (vk_res == VK_NOT_READY) {
+            pthread_mutex_unlock(&defrag->mutex);
+            return false;
+        }
+
+        if (vk_res == VK_SUCCESS) {
+            finish_step(defrag);
+        } else {
+            defrag->step_state = DEFRAG_STEP_FAILED;
+        }
+    }
+
+    if (defrag->step_state == DEFRAG_STEP_FAILED) {
+        abandon_step(defrag, heap);
+    }
+
+    b8 planned = false;
+
+    if (defrag->running && defrag->step_state == DEFRAG_STEP_NONE) {
+        planned            = plan_step(defrag, heap, request);
+        defrag->running    = planned;
+        defrag->step_state = planned ? DEFRAG_STEP_QUEUED : DEFRAG_STEP_NONE;
+    }
+
+    pthread_mutex_unlock(&defrag->mutex);
+
+    return planned;
+}
+
+void transfer_defrag_record_submission(transfer_defrag* defrag, const transfer_submission* submission) {
+    assert(defrag);
+
+    pthread_mutex_lock(&defrag->mutex);
+
+    assert(defrag->step_state == DEFRAG_STEP_QUEUED);
+
+    if (submission) {
+        defrag->step_fence_ref.vk_fence         = submission->fence;
+        defrag->step_fence_ref.fence_generation = submission->fence_generation;
+        defrag->step_fence_ref.fence_idx        = (u32)submission->cmd_idx;
+        defrag->step_state                      = DEFRAG_STEP_SUBMITTED;
+    } else {
+        defrag->step_state = DEFRAG_STEP_FAILED;
+    }
+
+    pthread_mutex_unlock(&defrag->mutex);
+}
+
+u32 transfer_defrag_take_relocations(transfer_defrag* defrag, transfer_relocation* relocations, u32 max_count) {
+    assert(defrag);
+    assert(relocations || max_count == 0);
+
+    pthread_mutex_lock(&defrag->mutex);
+
+    u32 count = 0;
+    while (count < max_count && d_array_pop_back(&defrag->relocations, &relocations[count])) {
+        count++;
+    }
+
+    pthread_mutex_unlock(&defrag->mutex);
+
+    return count;
+}
+
+void transfer_defrag_get_stats(transfer_defrag* defrag, transfer_defrag_stats* stats) {
+    assert(defrag);
+    assert(stats);
+
+    pthread_mutex_lock(&defrag->mutex);
+
+    stats->running          = defrag->running || defrag->step_state != DEFRAG_STEP_NONE;
+    stats->remaining_count  = 0;
+    stats->relocation_count = defrag->relocations.count;
+    stats->moved_count      = defrag->moved_count;
+    stats->moved_bytes      = defrag->moved_bytes;
+
+    for (u32 i = 0; i < defrag->moves.count; ++i) {
+        defrag_move_state state = move_at(defrag, i)->state;
+        stats->remaining_count += state == DEFRAG_MOVE_WAITING || state == DEFRAG_MOVE_IN_FLIGHT;
+    }
+
+    pthread_mutex_unlock(&defrag->mutex);
+}
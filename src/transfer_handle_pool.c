@@ -1,8 +1,11 @@
 #include "transfer_handle_pool.h"
 #include "transfer_types.h"
 
+// the ticket of the handle's latest enqueue lives in the high half of state, its transfer_status in the low half
+#define STATE_STATUS_MASK 0xffffffffull
+
 typedef struct transfer_handle_t {
-    _Atomic transfer_status   status;
+    atomic_uint_fast64_t      state;
     transfer_error            error;
     transfer_handle_fence_ref fence_ref;
 } transfer_handle_t;
@@ -19,11 +22,15 @@ const transfer_error default_error = {
 };
 
 const transfer_handle_t default_handle = {
-    .status    = TRANSFER_STATUS_READY,
+    .state     = TRANSFER_STATUS_READY,
     .error     = default_error,
     .fence_ref = {.vk_fence = VK_NULL_HANDLE, .fence_generation = 0, .fence_idx = 0},
 };
 
+static u64 pack_state(u32 ticket, transfer_status status) {
+    return (u64)ticket << 32 | (u64)status;
+}
+
 static transfer_handle_slot_t* transfer_handle_pool_get_handle_slot(transfer_handle_pool* handle_pool, transfer_handle handle) {
     assert(handle_pool);
 
@@ -135,7 +142,14 @@ void transfer_handle_pool_reset_handle(transfer_handle_pool* handle_pool, transf
         return;
     }
 
-    handle_slot->handle = default_handle;
+    handle_slot->handle.error     = default_handle.error;
+    handle_slot->handle.fence_ref = default_handle.fence_ref;
+
+    // the worker and host copy threads may update state meanwhile. keeps the ticket, so requests from before the reset
+    // still can't claim the handle
+    u64 state = atomic_load(&handle_slot->handle.state);
+    while (!atomic_compare_exchange_weak(&handle_slot->handle.state, &state, (state & ~STATE_STATUS_MASK) | TRANSFER_STATUS_READY)) {
+    }
 }
 
 void transfer_handle_pool_free_handle(transfer_handle_pool* handle_pool, transfer_handle handle) {
@@ -216,7 +230,9 @@ void transfer_handle_pool_insert_status_barrier(transfer_handle_pool* handle_poo
         return;
     }
 
-    atomic_store(&handle_slot->handle.status, status);
+    u64 state = atomic_load(&handle_slot->handle.state);
+    while (!atomic_compare_exchange_weak(&handle_slot->handle.state, &state, (state & ~STATE_STATUS_MASK) | status)) {
+    }
 }
 
 b8 transfer_handle_pool_get_handle_status(transfer_handle_pool* handle_pool, transfer_handle handle, transfer_status* status) {
@@ -226,6 +242,69 @@ b8 transfer_handle_pool_get_handle_status(transfer_handle_pool* handle_pool, tra
         return false;
     }
 
-    *status = atomic_load(&handle_slot->handle.status);
+    *status = (transfer_status)(atomic_load(&handle_slot->handle.state) & STATE_STATUS_MASK);
     return true;
 }
+
+u32 transfer_handle_pool_mark_pending(transfer_handle_pool* handle_pool, transfer_handle handle) {
+    transfer_handle_slot_t* handle_slot = transfer_handle_pool_get_handle_slot(handle_pool, handle);
+
+    if (!handle_slot) {
+        return 0;
+    }
+
+    u64 state  = atomic_load(&handle_slot->handle.state);
+    u32 ticket = 0;
+    do {
+        ticket = (u32)(state >> 32) + 1;
+    } while (!atomic_compare_exchange_weak(&handle_slot->handle.state, &state, pack_state(ticket, TRANSFER_STATUS_PENDING)));
+
+    return ticket;
+}
+
+b8 transfer_handle_pool_claim(transfer_handle_pool* handle_pool, transfer_handle handle, u32 ticket) {
+    transfer_handle_slot_t* handle_slot = transfer_handle_pool_get_handle_slot(handle_pool, handle);
+
+    if (!handle_slot) {
+        return true;
+    }
+
+    u64 expected = pack_state(ticket, TRANSFER_STATUS_PENDING);
+    return atomic_compare_exchange_strong(&handle_slot->handle.state, &expected, pack_state(ticket, TRANSFER_STATUS_EXECUTING));
+}
+
+b8 transfer_handle_pool_is_pending(transfer_handle_pool* handle_pool, transfer_handle handle, u32 ticket) {
+    transfer_handle_slot_t* handle_slot = transfer_handle_pool_get_handle_slot(handle_pool, handle);
+
+    if (!handle_slot) {
+        return true;
+    }
+
+    return atomic_load(&handle_slot->handle.state) == pack_state(ticket, TRANSFER_STATUS_PENDING);
+}
+
+b8 transfer_handle_pool_cancel(transfer_handle_pool* handle_pool, transfer_handle handle, u32 ticket, transfer_status status) {
+    transfer_handle_slot_t* handle_slot = transfer_handle_pool_get_handle_slot(handle_pool, handle);
+
+    if (!handle_slot) {
+        return false;
+    }
+
+    u64 expected = pack_state(ticket, TRANSFER_STATUS_PENDING);
+    return atomic_compare_exchange_strong(&handle_slot->handle.state, &expected, pack_state(ticket, status));
+}
+
+b8 transfer_handle_pool_cancel_current(transfer_handle_pool* handle_pool, transfer_handle handle, transfer_status status) {
+    transfer_handle_slot_t* handle_slot = transfer_handle_pool_get_handle_slot(handle_pool, handle);
+
+    if (!handle_slot) {
+        return false;
+    }
+
+    u64 state = atomic_load(&handle_slot->handle.state);
+    if ((state & STATE_STATUS_MASK) != TRANSFER_STATUS_PENDING) {
+        return false;
+    }
+
+    return atomic_compare_exchange_strong(&handle_slot->handle.state, &state, (state & ~STATE_STATUS_MASK) | status);
+}
@@ -0,0 +1,384 @@
+#include "transfer_mirrored_buffer.h"
+#include "transfer_handle_pool.h"
+#include "transfer_request.h"
+#include "transfer_scheduler.h"
+#include "vk_memory.h"
+#include "vk_transfer.h"
+
+#include <sched.h>
+
+static transfer_error fill_vulkan_err(VkResult vk_error) {
+    transfer_error err;
+    err.type           = TRANSFER_ERROR_TYPE_VULKAN;
+    err.vk_error       = vk_error;
+    err.internal_error = TRANSFER_INTERNAL_ERROR_NONE;
+    return err;
+}
+
+static transfer_error fill_internal_err(transfer_internal_error internal_error) {
+    transfer_error err;
+    err.type           = TRANSFER_ERROR_TYPE_INTERNAL;
+    err.vk_error       = VK_SUCCESS;
+    err.internal_error = internal_error;
+    return err;
+}
+
+static void release_resources(transfer_mirrored_buffer* mirror) {
+    VkDevice device = mirror->engine->vk_device;
+
+    vkDestroyBuffer(device, mirror->src, NULL);
+    vkFreeMemory(device, mirror->memory, NULL);
+    free(mirror->dirty_words);
+    d_array_destroy(&mirror->regions);
+}
+
+static b8 create_src_buffer(transfer_mirrored_buffer* mirror, VkPhysicalDevice physical_device, transfer_error* error) {
+    VkDevice device = mirror->engine->vk_device;
+
+    VkBufferCreateInfo buffer_ci = {
+        .sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext       = NULL,
+        .size        = mirror->size,
+        .usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+
+    VkResult vk_res = vkCreateBuffer(device, &buffer_ci, NULL, &mirror->src);
+    if (vk_res != VK_SUCCESS) {
+        *error = fill_vulkan_err(vk_res);
+        return false;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, mirror->src, &requirements);
+
+    u32                   memory_type_idx;
+    VkMemoryPropertyFlags memory_type_flags;
+    if (!vk_memory_find_type(physical_device, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                             VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &memory_type_idx, &memory_type_flags)) {
+        *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_NO_SUITABLE_MEMORY_TYPE);
+        return false;
+    }
+
+    mirror->coherent    = memory_type_flags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+    mirror->memory_size = requirements.size;
+
+    VkMemoryAllocateInfo memory_ai = {
+        .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+        .pNext           = NULL,
+        .allocationSize  = requirements.size,
+        .memoryTypeIndex = memory_type_idx,
+    };
+
+    vk_res = vkAllocateMemory(device, &memory_ai, NULL, &mirror->memory);
+    if (vk_res == VK_SUCCESS) {
+        vk_res = vkBindBufferMemory(device, mirror->src, mirror->memory, 0);
+    }
+    if (vk_res == VK_SUCCESS) {
+        vk_res = vkMapMemory(device, mirror->memory, 0, VK_WHOLE_SIZE, 0, (void**)&mirror->mapped);
+    }
+    if (vk_res != VK_SUCCESS) {
+        *error = fill_vulkan_err(vk_res);
+        return false;
+    }
+
+    return true;
+}
+
+static void mark_pages(transfer_mirrored_buffer* mirror, u64 first_page, u64 last_page) {
+    for (u64 page = first_page; page <= last_page;) {
+        u64 bit   = page & 63;
+        u64 count = 64 - bit < last_page - page + 1 ? 64 - bit : last_page - page + 1;
+        u64 mask  = (count == 64 ? ~0ull : (1ull << count) - 1) << bit;
+
+        // release pairs with the flush's acquire, so the data written before marking is what the flush submits
+        atomic_fetch_or_explicit(&mirror->dirty_words[page >> 6], mask, memory_order_release);
+        page += count;
+    }
+}
+
+static b8 push_region(transfer_mirrored_buffer* mirror, u64 first_page, u64 end_page) {
+    VkDeviceSize offset = first_page << mirror->page_shift;
+    VkDeviceSize end    = end_page << mirror->page_shift;
+
+    VkBufferCopy region = {
+        .srcOffset = offset,
+        .dstOffset = mirror->dst_offset + offset,
+        .size      = (end < mirror->size ? end : mirror->size) - offset,
+    };
+
+    return d_array_push_back(&mirror->regions, &region);
+}
+
+static void flush_mapped_regions(transfer_mirrored_buffer* mirror) {
+    // pages are a multiple of nonCoherentAtomSize, only the tail of the buffer needs rounding
+    for (u32 i = 0; i < mirror->regions.count; ++i) {
+        VkBufferCopy* region = d_array_at(&mirror->regions, i);
+        VkDeviceSize  end    = (region->srcOffset + region->size + mirror->page_size - 1) & ~(mirror->page_size - 1);
+
+        VkMappedMemoryRange range = {
+            .sType  = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE,
+            .pNext  = NULL,
+            .memory = mirror->memory,
+            .offset = region->srcOffset,
+            .size   = end < mirror->memory_size ? end - region->srcOffset : VK_WHOLE_SIZE,
+        };
+
+        vkFlushMappedMemoryRanges(mirror->engine->vk_device, 1, &range);
+    }
+}
+
+b8 transfer_mirrored_buffer_create(transfer_engine* engine, const transfer_mirrored_buffer_create_info* create_info,
+                                   transfer_mirrored_buffer* mirror, transfer_error* error) {
+    assert(engine);
+    assert(create_info);
+    assert(mirror);
+    assert(create_info->physical_device != VK_NULL_HANDLE);
+    assert(create_info->size > 0);
+
+    memset(mirror, 0, sizeof(transfer_mirrored_buffer));
+
+    mirror->engine          = engine;
+    mirror->dst             = create_info->dst;
+    mirror->dst_offset      = create_info->dst_offset;
+    mirror->size            = create_info->size;
+    mirror->dst_access_mask = create_info->dst_access_mask;
+    mirror->dst_stage_mask  = create_info->dst_stage_mask;
+    mirror->merge_gap       = create_info->merge_gap > 0 ? create_info->merge_gap : MIRROR_DEFAULT_MERGE_GAP;
+    atomic_store(&mirror->flush_queued, false);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(create_info->physical_device, &properties);
+
+    // a power of two maps offsets to pages with a shift, and non coherent flushes stay atom aligned
+    VkDeviceSize page_size = create_info->page_size > 0 ? create_info->page_size : MIRROR_DEFAULT_PAGE_SIZE;
+    if (page_size < properties.limits.nonCoherentAtomSize) {
+        page_size = properties.limits.nonCoherentAtomSize;
+    }
+
+    mirror->page_shift = 63 - (u32)__builtin_clzll(page_size);
+    if ((1ull << mirror->page_shift) < page_size) {
+        mirror->page_shift++;
+    }
+    mirror->page_size = 1ull << mirror->page_shift;
+
+    u64 page_count           = (mirror->size + mirror->page_size - 1) >> mirror->page_shift;
+    mirror->dirty_word_count = (u32)((page_count + 63) / 64);
+    mirror->dirty_words      = calloc(mirror->dirty_word_count, sizeof(atomic_uint_fast64_t));
+
+    transfer_error create_error;
+
+    if (!mirror->dirty_words || !d_array_create(&mirror->regions, sizeof(VkBufferCopy), 16)) {
+        create_error = fill_internal_err(TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY);
+    } else if (create_src_buffer(mirror, create_info->physical_device, &create_error)) {
+        return true;
+    }
+
+    if (error) {
+        *error = create_error;
+    }
+
+    release_resources(mirror);
+    memset(mirror, 0, sizeof(transfer_mirrored_buffer));
+
+    return false;
+}
+
+void transfer_mirrored_buffer_destroy(transfer_mirrored_buffer* mirror) {
+    assert(mirror);
+
+    transfer_engine* engine = mirror->engine;
+
+    // the worker still needs the regions
+    while (atomic_load(&mirror->flush_queued)) {
+        sched_yield();
+    }
+
+    transfer_handle_fence_ref* fence_ref = &mirror->fence_ref;
+    if (fence_ref->vk_fence != VK_NULL_HANDLE && fence_ref->fence_generation == engine->command_pool.fence_generations[fence_ref->fence_idx]) {
+        vkWaitForFences(engine->vk_device, 1, &fence_ref->vk_fence, VK_TRUE, UINT64_MAX);
+    }
+
+    release_resources(mirror);
+
+    memset(mirror, 0, sizeof(transfer_mirrored_buffer));
+}
+
+void* transfer_mirrored_buffer_data(transfer_mirrored_buffer* mirror) {
+    assert(mirror);
+
+    return mirror->mapped;
+}
+
+void transfer_mirrored_buffer_mark_dirty(transfer_mirrored_buffer* mirror, VkDeviceSize offset, VkDeviceSize size) {
+    assert(mirror);
+    assert(offset + size <= mirror->size);
+
+    if (size == 0) {
+        return;
+    }
+
+    mark_pages(mirror, offset >> mirror->page_shift, (offset + size - 1) >> mirror->page_shift);
+}
+
+void transfer_mirrored_buffer_write(transfer_mirrored_buffer* mirror, VkDeviceSize offset, const void* data, VkDeviceSize size) {
+    assert(mirror);
+    assert(data || size == 0);
+    assert(offset + size <= mirror->size);
+
+    memcpy(mirror->mapped + offset, data, size);
+    transfer_mirrored_buffer_mark_dirty(mirror, offset, size);
+}
+
+void transfer_mirrored_buffer_get_stats(const transfer_mirrored_buffer* mirror, transfer_mirrored_buffer_stats* stats) {
+    assert(mirror);
+    assert(stats);
+
+    stats->flush_count   = mirror->flush_count;
+    stats->region_count  = mirror->region_count;
+    stats->flushed_bytes = mirror->flushed_bytes;
+}
+
+// swaps the dirty bitmap out and turns it into the flush's copy regions. region_count is 0 when nothing was dirty.
+// only while flush_queued is held by the caller
+static b8 prepare_flush(transfer_mirrored_buffer* mirror, transfer_request* request) {
+    assert(mirror);
+    assert(request);
+
+    d_array_resize(&mirror->regions, 0);
+
+    u64 gap_pages = mirror->merge_gap >> mirror->page_shift;
+    u64 run_start = 0;
+    u64 run_end   = 0;
+    b8  run_open  = false;
+    b8  pushed    = true;
+
+    // swapping words out means a write racing the flush re-marks its page for the next one
+    for (u32 w = 0; w < mirror->dirty_word_count; ++w) {
+        u64 bits = atomic_exchange_explicit(&mirror->dirty_words[w], 0, memory_order_acquire);
+
+        while (bits) {
+            u64 page = (u64)w * 64 + (u64)__builtin_ctzll(bits);
+            bits &= bits - 1;
+
+            // copying a few clean pages is cheaper than another region
+            if (run_open && page - run_end <= gap_pages) {
+                run_end = page + 1;
+                continue;
+            }
+
+            if (run_open) {
+                pushed &= push_region(mirror, run_start, run_end);
+            }
+
+            run_start = page;
+            run_end   = page + 1;
+            run_open  = true;
+        }
+    }
+
+    if (run_open) {
+        pushed &= push_region(mirror, run_start, run_end);
+    }
+
+    if (!pushed) {
+        // out of memory: some runs have no region, send everything next time
+        mark_pages(mirror, 0, (mirror->size - 1) >> mirror->page_shift);
+        return false;
+    }
+
+    VkDeviceSize size = 0;
+    for (u32 i = 0; i < mirror->regions.count; ++i) {
+        size += ((VkBufferCopy*)d_array_at(&mirror->regions, i))->size;
+    }
+
+    if (!mirror->coherent) {
+        flush_mapped_regions(mirror);
+    }
+
+    mirror->flush_count++;
+    mirror->region_count += mirror->regions.count;
+    mirror->flushed_bytes += size;
+
+    // the barrier also covers transfer writes, so the next flush's copy into the same range waits for this one
+    *request = (transfer_request){
+        .handle          = TRANSFER_HANDLE_INVALID,
+        .src.buffer      = mirror->src,
+        .dst.buffer      = mirror->dst,
+        .type            = TRANSFER_TYPE_BUFFER_TO_BUFFER,
+        .flags           = TRANSFER_REQUEST_FLAG_NONE,
+        .dst_access_mask = mirror->dst_access_mask ? mirror->dst_access_mask | VK_ACCESS_TRANSFER_WRITE_BIT : 0,
+        .dst_stage_mask  = mirror->dst_stage_mask ? mirror->dst_stage_mask | VK_PIPELINE_STAGE_TRANSFER_BIT : 0,
+        .size            = size,
+        .regions         = mirror->regions.memory,
+        .region_count    = mirror->regions.count,
+        .mirror          = mirror,
+        .deadline_frame  = TRANSFER_DEADLINE_NONE,
+    };
+
+    return true;
+}
+
+// puts the regions of a flush that never reached the GPU back into the bitmap and releases flush_queued
+static void abandon_flush(transfer_mirrored_buffer* mirror) {
+    assert(mirror);
+
+    for (u32 i = 0; i < mirror->regions.count; ++i) {
+        VkBufferCopy* region = d_array_at(&mirror->regions, i);
+        transfer_mirrored_buffer_mark_dirty(mirror, region->srcOffset, region->size);
+    }
+
+    atomic_store(&mirror->flush_queued, false);
+}
+
+b8 transfer_mirrored_buffer_flush(transfer_mirrored_buffer* mirror, u64 deadline_frame, transfer_handle handle) {
+    assert(mirror);
+
+    transfer_engine* engine = mirror->engine;
+
+    // the regions of the previous flush are still waiting for the worker
+    b8 idle = false;
+    if (!atomic_compare_exchange_strong(&mirror->flush_queued, &idle, true)) {
+        return false;
+    }
+
+    transfer_handle_pool_reset_handle(&engine->handle_pool, handle);
+
+    transfer_request request;
+    if (!prepare_flush(mirror, &request)) {
+        atomic_store(&mirror->flush_queued, false);
+        return false;
+    }
+
+    if (request.region_count == 0) {
+        atomic_store(&mirror->flush_queued, false);
+        transfer_handle_pool_insert_status_barrier(&engine->handle_pool, handle, TRANSFER_STATUS_COMPLETE);
+        return true;
+    }
+
+    request.handle         = handle;
+    request.deadline_frame = transfer_scheduler_deadline_key(deadline_frame);
+
+    if (!transfer_engine_enqueue_request(engine, &request)) {
+        abandon_flush(mirror);
+        return false;
+    }
+
+    return true;
+}
+
+void transfer_mirrored_buffer_record_submission(transfer_mirrored_buffer* mirror, const transfer_submission* submission) {
+    assert(mirror);
+
+    if (!submission) {
+        abandon_flush(mirror);
+        return;
+    }
+
+    mirror->fence_ref.vk_fence         = submission->fence;
+    mirror->fence_ref.fence_generation = submission->fence_generation;
+    mirror->fence_ref.fence_idx        = (u32)submission->cmd_idx;
+
+    // publishes fence_ref to transfer_mirrored_buffer_destroy
+    atomic_store(&mirror->flush_queued, false);
+}
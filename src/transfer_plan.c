@@ -0,0 +1,322 @@
+#include "transfer_plan.h"
+#include "transfer_handle_pool.h"
+#include "transfer_request.h"
+#include "transfer_scheduler.h"
+#include "transfer_submission.h"
+#include "vk_transfer.h"
+
+#include <sched.h>
+
+static transfer_error fill_vulkan_err(VkResult vk_error) {
+    transfer_error err;
+    err.type           = TRANSFER_ERROR_TYPE_VULKAN;
+    err.vk_error       = vk_error;
+    err.internal_error = TRANSFER_INTERNAL_ERROR_NONE;
+    return err;
+}
+
+static transfer_error fill_internal_err(transfer_internal_error internal_error) {
+    transfer_error err;
+    err.type           = TRANSFER_ERROR_TYPE_INTERNAL;
+    err.vk_error       = VK_SUCCESS;
+    err.internal_error = internal_error;
+    return err;
+}
+
+static void release_resources(transfer_plan* plan) {
+    // destroying the pool frees the command buffer
+    if (plan->pool != VK_NULL_HANDLE) {
+        vkDestroyCommandPool(plan->engine->vk_device, plan->pool, NULL);
+    }
+
+    free(plan->copies);
+    free(plan->regions);
+    free(plan->buffers);
+}
+
+static void add_buffer(transfer_plan* plan, VkBuffer buffer) {
+    for (u32 i = 0; i < plan->buffer_count; ++i) {
+        if (plan->buffers[i] == buffer) {
+            return;
+        }
+    }
+
+    plan->buffers[plan->buffer_count++] = buffer;
+}
+
+static b8 copy_create_info(transfer_plan* plan, const transfer_plan_create_info* create_info) {
+    u32 region_count = 0;
+    for (u32 i = 0; i < create_info->copy_count; ++i) {
+        region_count += create_info->copies[i].region_count;
+    }
+
+    plan->copies  = malloc(create_info->copy_count * sizeof(transfer_plan_copy));
+    plan->regions = malloc(region_count * sizeof(VkBufferCopy));
+    plan->buffers = malloc(create_info->copy_count * 2 * sizeof(VkBuffer));
+
+    if (!plan->copies || !plan->regions || !plan->buffers) {
+        return false;
+    }
+
+    VkBufferCopy* regions = plan->regions;
+
+    for (u32 i = 0; i < create_info->copy_count; ++i) {
+        const transfer_plan_copy* copy = &create_info->copies[i];
+        assert(copy->region_count > 0);
+
+        memcpy(regions, copy->regions, copy->region_count * sizeof(VkBufferCopy));
+
+        plan->copies[i]         = *copy;
+        plan->copies[i].regions = regions;
+
+        for (u32 r = 0; r < copy->region_count; ++r) {
+            plan->size += regions[r].size;
+        }
+
+        regions += copy->region_count;
+
+        add_buffer(plan, copy->src);
+        add_buffer(plan, copy->dst);
+    }
+
+    plan->copy_count = create_info->copy_count;
+
+    return true;
+}
+
+static VkResult record_copies(transfer_plan* plan, const transfer_plan_create_info* create_info) {
+    VkDevice device = plan->engine->vk_device;
+
+    VkCommandPoolCreateInfo pool_ci = {
+        .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+        .pNext            = NULL,
+        .flags            = 0,
+        .queueFamilyIndex = plan->engine->queue_family,
+    };
+
+    VkResult vk_res = vkCreateCommandPool(device, &pool_ci, NULL, &plan->pool);
+    if (vk_res != VK_SUCCESS) {
+        plan->pool = VK_NULL_HANDLE;
+        return vk_res;
+    }
+
+    VkCommandBufferAllocateInfo command_buffer_ai = {
+        .sType              = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .pNext              = NULL,
+        .commandPool        = plan->pool,
+        .level              = VK_COMMAND_BUFFER_LEVEL_SECONDARY,
+        .commandBufferCount = 1,
+    };
+
+    vk_res = vkAllocateCommandBuffers(device, &command_buffer_ai, &plan->cmd);
+    if (vk_res != VK_SUCCESS) {
+        return vk_res;
+    }
+
+    VkCommandBufferInheritanceInfo inheritance_info = {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO,
+        .pNext = NULL,
+    };
+
+    // a new submit may be recorded while the previous one is still executing
+    VkCommandBufferBeginInfo begin_info = {
+        .sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext            = NULL,
+        .flags            = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT,
+        .pInheritanceInfo = &inheritance_info,
+    };
+
+    vk_res = vkBeginCommandBuffer(plan->cmd, &begin_info);
+    if (vk_res != VK_SUCCESS) {
+        return vk_res;
+    }
+
+    for (u32 i = 0; i < plan->copy_count; ++i) {
+        const transfer_plan_copy* copy = &plan->copies[i];
+        vkCmdCopyBuffer(plan->cmd, copy->src, copy->dst, copy->region_count, copy->regions);
+    }
+
+    // only carries the destination masks
+    transfer_request masks = {
+        .dst_access_mask = create_info->dst_access_mask,
+        .dst_stage_mask  = create_info->dst_stage_mask,
+    };
+
+    for (u32 i = 0; i < plan->copy_count; ++i) {
+        b8 seen = false;
+        for (u32 j = 0; j < i && !seen; ++j) {
+            seen = plan->copies[j].dst == plan->copies[i].dst;
+        }
+
+        if (!seen) {
+            transfer_record_dst_buffer_barrier(plan->cmd, &masks, plan->copies[i].dst, 0, VK_WHOLE_SIZE);
+        }
+    }
+
+    return vkEndCommandBuffer(plan->cmd);
+}
+
+b8 transfer_plan_registry_create(transfer_plan_registry* registry) {
+    assert(registry);
+
+    registry->head = NULL;
+
+    return pthread_mutex_init(&registry->mutex, NULL) == 0;
+}
+
+void transfer_plan_registry_destroy(transfer_plan_registry* registry) {
+    assert(registry);
+
+    pthread_mutex_destroy(&registry->mutex);
+    registry->head = NULL;
+}
+
+void transfer_plan_registry_buffer_destroyed(transfer_plan_registry* registry, VkBuffer buffer) {
+    assert(registry);
+
+    pthread_mutex_lock(&registry->mutex);
+
+    for (transfer_plan* plan = registry->head; plan; plan = plan->next) {
+        for (u32 i = 0; i < plan->buffer_count; ++i) {
+            if (plan->buffers[i] == buffer) {
+                atomic_store(&plan->valid, false);
+                break;
+            }
+        }
+    }
+
+    pthread_mutex_unlock(&registry->mutex);
+}
+
+b8 transfer_plan_create(transfer_engine* engine, const transfer_plan_create_info* create_info, transfer_plan* plan, transfer_error* error) {
+    assert(engine);
+    assert(create_info);
+    assert(plan);
+    assert(create_info->copy_count > 0);
+
+    memset(plan, 0, sizeof(transfer_plan));
+
+    plan->engine = engine;
+    atomic_store(&plan->queued_count, 0);
+
+    transfer_error create_error;
+
+    if (!copy_create_info(plan, create_info)) {
+        create_error = fill_internal_err(TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY);
+    } else {
+        VkResult vk_res = record_copies(plan, create_info);
+
+        if (vk_res == VK_SUCCESS) {
+            atomic_store(&plan->valid, true);
+
+            transfer_plan_registry* registry = &engine->plans;
+            pthread_mutex_lock(&registry->mutex);
+
+            plan->next = registry->head;
+            if (registry->head) {
+                registry->head->prev = plan;
+            }
+            registry->head = plan;
+
+            pthread_mutex_unlock(&registry->mutex);
+
+            return true;
+        }
+
+        create_error = fill_vulkan_err(vk_res);
+    }
+
+    if (error) {
+        *error = create_error;
+    }
+
+    release_resources(plan);
+    memset(plan, 0, sizeof(transfer_plan));
+
+    return false;
+}
+
+void transfer_plan_destroy(transfer_plan* plan) {
+    assert(plan);
+
+    transfer_engine*        engine   = plan->engine;
+    transfer_plan_registry* registry = &engine->plans;
+
+    pthread_mutex_lock(&registry->mutex);
+
+    if (plan->prev) {
+        plan->prev->next = plan->next;
+    } else {
+        registry->head = plan->next;
+    }
+    if (plan->next) {
+        plan->next->prev = plan->prev;
+    }
+
+    pthread_mutex_unlock(&registry->mutex);
+
+    // the worker still needs the command buffer
+    while (atomic_load(&plan->queued_count) > 0) {
+        sched_yield();
+    }
+
+    // submissions on the queue finish in order, the last one covers every earlier submit
+    transfer_handle_fence_ref* fence_ref = &plan->fence_ref;
+    if (fence_ref->vk_fence != VK_NULL_HANDLE && fence_ref->fence_generation == engine->command_pool.fence_generations[fence_ref->fence_idx]) {
+        vkWaitForFences(engine->vk_device, 1, &fence_ref->vk_fence, VK_TRUE, UINT64_MAX);
+    }
+
+    release_resources(plan);
+
+    memset(plan, 0, sizeof(transfer_plan));
+}
+
+b8 transfer_plan_is_valid(const transfer_plan* plan) {
+    assert(plan);
+
+    return atomic_load(&plan->valid);
+}
+
+b8 transfer_plan_submit(transfer_plan* plan, u64 deadline_frame, transfer_handle handle) {
+    assert(plan);
+
+    transfer_engine* engine = plan->engine;
+
+    if (!atomic_load(&plan->valid)) {
+        return false;
+    }
+
+    transfer_handle_pool_reset_handle(&engine->handle_pool, handle);
+
+    // keeps transfer_plan_destroy waiting until the worker is done with the command buffer
+    atomic_fetch_add(&plan->queued_count, 1);
+
+    transfer_request request = {
+        .handle         = handle,
+        .type           = TRANSFER_TYPE_PLAN,
+        .flags          = TRANSFER_REQUEST_FLAG_NONE,
+        .deadline_frame = transfer_scheduler_deadline_key(deadline_frame),
+        .size           = plan->size,
+        .plan           = plan,
+    };
+
+    if (!transfer_engine_enqueue_request(engine, &request)) {
+        atomic_fetch_sub(&plan->queued_count, 1);
+        return false;
+    }
+
+    return true;
+}
+
+void transfer_plan_record_submission(transfer_plan* plan, const transfer_submission* submission) {
+    assert(plan);
+
+    if (submission) {
+        plan->fence_ref.vk_fence         = submission->fence;
+        plan->fence_ref.fence_generation = submission->fence_generation;
+        plan->fence_ref.fence_idx        = (u32)submission->cmd_idx;
+    }
+
+    // publishes fence_ref to transfer_plan_destroy
+    atomic_fetch_sub(&plan->queued_count, 1);
+}
@@ -0,0 +1,136 @@
+#include "transfer_request.h"
+#include "format_convert.h"
+#include "transfer_scheduler.h"
+
+void transfer_build_buffer_to_buffer_request(const buffer_to_buffer_request* buffer_transfer, transfer_request* request) {
+    assert(buffer_transfer);
+    assert(request);
+    assert(buffer_transfer->size > 0 || buffer_transfer->region_count > 0);
+
+    *request = (transfer_request){
+        .handle          = buffer_transfer->handle,
+        .src             = buffer_transfer->src,
+        .dst             = buffer_transfer->dst,
+        .type            = TRANSFER_TYPE_BUFFER_TO_BUFFER,
+        .flags           = TRANSFER_REQUEST_FLAG_NONE,
+        .dst_access_mask = buffer_transfer->dst_access_mask,
+        .dst_stage_mask  = buffer_transfer->dst_stage_mask,
+        .deadline_frame  = transfer_scheduler_deadline_key(buffer_transfer->deadline_frame),
+        .size            = buffer_transfer->size,
+        .regions         = buffer_transfer->regions,
+        .region_count    = buffer_transfer->region_count,
+    };
+
+    if (buffer_transfer->region_count > 0) {
+        request->size = 0;
+        for (u32 i = 0; i < buffer_transfer->region_count; ++i) {
+            request->size += buffer_transfer->regions[i].size;
+        }
+    }
+}
+
+void transfer_build_host_to_buffer_request(const host_to_buffer_request* host_transfer, transfer_request* request) {
+    assert(host_transfer);
+    assert(request);
+
+    *request = (transfer_request){
+        .handle          = host_transfer->handle,
+        .src.host        = host_transfer->src,
+        .dst.buffer      = host_transfer->dst,
+        .type            = TRANSFER_TYPE_HOST_TO_BUFFER,
+        .flags           = TRANSFER_REQUEST_FLAG_NONE,
+        .dst_access_mask = host_transfer->dst_access_mask,
+        .dst_stage_mask  = host_transfer->dst_stage_mask,
+        .deadline_frame  = transfer_scheduler_deadline_key(host_transfer->deadline_frame),
+        .dst_offset      = host_transfer->dst_offset,
+        .size            = format_convert_dst_size(&host_transfer->conversion, host_transfer->size),
+        .conversion      = host_transfer->conversion,
+    };
+}
+
+void transfer_build_compressed_to_buffer_request(const compressed_to_buffer_request* compressed_transfer, transfer_request* request) {
+    assert(compressed_transfer);
+    assert(request);
+
+    VkDeviceSize decompressed_size = 0;
+    for (u32 i = 0; i < compressed_transfer->block_count; ++i) {
+        decompressed_size += compressed_transfer->blocks[i].decompressed_size;
+    }
+
+    *request = (transfer_request){
+        .handle         = compressed_transfer->handle,
+        .src.compressed = {.blocks      = compressed_transfer->blocks,
+                           .block_count = compressed_transfer->block_count,
+                           .compression = compressed_transfer->compression},
+        .dst.buffer      = compressed_transfer->dst,
+        .type            = TRANSFER_TYPE_COMPRESSED_TO_BUFFER,
+        .flags           = TRANSFER_REQUEST_FLAG_NONE,
+        .dst_access_mask = compressed_transfer->dst_access_mask,
+        .dst_stage_mask  = compressed_transfer->dst_stage_mask,
+        .deadline_frame  = transfer_scheduler_deadline_key(compressed_transfer->deadline_frame),
+        .dst_offset      = compressed_transfer->dst_offset,
+        .size            = decompressed_size,
+    };
+}
+
+void transfer_build_file_to_buffer_request(const file_to_buffer_request* file_transfer, transfer_request* request) {
+    assert(file_transfer);
+    assert(request);
+
+    *request = (transfer_request){
+        .handle          = file_transfer->handle,
+        .src.file        = {.fd = file_transfer->fd, .offset = file_transfer->file_offset},
+        .dst.buffer      = file_transfer->dst,
+        .type            = TRANSFER_TYPE_FILE_TO_BUFFER,
+        .flags           = TRANSFER_REQUEST_FLAG_NONE,
+        .dst_access_mask = file_transfer->dst_access_mask,
+        .dst_stage_mask  = file_transfer->dst_stage_mask,
+        .deadline_frame  = transfer_scheduler_deadline_key(file_transfer->deadline_frame),
+        .dst_offset      = file_transfer->dst_offset,
+        .size            = file_transfer->size,
+    };
+}
+
+void transfer_build_host_to_image_request(const host_to_image_request* image_transfer, transfer_request* request) {
+    assert(image_transfer);
+    assert(request);
+
+    *request = (transfer_request){
+        .handle          = image_transfer->handle,
+        .src.host        = image_transfer->src,
+        .dst.image       = image_transfer->dst,
+        .type            = TRANSFER_TYPE_HOST_TO_IMAGE,
+        .flags           = TRANSFER_REQUEST_FLAG_NONE,
+        .dst_access_mask = image_transfer->dst_access_mask,
+        .dst_stage_mask  = image_transfer->dst_stage_mask,
+        .deadline_frame  = transfer_scheduler_deadline_key(image_transfer->deadline_frame),
+        .size            = image_transfer->size,
+        .image           = {.subresource  = image_transfer->subresource,
+                            .offset       = image_transfer->offset,
+                            .extent       = image_transfer->extent,
+                            .row_length   = image_transfer->row_length,
+                            .image_height = image_transfer->image_height,
+                            .old_layout   = image_transfer->old_layout,
+                            .new_layout   = image_transfer->new_layout,
+                            .usage        = image_transfer->usage},
+    };
+}
+
+void transfer_build_heap_upload_request(const heap_upload_request* upload, const transfer_allocation* allocation,
+                                        host_to_buffer_request* host_transfer) {
+    assert(upload);
+    assert(allocation);
+    assert(host_transfer);
+
+    *host_transfer = (host_to_buffer_request){
+        .src             = upload->src,
+        .dst             = allocation->buffer,
+        .dst_offset      = allocation->offset,
+        .size            = upload->size,
+        .conversion      = upload->conversion,
+        .dst_access_mask = upload->dst_access_mask,
+        .dst_stage_mask  = upload->dst_stage_mask,
+        .deadline_frame  = upload->deadline_frame,
+        .handle          = upload->handle,
+    };
+}
@@ -0,0 +1,306 @@
+#include "transfer_scheduler.h"
+
+#include <time.h>
+
+#define NS_PER_MS 1000000ull
+
+static u64 monotonic_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static b8 scheduled_before(const scheduled_request* a, const scheduled_request* b) {
+    if (a->request.deadline_frame != b->request.deadline_frame) {
+        return a->request.deadline_frame < b->request.deadline_frame;
+    }
+
+    return a->sequence < b->sequence;
+}
+
+static scheduled_request* heap_at(transfer_scheduler* scheduler, u32 idx) {
+    return d_array_at(&scheduler->heap, idx);
+}
+
+static void heap_swap(transfer_scheduler* scheduler, u32 a, u32 b) {
+    scheduled_request temp = *heap_at(scheduler, a);
+    *heap_at(scheduler, a) = *heap_at(scheduler, b);
+    *heap_at(scheduler, b) = temp;
+}
+
+static void sift_up(transfer_scheduler* scheduler, u32 idx) {
+    while (idx > 0) {
+        u32 parent = (idx - 1) / 2;
+
+        if (!scheduled_before(heap_at(scheduler, idx), heap_at(scheduler, parent))) {
+            break;
+        }
+
+        heap_swap(scheduler, idx, parent);
+        idx = parent;
+    }
+}
+
+static void sift_down(transfer_scheduler* scheduler, u32 idx) {
+    u32 count = scheduler->heap.count;
+
+    while (1) {
+        u32 first    = idx;
+        u32 children = idx * 2 + 1;
+
+        for (u32 child = children; child < children + 2 && child < count; ++child) {
+            if (scheduled_before(heap_at(scheduler, child), heap_at(scheduler, first))) {
+                first = child;
+            }
+        }
+
+        if (first == idx) {
+            return;
+        }
+
+        heap_swap(scheduler, idx, first);
+        idx = first;
+    }
+}
+
+static void remove_head(transfer_scheduler* scheduler, transfer_request* request) {
+    const scheduled_request* head = heap_at(scheduler, 0);
+
+    if (head->request.deadline_frame > scheduler->passed_deadline_frame ||
+        (head->request.deadline_frame == scheduler->passed_deadline_frame && head->sequence > scheduler->passed_sequence)) {
+        scheduler->passed_deadline_frame = head->request.deadline_frame;
+        scheduler->passed_sequence       = head->sequence;
+    }
+
+    *request = head->request;
+
+    scheduled_request last;
+    d_array_pop_back(&scheduler->heap, &last);
+
+    if (scheduler->heap.count > 0) {
+        *heap_at(scheduler, 0) = last;
+        sift_down(scheduler, 0);
+    }
+}
+
+static i64 rate_capacity(u64 bytes_per_ms) {
+    return (i64)(bytes_per_ms * SCHEDULER_MAX_BURST_MS);
+}
+
+// catches the worker's view up with frame ticks, budget changes and elapsed time
+static void refresh_budget(transfer_scheduler* scheduler) {
+    u64 current_frame = atomic_load(&scheduler->current_frame);
+    if (current_frame != scheduler->frame_index) {
+        scheduler->frame_index = current_frame;
+        scheduler->frame_spent = 0;
+    }
+
+    u64 bytes_per_ms = atomic_load(&scheduler->bytes_per_ms);
+    u64 now          = monotonic_time_ns();
+
+    u64 budget_generation = atomic_load(&scheduler->budget_generation);
+    if (budget_generation != scheduler->seen_budget_generation) {
+        // a new rate starts with a full bucket
+        scheduler->seen_budget_generation = budget_generation;
+        scheduler->rate_tokens            = rate_capacity(bytes_per_ms);
+        scheduler->rate_refill_time_ns    = now;
+        return;
+    }
+
+    if (bytes_per_ms == 0) {
+        return;
+    }
+
+    i64 capacity = rate_capacity(bytes_per_ms);
+    u64 elapsed  = now - scheduler->rate_refill_time_ns;
+
+    // long idle periods would overflow the product, they refill the bucket anyway
+    if (elapsed >= SCHEDULER_MAX_BURST_MS * NS_PER_MS) {
+        scheduler->rate_tokens = capacity;
+    } else {
+        scheduler->rate_tokens += (i64)(elapsed * bytes_per_ms / NS_PER_MS);
+        if (scheduler->rate_tokens > capacity) {
+            scheduler->rate_tokens = capacity;
+        }
+    }
+
+    scheduler->rate_refill_time_ns = now;
+}
+
+b8 transfer_scheduler_create(transfer_scheduler* scheduler) {
+    assert(scheduler);
+
+    memset(scheduler, 0, sizeof(transfer_scheduler));
+
+    return d_array_create(&scheduler->heap, sizeof(scheduled_request), SCHEDULER_INITIAL_CAPACITY);
+}
+
+void transfer_scheduler_destroy(transfer_scheduler* scheduler) {
+    assert(scheduler);
+
+    d_array_destroy(&scheduler->heap);
+
+    memset(scheduler, 0, sizeof(transfer_scheduler));
+}
+
+u64 transfer_scheduler_deadline_key(u64 deadline_frame) {
+    return deadline_frame == 0 ? TRANSFER_DEADLINE_NONE : deadline_frame;
+}
+
+b8 transfer_scheduler_push(transfer_scheduler* scheduler, const transfer_request* request) {
+    assert(scheduler);
+    assert(request);
+
+    scheduled_request scheduled = {
+        .sequence = scheduler->next_sequence++,
+        .request  = *request,
+    };
+
+    if (!d_array_push_back(&scheduler->heap, &scheduled)) {
+        return false;
+    }
+
+    sift_up(scheduler, scheduler->heap.count - 1);
+
+    return true;
+}
+
+u32 transfer_scheduler_count(const transfer_scheduler* scheduler) {
+    assert(scheduler);
+
+    return scheduler->heap.count;
+}
+
+u64 transfer_scheduler_next_sequence(const transfer_scheduler* scheduler) {
+    assert(scheduler);
+
+    return scheduler->next_sequence;
+}
+
+b8 transfer_scheduler_has_passed(const transfer_scheduler* scheduler, u64 deadline_frame, u64 sequence) {
+    assert(scheduler);
+
+    // the heap always hands out its lowest key, so a higher one can only have left after this one did
+    if (scheduler->passed_deadline_frame != deadline_frame) {
+        return scheduler->passed_deadline_frame > deadline_frame;
+    }
+
+    return scheduler->passed_sequence >= sequence;
+}
+
+transfer_scheduler_pop_result transfer_scheduler_pop(transfer_scheduler* scheduler, transfer_request* request, u64* wait_ns) {
+    assert(scheduler);
+    assert(request);
+    assert(wait_ns);
+
+    *wait_ns = 0;
+
+    if (scheduler->heap.count == 0) {
+        scheduler->stalled = false;
+        return TRANSFER_SCHEDULER_POP_EMPTY;
+    }
+
+    refresh_budget(scheduler);
+
+    const transfer_request* next = &heap_at(scheduler, 0)->request;
+
+    u64 cost = next->size;
+
+    // the first request of a frame always goes, otherwise one bigger than the whole budget would never start
+    u64  bytes_per_frame = atomic_load(&scheduler->bytes_per_frame);
+    b8   over_budget     = bytes_per_frame > 0 && scheduler->frame_spent > 0 && scheduler->frame_spent + cost > bytes_per_frame;
+    u64  bytes_per_ms    = atomic_load(&scheduler->bytes_per_ms);
+    i64  capacity        = rate_capacity(bytes_per_ms);
+
+    if (!over_budget && bytes_per_ms > 0) {
+        // a request bigger than the bucket waits for a full bucket and then drives it negative
+        i64 needed = (i64)cost < capacity ? (i64)cost : capacity;
+
+        if (scheduler->rate_tokens < needed) {
+            over_budget = true;
+            *wait_ns    = (u64)(needed - scheduler->rate_tokens) * NS_PER_MS / bytes_per_ms + 1;
+        }
+    }
+
+    if (over_budget) {
+        if (!scheduler->stalled) {
+            scheduler->stalled = true;
+            atomic_fetch_add_explicit(&scheduler->budget_stall_count, 1, memory_order_relaxed);
+        }
+
+        return TRANSFER_SCHEDULER_POP_OVER_BUDGET;
+    }
+
+    scheduler->stalled = false;
+
+    remove_head(scheduler, request);
+
+    scheduler->frame_spent += cost;
+    scheduler->rate_tokens -= (i64)cost;
+
+    atomic_fetch_add_explicit(&scheduler->dispatched_count, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&scheduler->dispatched_bytes, cost, memory_order_relaxed);
+
+    if (request->deadline_frame != TRANSFER_DEADLINE_NONE) {
+        atomic_fetch_add_explicit(&scheduler->deadline_count, 1, memory_order_relaxed);
+
+        if (scheduler->frame_index >= request->deadline_frame) {
+            atomic_fetch_add_explicit(&scheduler->deadline_miss_count, 1, memory_order_relaxed);
+        }
+    }
+
+    return TRANSFER_SCHEDULER_POP_READY;
+}
+
+const transfer_request* transfer_scheduler_peek(transfer_scheduler* scheduler) {
+    assert(scheduler);
+
+    return scheduler->heap.count > 0 ? &heap_at(scheduler, 0)->request : NULL;
+}
+
+b8 transfer_scheduler_discard(transfer_scheduler* scheduler, transfer_request* request) {
+    assert(scheduler);
+    assert(request);
+
+    if (scheduler->heap.count == 0) {
+        return false;
+    }
+
+    remove_head(scheduler, request);
+
+    return true;
+}
+
+b8 transfer_scheduler_budget_changed(transfer_scheduler* scheduler) {
+    assert(scheduler);
+
+    return atomic_load(&scheduler->current_frame) != scheduler->frame_index ||
+           atomic_load(&scheduler->budget_generation) != scheduler->seen_budget_generation;
+}
+
+void transfer_scheduler_frame_tick(transfer_scheduler* scheduler) {
+    assert(scheduler);
+
+    atomic_fetch_add(&scheduler->current_frame, 1);
+}
+
+void transfer_scheduler_set_budget(transfer_scheduler* scheduler, const transfer_budget* budget) {
+    assert(scheduler);
+    assert(budget);
+
+    atomic_store(&scheduler->bytes_per_frame, budget->bytes_per_frame);
+    atomic_store(&scheduler->bytes_per_ms, budget->bytes_per_ms);
+    atomic_fetch_add(&scheduler->budget_generation, 1);
+}
+
+void transfer_scheduler_get_stats(transfer_scheduler* scheduler, transfer_scheduler_stats* stats) {
+    assert(scheduler);
+    assert(stats);
+
+    stats->frame_index         = atomic_load(&scheduler->current_frame);
+    stats->dispatched_count    = atomic_load_explicit(&scheduler->dispatched_count, memory_order_relaxed);
+    stats->dispatched_bytes    = atomic_load_explicit(&scheduler->dispatched_bytes, memory_order_relaxed);
+    stats->deadline_count      = atomic_load_explicit(&scheduler->deadline_count, memory_order_relaxed);
+    stats->deadline_miss_count = atomic_load_explicit(&scheduler->deadline_miss_count, memory_order_relaxed);
+    stats->budget_stall_count  = atomic_load_explicit(&scheduler->budget_stall_count, memory_order_relaxed);
+}
@@ -0,0 +1,602 @@
+#include "transfer_staged.h"
+#include "decompress.h"
+#include "format_convert.h"
+#include "staging_buffer.h"
+#include "transfer_handle_pool.h"
+#include "transfer_scheduler.h"
+#include "transfer_submission.h"
+#include "upload_dedup_cache.h"
+
+#include <errno.h>
+
+// pieces being filled ahead of the one being copied
+#define STAGED_PIPELINE_DEPTH 2
+// batched regions start on this boundary inside the chunk so the conversion kernels see aligned destinations
+#define STAGED_BATCH_REGION_ALIGNMENT 16ull
+
+typedef struct decompress_task {
+    const transfer_compressed_block* block;
+    transfer_compression             compression;
+    u8*                              dst;
+    atomic_bool                      done;
+    b8                               succeeded;
+} decompress_task;
+
+typedef struct staged_piece {
+    u32          chunk_idx;
+    VkDeviceSize stream_offset;
+    VkDeviceSize size;
+    b8           filled;
+    i64          fill_result;
+
+    // TRANSFER_TYPE_COMPRESSED_TO_BUFFER: blocks [first_block, first_block + block_count) land in this piece
+    u32      first_block;
+    u32      block_count;
+    d_array* tasks;
+} staged_piece;
+
+// how far the request's source has been split into pieces
+typedef struct staged_cursor {
+    VkDeviceSize stream_offset;
+    u32          block_idx;
+} staged_cursor;
+
+static void run_decompress_task(void* user_data) {
+    decompress_task* decompress = user_data;
+
+    i64 written = decompress_block(decompress->compression, decompress->block->src, decompress->block->compressed_size, decompress->dst,
+                                   decompress->block->decompressed_size);
+
+    decompress->succeeded = written == (i64)decompress->block->decompressed_size;
+    atomic_store(&decompress->done, true);
+}
+
+static transfer_internal_error fill_error(const transfer_request* request) {
+    switch (request->type) {
+    case TRANSFER_TYPE_FILE_TO_BUFFER:
+        return TRANSFER_INTERNAL_ERROR_FILE_READ_FAILED;
+    case TRANSFER_TYPE_COMPRESSED_TO_BUFFER:
+        return TRANSFER_INTERNAL_ERROR_DECOMPRESSION_FAILED;
+    default:
+        return TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY;
+    }
+}
+
+static b8 cursor_done(const transfer_request* request, const staged_cursor* cursor) {
+    if (request->type == TRANSFER_TYPE_COMPRESSED_TO_BUFFER) {
+        return cursor->block_idx == request->src.compressed.block_count;
+    }
+
+    return cursor->stream_offset == request->size;
+}
+
+static b8 plan_piece(transfer_engine* engine, const transfer_request* request, staged_cursor* cursor, staged_piece* piece) {
+    VkDeviceSize chunk_size = engine->staging.chunk_size;
+
+    piece->stream_offset = cursor->stream_offset;
+    piece->filled        = false;
+    piece->fill_result   = 0;
+
+    if (request->type == TRANSFER_TYPE_COMPRESSED_TO_BUFFER) {
+        const transfer_compressed_location* compressed = &request->src.compressed;
+
+        // pack whole blocks until the chunk is full, a block never straddles two chunks
+        piece->first_block = cursor->block_idx;
+        piece->block_count = 0;
+        piece->size        = 0;
+
+        while (cursor->block_idx < compressed->block_count) {
+            VkDeviceSize block_size = compressed->blocks[cursor->block_idx].decompressed_size;
+
+            if (piece->size + block_size > chunk_size) {
+                break;
+            }
+
+            piece->size += block_size;
+            piece->block_count++;
+            cursor->block_idx++;
+        }
+
+        if (piece->block_count == 0) {
+            // the next block alone is bigger than a chunk
+            return false;
+        }
+    } else {
+        if (request->type == TRANSFER_TYPE_HOST_TO_BUFFER) {
+            // converted pieces must end on an element boundary so each one maps back to whole source elements
+            chunk_size -= chunk_size % format_convert_dst_element_size(&request->conversion);
+        }
+
+        VkDeviceSize remaining = request->size - cursor->stream_offset;
+        piece->size            = remaining < chunk_size ? remaining : chunk_size;
+    }
+
+    cursor->stream_offset += piece->size;
+
+    return true;
+}
+
+static b8 begin_fill(transfer_engine* engine, const transfer_request* request, staged_piece* piece) {
+    u8* dst = staging_buffer_chunk_memory(&engine->staging, piece->chunk_idx);
+
+    switch (request->type) {
+    case TRANSFER_TYPE_FILE_TO_BUFFER: {
+        u64 file_offset = request->src.file.offset + piece->stream_offset;
+        return file_reader_submit(&engine->file_reader, request->src.file.fd, dst, (u32)piece->size, file_offset, piece->stream_offset);
+    }
+    case TRANSFER_TYPE_HOST_TO_BUFFER: {
+        // stream offsets count destination bytes, the conversion runs while writing staging so the source is read once
+        const transfer_conversion* conversion       = &request->conversion;
+        u32                        dst_element_size = format_convert_dst_element_size(conversion);
+        u64                        first_element    = piece->stream_offset / dst_element_size;
+        const u8*                  src = (const u8*)request->src.host + first_element * format_convert_src_element_size(conversion);
+
+        format_convert(conversion, src, dst, piece->size / dst_element_size);
+        piece->filled      = true;
+        piece->fill_result = (i64)piece->size;
+        return true;
+    }
+    case TRANSFER_TYPE_COMPRESSED_TO_BUFFER: {
+        if (!d_array_resize(piece->tasks, piece->block_count)) {
+            piece->block_count = 0;
+            return false;
+        }
+
+        // one task per block so a single large piece still spreads across every decompression thread
+        for (u32 i = 0; i < piece->block_count; ++i) {
+            const transfer_compressed_block* block = &request->src.compressed.blocks[piece->first_block + i];
+
+            decompress_task* decompress = d_array_at(piece->tasks, i);
+            decompress->block           = block;
+            decompress->compression     = request->src.compressed.compression;
+            decompress->dst             = dst;
+            decompress->succeeded       = false;
+            atomic_store(&decompress->done, false);
+
+            dst += block->decompressed_size;
+
+            if (!task_pool_push(&engine->decompression_pool, run_decompress_task, decompress)) {
+                // only the tasks already queued need waiting on
+                piece->block_count = i;
+                return false;
+            }
+        }
+
+        return true;
+    }
+    default:
+        assert(0 && "unhandled staged transfer type");
+        return false;
+    }
+}
+
+static b8 wait_fill(transfer_engine* engine, const transfer_request* request, staged_piece* pieces, u32 piece_idx) {
+    staged_piece* piece = &pieces[piece_idx % STAGED_PIPELINE_DEPTH];
+
+    switch (request->type) {
+    case TRANSFER_TYPE_FILE_TO_BUFFER: {
+        // completions can come back out of order, park them on the piece they belong to
+        while (!piece->filled) {
+            file_read_completion completion;
+            if (!file_reader_wait(&engine->file_reader, &completion)) {
+                return false;
+            }
+
+            for (u32 i = 0; i < STAGED_PIPELINE_DEPTH; ++i) {
+                if (pieces[i].stream_offset == completion.user_data && !pieces[i].filled) {
+                    pieces[i].filled      = true;
+                    pieces[i].fill_result = completion.result;
+                    break;
+                }
+            }
+        }
+
+        // some filesystems and file types reject io_uring reads that pread still serves, redo the whole piece below
+        if (piece->fill_result == -EINVAL || piece->fill_result == -EOPNOTSUPP) {
+            piece->fill_result = 0;
+        }
+
+        if (piece->fill_result < 0) {
+            return false;
+        }
+
+        // io_uring may return short reads, finish them synchronously
+        if ((u64)piece->fill_result < piece->size) {
+            u8* dst         = staging_buffer_chunk_memory(&engine->staging, piece->chunk_idx) + piece->fill_result;
+            u64 file_offset = request->src.file.offset + piece->stream_offset + piece->fill_result;
+            u64 remaining   = piece->size - piece->fill_result;
+
+            if (file_reader_read_all(request->src.file.fd, dst, remaining, file_offset) != (i64)remaining) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+    case TRANSFER_TYPE_HOST_TO_BUFFER:
+        // filled synchronously in begin_fill
+        return piece->filled;
+    case TRANSFER_TYPE_COMPRESSED_TO_BUFFER: {
+        b8 succeeded = true;
+
+        for (u32 i = 0; i < piece->block_count; ++i) {
+            decompress_task* decompress = d_array_at(piece->tasks, i);
+            task_pool_wait(&engine->decompression_pool, &decompress->done);
+            succeeded &= decompress->succeeded;
+        }
+
+        piece->filled = true;
+
+        return succeeded;
+    }
+    default:
+        assert(0 && "unhandled staged transfer type");
+        return false;
+    }
+}
+
+static void drain_fills(transfer_engine* engine, const transfer_request* request, staged_piece* pieces, u32 first_piece, u32 end_piece) {
+    // fills still target staging memory, so they must land before the chunks are reused
+    if (request->type == TRANSFER_TYPE_FILE_TO_BUFFER) {
+        file_read_completion completion;
+        while (engine->file_reader.in_flight > 0 && file_reader_wait(&engine->file_reader, &completion)) {
+        }
+        return;
+    }
+
+    for (u32 i = first_piece; i < end_piece; ++i) {
+        staged_piece* piece = &pieces[i % STAGED_PIPELINE_DEPTH];
+        if (!piece->filled) {
+            wait_fill(engine, request, pieces, i);
+        }
+    }
+}
+
+static void record_piece_copy(VkCommandBuffer cmd, transfer_engine* engine, const transfer_request* request, const staged_piece* piece) {
+    VkBufferCopy buffer_copy = {
+        .srcOffset = staging_buffer_chunk_offset(&engine->staging, piece->chunk_idx),
+        .dstOffset = request->dst_offset + piece->stream_offset,
+        .size      = piece->size,
+    };
+
+    vkCmdCopyBuffer(cmd, engine->staging.buffer, request->dst.buffer, 1, &buffer_copy);
+}
+
+void transfer_staged_execute(transfer_engine* engine, const transfer_request* request) {
+    assert(engine);
+    assert(request);
+
+    if (!atomic_load(&engine->staging_ready)) {
+        transfer_handle_pool_set_handle_error_internal(&engine->handle_pool, request->handle, TRANSFER_INTERNAL_ERROR_STAGING_UNAVAILABLE);
+        return;
+    }
+
+    if (request->type == TRANSFER_TYPE_COMPRESSED_TO_BUFFER &&
+        (!atomic_load(&engine->decompression_ready) || !decompress_codec_available(request->src.compressed.compression))) {
+        transfer_handle_pool_set_handle_error_internal(&engine->handle_pool, request->handle,
+                                                       TRANSFER_INTERNAL_ERROR_DECOMPRESSION_UNAVAILABLE);
+        return;
+    }
+
+    staging_buffer* staging = &engine->staging;
+    staged_cursor   cursor  = {.stream_offset = 0, .block_idx = 0};
+
+    if (cursor_done(request, &cursor)) {
+        transfer_handle_pool_insert_status_barrier(&engine->handle_pool, request->handle, TRANSFER_STATUS_COMPLETE);
+        return;
+    }
+
+    d_array      piece_tasks[STAGED_PIPELINE_DEPTH];
+    staged_piece pieces[STAGED_PIPELINE_DEPTH];
+    for (u32 i = 0; i < STAGED_PIPELINE_DEPTH; ++i) {
+        // idle slots must never match a completion
+        pieces[i].filled      = true;
+        pieces[i].block_count = 0;
+        pieces[i].tasks       = &piece_tasks[i];
+        if (!d_array_create(&piece_tasks[i], sizeof(decompress_task), request->type == TRANSFER_TYPE_COMPRESSED_TO_BUFFER ? 16 : 1)) {
+            for (u32 j = 0; j < i; ++j) {
+                d_array_destroy(&piece_tasks[j]);
+            }
+            transfer_handle_pool_set_handle_error_internal(&engine->handle_pool, request->handle, TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY);
+            return;
+        }
+    }
+
+    u32                     begun_count     = 0;
+    u32                     submitted_count = 0;
+    transfer_submission     submission;
+    VkResult                vk_res         = VK_SUCCESS;
+    transfer_internal_error internal_error = TRANSFER_INTERNAL_ERROR_NONE;
+
+    while (1) {
+        // keep the pipeline full: fills for the next pieces are in flight while this one is copied
+        while (begun_count < submitted_count + STAGED_PIPELINE_DEPTH && !cursor_done(request, &cursor)) {
+            staged_piece* piece = &pieces[begun_count % STAGED_PIPELINE_DEPTH];
+
+            if (!plan_piece(engine, request, &cursor, piece)) {
+                internal_error = TRANSFER_INTERNAL_ERROR_BLOCK_TOO_LARGE;
+                break;
+            }
+
+            vk_res = staging_buffer_acquire_chunk(staging, engine->vk_device, &engine->command_pool, &piece->chunk_idx);
+            if (vk_res != VK_SUCCESS) {
+                piece->filled = true;
+                break;
+            }
+
+            begun_count++;
+
+            if (!begin_fill(engine, request, piece)) {
+                internal_error = fill_error(request);
+                break;
+            }
+        }
+
+        if (vk_res != VK_SUCCESS || internal_error != TRANSFER_INTERNAL_ERROR_NONE || submitted_count == begun_count) {
+            break;
+        }
+
+        staged_piece* piece = &pieces[submitted_count % STAGED_PIPELINE_DEPTH];
+
+        if (!wait_fill(engine, request, pieces, submitted_count)) {
+            internal_error = fill_error(request);
+            break;
+        }
+
+        b8 last_piece = submitted_count + 1 == begun_count && cursor_done(request, &cursor);
+
+        vk_res = staging_buffer_flush_chunk(staging, engine->vk_device, piece->chunk_idx, piece->size);
+
+        // the last piece waits on the earlier ones so its fence alone tells the handle the whole range is resident
+        b8 ordered = (submitted_count == 0 && (request->flags & TRANSFER_REQUEST_FLAG_ORDERED)) || (last_piece && submitted_count > 0);
+
+        if (vk_res == VK_SUCCESS) {
+            vk_res = transfer_submission_begin(engine, ordered, &submission);
+        }
+
+        if (vk_res != VK_SUCCESS) {
+            break;
+        }
+
+        record_piece_copy(submission.cmd, engine, request, piece);
+
+        if (last_piece) {
+            transfer_record_dst_buffer_barrier(submission.cmd, request, request->dst.buffer, request->dst_offset, cursor.stream_offset);
+        }
+
+        vk_res = transfer_submission_submit(engine, &submission);
+
+        if (vk_res != VK_SUCCESS) {
+            break;
+        }
+
+        staging_buffer_retire_chunk(staging, piece->chunk_idx, &submission);
+        submitted_count++;
+    }
+
+    if (vk_res != VK_SUCCESS || internal_error != TRANSFER_INTERNAL_ERROR_NONE) {
+        drain_fills(engine, request, pieces, submitted_count, begun_count);
+
+        if (vk_res != VK_SUCCESS) {
+            transfer_handle_pool_set_handle_error_vulkan(&engine->handle_pool, request->handle, vk_res);
+        } else {
+            transfer_handle_pool_set_handle_error_internal(&engine->handle_pool, request->handle, internal_error);
+        }
+    } else {
+        transfer_submission_track_request(engine, &submission, request);
+    }
+
+    for (u32 i = 0; i < STAGED_PIPELINE_DEPTH; ++i) {
+        d_array_destroy(&piece_tasks[i]);
+    }
+}
+
+static VkDeviceSize align_batch_offset(VkDeviceSize offset) {
+    return (offset + STAGED_BATCH_REGION_ALIGNMENT - 1) & ~(STAGED_BATCH_REGION_ALIGNMENT - 1);
+}
+
+static b8 ranges_overlap(VkDeviceSize a_offset, VkDeviceSize a_size, VkDeviceSize b_offset, VkDeviceSize b_size) {
+    return a_offset < b_offset + b_size && b_offset < a_offset + a_size;
+}
+
+// regions of one vkCmdCopyBuffer must not overlap in dst, and a request touching an earlier one's range has to wait
+// for it anyway
+static b8 can_join_batch(const transfer_request* batch, u32 batch_count, VkDeviceSize chunk_used, VkDeviceSize chunk_size,
+                         const transfer_request* candidate) {
+    if (batch_count == UPLOAD_BATCH_MAX_REGIONS || candidate->type != TRANSFER_TYPE_HOST_TO_BUFFER ||
+        candidate->dst.buffer != batch[0].dst.buffer || (candidate->flags & TRANSFER_REQUEST_FLAG_ORDERED) || candidate->size == 0) {
+        return false;
+    }
+
+    if (align_batch_offset(chunk_used) + candidate->size > chunk_size) {
+        return false;
+    }
+
+    for (u32 i = 0; i < batch_count; ++i) {
+        if (ranges_overlap(batch[i].dst_offset, batch[i].size, candidate->dst_offset, candidate->size)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// 0 masks fall back to the safest barrier, so any request asking for it makes the whole batch use it
+static void merge_dst_masks(transfer_request* merged, const transfer_request* request) {
+    merged->dst_access_mask = merged->dst_access_mask && request->dst_access_mask ? merged->dst_access_mask | request->dst_access_mask : 0;
+    merged->dst_stage_mask  = merged->dst_stage_mask && request->dst_stage_mask ? merged->dst_stage_mask | request->dst_stage_mask : 0;
+}
+
+b8 transfer_staged_execute_batch(transfer_engine* engine, const transfer_request* request) {
+    assert(engine);
+    assert(request);
+
+    if (!atomic_load(&engine->staging_ready) || request->type != TRANSFER_TYPE_HOST_TO_BUFFER || request->size == 0 ||
+        request->size > engine->staging.chunk_size) {
+        return false;
+    }
+
+    staging_buffer*  staging = &engine->staging;
+    transfer_request batch[UPLOAD_BATCH_MAX_REGIONS];
+    VkBufferCopy     regions[UPLOAD_BATCH_MAX_REGIONS];
+
+    batch[0]   = *request;
+    regions[0] = (VkBufferCopy){.srcOffset = 0, .dstOffset = request->dst_offset, .size = request->size};
+
+    u32          batch_count = 1;
+    VkDeviceSize chunk_used  = request->size;
+
+    // followers go through the scheduler's pop, so deadlines and the budget still decide what joins
+    while (1) {
+        transfer_submission_discard_dead_requests(engine);
+
+        const transfer_request* next = transfer_scheduler_peek(&engine->scheduler);
+        if (!next || !can_join_batch(batch, batch_count, chunk_used, staging->chunk_size, next)) {
+            break;
+        }
+
+        u64 wait_ns;
+        if (transfer_scheduler_pop(&engine->scheduler, &batch[batch_count], &wait_ns) != TRANSFER_SCHEDULER_POP_READY) {
+            break;
+        }
+
+        if (!transfer_submission_claim_request(engine, &batch[batch_count])) {
+            continue;
+        }
+
+        VkDeviceSize region_offset = align_batch_offset(chunk_used);
+
+        regions[batch_count] = (VkBufferCopy){
+            .srcOffset = region_offset,
+            .dstOffset = batch[batch_count].dst_offset,
+            .size      = batch[batch_count].size,
+        };
+
+        chunk_used = region_offset + batch[batch_count].size;
+        batch_count++;
+    }
+
+    u32                 chunk_idx;
+    transfer_submission submission;
+    VkResult            vk_res = staging_buffer_acquire_chunk(staging, engine->vk_device, &engine->command_pool, &chunk_idx);
+
+    if (vk_res == VK_SUCCESS) {
+        u8*          memory       = staging_buffer_chunk_memory(staging, chunk_idx);
+        VkDeviceSize chunk_offset = staging_buffer_chunk_offset(staging, chunk_idx);
+
+        for (u32 i = 0; i < batch_count; ++i) {
+            const transfer_conversion* conversion = &batch[i].conversion;
+
+            format_convert(conversion, batch[i].src.host, memory + regions[i].srcOffset,
+                           batch[i].size / format_convert_dst_element_size(conversion));
+            regions[i].srcOffset += chunk_offset;
+        }
+
+        vk_res = staging_buffer_flush_chunk(staging, engine->vk_device, chunk_idx, chunk_used);
+    }
+
+    if (vk_res == VK_SUCCESS) {
+        vk_res = transfer_submission_begin(engine, request->flags & TRANSFER_REQUEST_FLAG_ORDERED, &submission);
+    }
+
+    if (vk_res == VK_SUCCESS) {
+        vkCmdCopyBuffer(submission.cmd, staging->buffer, request->dst.buffer, batch_count, regions);
+
+        // one barrier over the span covering every region
+        transfer_request merged    = batch[0];
+        VkDeviceSize     span_low  = regions[0].dstOffset;
+        VkDeviceSize     span_high = regions[0].dstOffset + regions[0].size;
+
+        for (u32 i = 1; i < batch_count; ++i) {
+            merge_dst_masks(&merged, &batch[i]);
+            span_low  = regions[i].dstOffset < span_low ? regions[i].dstOffset : span_low;
+            span_high = regions[i].dstOffset + regions[i].size > span_high ? regions[i].dstOffset + regions[i].size : span_high;
+        }
+
+        transfer_record_dst_buffer_barrier(submission.cmd, &merged, request->dst.buffer, span_low, span_high - span_low);
+
+        vk_res = transfer_submission_submit(engine, &submission);
+    }
+
+    if (vk_res == VK_SUCCESS) {
+        staging_buffer_retire_chunk(staging, chunk_idx, &submission);
+    }
+
+    for (u32 i = 0; i < batch_count; ++i) {
+        if (vk_res == VK_SUCCESS) {
+            transfer_submission_track_request(engine, &submission, &batch[i]);
+        } else {
+            transfer_handle_pool_set_handle_error_vulkan(&engine->handle_pool, batch[i].handle, vk_res);
+        }
+
+        if (i > 0 && atomic_load(&engine->upload_dedup_ready)) {
+            upload_dedup_cache_finish_request(&engine->upload_dedup, &batch[i]);
+        }
+    }
+
+    return true;
+}
+
+b8 transfer_staged_execute_image(transfer_engine* engine, const transfer_request* request, transfer_submission* submission) {
+    assert(engine);
+    assert(request);
+    assert(submission);
+    assert(request->type == TRANSFER_TYPE_HOST_TO_IMAGE);
+
+    if (!atomic_load(&engine->staging_ready)) {
+        transfer_handle_pool_set_handle_error_internal(&engine->handle_pool, request->handle, TRANSFER_INTERNAL_ERROR_STAGING_UNAVAILABLE);
+        return false;
+    }
+
+    staging_buffer* staging = &engine->staging;
+
+    // splitting a region into rows would need the format's texel block size, which the request doesn't carry
+    if (request->size > staging->chunk_size) {
+        transfer_handle_pool_set_handle_error_internal(&engine->handle_pool, request->handle, TRANSFER_INTERNAL_ERROR_IMAGE_TOO_LARGE);
+        return false;
+    }
+
+    u32      chunk_idx;
+    VkResult vk_res = staging_buffer_acquire_chunk(staging, engine->vk_device, &engine->command_pool, &chunk_idx);
+
+    if (vk_res == VK_SUCCESS) {
+        memcpy(staging_buffer_chunk_memory(staging, chunk_idx), request->src.host, request->size);
+
+        vk_res = staging_buffer_flush_chunk(staging, engine->vk_device, chunk_idx, request->size);
+    }
+
+    if (vk_res == VK_SUCCESS) {
+        vk_res = transfer_submission_begin(engine, request->flags & TRANSFER_REQUEST_FLAG_ORDERED, submission);
+    }
+
+    if (vk_res == VK_SUCCESS) {
+        const transfer_image_region* image = &request->image;
+
+        VkBufferImageCopy region = {
+            .bufferOffset      = staging_buffer_chunk_offset(staging, chunk_idx),
+            .bufferRowLength   = image->row_length,
+            .bufferImageHeight = image->image_height,
+            .imageSubresource  = image->subresource,
+            .imageOffset       = image->offset,
+            .imageExtent       = image->extent,
+        };
+
+        transfer_record_image_upload_barrier(submission->cmd, request);
+
+        vkCmdCopyBufferToImage(submission->cmd, staging->buffer, request->dst.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+        transfer_record_dst_image_barrier(submission->cmd, request);
+
+        vk_res = transfer_submission_submit(engine, submission);
+    }
+
+    if (vk_res != VK_SUCCESS) {
+        transfer_handle_pool_set_handle_error_vulkan(&engine->handle_pool, request->handle, vk_res);
+        return false;
+    }
+
+    staging_buffer_retire_chunk(staging, chunk_idx, submission);
+    transfer_submission_track_request(engine, submission, request);
+
+    return true;
+}
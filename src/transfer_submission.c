@@ -0,0 +1,298 @@
+#include "transfer_submission.h"
+#include "pending_write_table.h"
+#include "transfer_defrag.h"
+#include "transfer_handle_pool.h"
+#include "transfer_mirrored_buffer.h"
+#include "transfer_plan.h"
+#include "transfer_scheduler.h"
+#include "upload_dedup_cache.h"
+
+static VkResult get_available_command_buffer_idx(transfer_engine* engine, i32* cmd_idx) {
+    i32 i = 0;
+    while (1) {
+        VkResult vk_res = vkGetFenceStatus(engine->vk_device, engine->command_pool.fences[i]);
+        if (vk_res == VK_SUCCESS) {
+            atomic_fetch_add(&engine->command_pool.fence_generations[i], 1);
+            *cmd_idx = i;
+            return VK_SUCCESS;
+        }
+        if (vk_res == VK_NOT_READY) {
+            i = (i + 1) % CMD_BUF_COUNT;
+            continue;
+        }
+
+        return vk_res;
+    }
+}
+
+VkResult transfer_submission_begin(transfer_engine* engine, b8 ordered, transfer_submission* submission) {
+    assert(engine);
+    assert(submission);
+
+    VkResult vk_res = get_available_command_buffer_idx(engine, &submission->cmd_idx);
+
+    if (vk_res != VK_SUCCESS) {
+        return vk_res;
+    }
+
+    submission->fence            = engine->command_pool.fences[submission->cmd_idx];
+    submission->cmd              = engine->command_pool.buffers[submission->cmd_idx];
+    submission->fence_generation = engine->command_pool.fence_generations[submission->cmd_idx];
+
+    vk_res = vkResetFences(engine->vk_device, 1, &submission->fence);
+
+    if (vk_res != VK_SUCCESS) {
+        return vk_res;
+    }
+
+    VkCommandBufferBeginInfo cmd_buf_bi = {
+        .sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+        .pNext            = NULL,
+        .flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+        .pInheritanceInfo = NULL,
+    };
+
+    vk_res = vkBeginCommandBuffer(submission->cmd, &cmd_buf_bi);
+    if (vk_res != VK_SUCCESS) {
+        transfer_submission_abandon(engine, submission);
+        return vk_res;
+    }
+
+    if (ordered) {
+        transfer_record_ordering_barrier(submission->cmd);
+    }
+
+    return VK_SUCCESS;
+}
+
+VkResult transfer_submission_submit(transfer_engine* engine, transfer_submission* submission) {
+    assert(engine);
+    assert(submission);
+
+    VkResult vk_res = vkEndCommandBuffer(submission->cmd);
+
+    if (vk_res != VK_SUCCESS) {
+        transfer_submission_abandon(engine, submission);
+        return vk_res;
+    }
+
+    VkSubmitInfo submit_info = {
+        .sType                = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext                = NULL,
+        .waitSemaphoreCount   = 0,
+        .pWaitSemaphores      = NULL,
+        .pWaitDstStageMask    = NULL,
+        .commandBufferCount   = 1,
+        .pCommandBuffers      = &submission->cmd,
+        .signalSemaphoreCount = 0,
+        .pSignalSemaphores    = NULL,
+    };
+
+    vk_res = vkQueueSubmit(engine->vk_queue, 1, &submit_info, submission->fence);
+
+    if (vk_res != VK_SUCCESS) {
+        transfer_submission_abandon(engine, submission);
+    }
+
+    return vk_res;
+}
+
+void transfer_submission_abandon(transfer_engine* engine, transfer_submission* submission) {
+    assert(engine);
+    assert(submission);
+
+    // an empty submit still signals the fence
+    vkQueueSubmit(engine->vk_queue, 0, NULL, submission->fence);
+}
+
+void transfer_submission_track_request(transfer_engine* engine, const transfer_submission* submission, const transfer_request* request) {
+    assert(engine);
+    assert(submission);
+    assert(request);
+
+    transfer_handle_pool_set_handle_fence(&engine->handle_pool, request->handle, submission->fence, submission->fence_generation,
+                                          (u32)submission->cmd_idx);
+
+    transfer_handle_pool_insert_status_barrier(&engine->handle_pool, request->handle, TRANSFER_STATUS_EXECUTING);
+
+    if (atomic_load(&engine->upload_dedup_ready)) {
+        upload_dedup_cache_record_submission(&engine->upload_dedup, request, submission);
+    }
+}
+
+// hands back whatever the request was holding besides its handle
+static void release_request_state(transfer_engine* engine, const transfer_request* request) {
+    if (request->flags & TRANSFER_REQUEST_FLAG_DEFRAG) {
+        transfer_defrag_record_submission(&engine->defrag, NULL);
+    }
+
+    if (request->mirror) {
+        transfer_mirrored_buffer_record_submission(request->mirror, NULL);
+    }
+
+    if (request->plan) {
+        transfer_plan_record_submission(request->plan, NULL);
+    }
+
+    if (atomic_load(&engine->upload_dedup_ready)) {
+        upload_dedup_cache_finish_request(&engine->upload_dedup, request);
+    }
+}
+
+b8 transfer_submission_is_request_live(transfer_engine* engine, const transfer_request* request) {
+    assert(engine);
+    assert(request);
+
+    if (request->pending_write != PENDING_WRITE_NONE && !pending_write_table_is_queued(&engine->pending_writes, request->pending_write)) {
+        return false;
+    }
+
+    return transfer_handle_pool_is_pending(&engine->handle_pool, request->handle, request->handle_ticket);
+}
+
+b8 transfer_submission_claim_request(transfer_engine* engine, const transfer_request* request) {
+    assert(engine);
+    assert(request);
+
+    // the pending write goes first, once it's taken no later request can supersede this one
+    b8 claimed = true;
+    if (request->pending_write != PENDING_WRITE_NONE) {
+        claimed = pending_write_table_take(&engine->pending_writes, request->pending_write);
+    }
+
+    if (claimed) {
+        claimed = transfer_handle_pool_claim(&engine->handle_pool, request->handle, request->handle_ticket);
+    }
+
+    if (!claimed) {
+        release_request_state(engine, request);
+    }
+
+    return claimed;
+}
+
+void transfer_submission_discard_dead_requests(transfer_engine* engine) {
+    assert(engine);
+
+    const transfer_request* next;
+    while ((next = transfer_scheduler_peek(&engine->scheduler)) && !transfer_submission_is_request_live(engine, next)) {
+        transfer_request dead;
+        transfer_scheduler_discard(&engine->scheduler, &dead);
+
+        // a dead request never comes back to life, this only drops it
+        transfer_submission_claim_request(engine, &dead);
+    }
+}
+
+void transfer_submission_drop_request(transfer_engine* engine, const transfer_request* request) {
+    assert(engine);
+    assert(request);
+
+    if (request->pending_write != PENDING_WRITE_NONE) {
+        pending_write_table_take(&engine->pending_writes, request->pending_write);
+    }
+
+    release_request_state(engine, request);
+}
+
+void transfer_record_ordering_barrier(VkCommandBuffer cmd) {
+    // barriers reach back across submission boundaries on the same queue, so this waits on every earlier transfer
+    VkMemoryBarrier memory_barrier = {
+        .sType         = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .pNext         = NULL,
+        .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+    };
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, NULL, 0, NULL);
+}
+
+void transfer_record_dst_buffer_barrier(VkCommandBuffer cmd, const transfer_request* request, VkBuffer buffer, VkDeviceSize offset,
+                                        VkDeviceSize size) {
+    VkAccessFlags dst_access = request->dst_access_mask;
+    if (dst_access == 0) {
+        dst_access = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    }
+
+    VkPipelineStageFlags dst_stage = request->dst_stage_mask;
+    if (dst_stage == 0) {
+        dst_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+
+    VkBufferMemoryBarrier buffer_memory_barrier = {
+        .sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+        .pNext               = NULL,
+        .srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask       = dst_access,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .buffer              = buffer,
+        .offset              = offset,
+        .size                = size,
+    };
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0, 0, NULL, 1, &buffer_memory_barrier, 0, NULL);
+}
+
+static VkImageSubresourceRange image_region_range(const transfer_image_region* image) {
+    VkImageSubresourceRange range = {
+        .aspectMask     = image->subresource.aspectMask,
+        .baseMipLevel   = image->subresource.mipLevel,
+        .levelCount     = 1,
+        .baseArrayLayer = image->subresource.baseArrayLayer,
+        .layerCount     = image->subresource.layerCount,
+    };
+    return range;
+}
+
+void transfer_record_image_upload_barrier(VkCommandBuffer cmd, const transfer_request* request) {
+    // contents in a defined layout may still be written by an earlier upload to the image, wait for those writes
+    VkPipelineStageFlags src_stage  = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    VkAccessFlags        src_access = 0;
+    if (request->image.old_layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+        src_stage  = VK_PIPELINE_STAGE_TRANSFER_BIT;
+        src_access = VK_ACCESS_TRANSFER_WRITE_BIT;
+    }
+
+    VkImageMemoryBarrier image_memory_barrier = {
+        .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext               = NULL,
+        .srcAccessMask       = src_access,
+        .dstAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .oldLayout           = request->image.old_layout,
+        .newLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image               = request->dst.image,
+        .subresourceRange    = image_region_range(&request->image),
+    };
+
+    vkCmdPipelineBarrier(cmd, src_stage, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &image_memory_barrier);
+}
+
+void transfer_record_dst_image_barrier(VkCommandBuffer cmd, const transfer_request* request) {
+    VkAccessFlags dst_access = request->dst_access_mask;
+    if (dst_access == 0) {
+        dst_access = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    }
+
+    VkPipelineStageFlags dst_stage = request->dst_stage_mask;
+    if (dst_stage == 0) {
+        dst_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    }
+
+    VkImageMemoryBarrier image_memory_barrier = {
+        .sType               = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+        .pNext               = NULL,
+        .srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
+        .dstAccessMask       = dst_access,
+        .oldLayout           = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        .newLayout           = request->image.new_layout,
+        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .image               = request->dst.image,
+        .subresourceRange    = image_region_range(&request->image),
+    };
+
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0, 0, NULL, 0, NULL, 1, &image_memory_barrier);
+}
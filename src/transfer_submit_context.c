@@ -0,0 +1,324 @@
+#include "transfer_submit_context.h"
+#include "format_convert.h"
+#include "pending_write_table.h"
+#include "transfer_capture.h"
+#include "transfer_handle_pool.h"
+#include "transfer_request.h"
+#include "transfer_scheduler.h"
+#include "upload_dedup_cache.h"
+#include "vk_transfer.h"
+
+#include <sched.h>
+
+static transfer_error fill_internal_err(transfer_internal_error internal_error) {
+    transfer_error err;
+    err.type           = TRANSFER_ERROR_TYPE_INTERNAL;
+    err.vk_error       = VK_SUCCESS;
+    err.internal_error = internal_error;
+    return err;
+}
+
+b8 transfer_submit_context_registry_create(transfer_submit_context_registry* registry) {
+    assert(registry);
+
+    memset(registry->contexts, 0, sizeof(registry->contexts));
+    registry->count    = 0;
+    registry->capacity = 0;
+    registry->next_idx = 0;
+
+    return pthread_mutex_init(&registry->mutex, NULL) == 0;
+}
+
+void transfer_submit_context_registry_destroy(transfer_submit_context_registry* registry) {
+    assert(registry);
+
+    pthread_mutex_destroy(&registry->mutex);
+    registry->count = 0;
+}
+
+b8 transfer_submit_context_registry_pop(transfer_submit_context_registry* registry, const transfer_scheduler* scheduler,
+                                        transfer_request* request) {
+    assert(registry);
+    assert(scheduler);
+    assert(request);
+
+    pthread_mutex_lock(&registry->mutex);
+
+    for (u32 i = 0; i < registry->count; ++i) {
+        u32                      idx     = (registry->next_idx + i) % registry->count;
+        transfer_submit_context* context = registry->contexts[idx];
+
+        if (!spsc_ring_pop(&context->ring, request)) {
+            continue;
+        }
+
+        if (context->flags & TRANSFER_SUBMIT_CONTEXT_FLAG_ORDERED) {
+            request->flags |= TRANSFER_REQUEST_FLAG_ORDERED;
+
+            // the scheduler only keeps equal deadlines FIFO, so an earlier deadline can't overtake the previous request.
+            // once that one left, everything else of this context left before it and the floor no longer applies
+            if (request->deadline_frame < context->floor_deadline_frame &&
+                !transfer_scheduler_has_passed(scheduler, context->floor_deadline_frame, context->floor_sequence)) {
+                request->deadline_frame = context->floor_deadline_frame;
+            }
+
+            // the caller pushes it next
+            context->floor_deadline_frame = request->deadline_frame;
+            context->floor_sequence       = transfer_scheduler_next_sequence(scheduler);
+        }
+
+        atomic_fetch_add_explicit(&context->dequeued_count, 1, memory_order_relaxed);
+        registry->next_idx = idx + 1;
+
+        pthread_mutex_unlock(&registry->mutex);
+        return true;
+    }
+
+    pthread_mutex_unlock(&registry->mutex);
+    return false;
+}
+
+u32 transfer_submit_context_registry_capacity(transfer_submit_context_registry* registry) {
+    assert(registry);
+
+    pthread_mutex_lock(&registry->mutex);
+    u32 capacity = registry->capacity;
+    pthread_mutex_unlock(&registry->mutex);
+
+    return capacity;
+}
+
+b8 transfer_submit_context_registry_has_pending(transfer_submit_context_registry* registry) {
+    assert(registry);
+
+    b8 has_pending = false;
+
+    pthread_mutex_lock(&registry->mutex);
+
+    for (u32 i = 0; i < registry->count && !has_pending; ++i) {
+        has_pending = spsc_ring_count(&registry->contexts[i]->ring) > 0;
+    }
+
+    pthread_mutex_unlock(&registry->mutex);
+
+    return has_pending;
+}
+
+void transfer_request_queue_notify_worker(transfer_request_queue* request_queue) {
+    // pairs with the fence the worker issues after raising worker_sleeping. either we see the flag, or the worker
+    // sees our push when it re-checks for work, so a wakeup can't be lost.
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (!atomic_load_explicit(&request_queue->worker_sleeping, memory_order_relaxed)) {
+        return;
+    }
+
+    pthread_mutex_lock(&request_queue->mutex);
+    pthread_cond_signal(&request_queue->worker_notify_cond);
+    pthread_mutex_unlock(&request_queue->mutex);
+}
+
+b8 transfer_submit_context_create(transfer_engine* engine, const transfer_submit_context_create_info* create_info,
+                                  transfer_submit_context* context, transfer_error* error) {
+    assert(engine);
+    assert(context);
+
+    memset(context, 0, sizeof(transfer_submit_context));
+
+    context->engine = engine;
+    context->flags  = create_info ? create_info->flags : TRANSFER_SUBMIT_CONTEXT_FLAG_NONE;
+
+    u32 capacity = create_info && create_info->capacity > 0 ? create_info->capacity : SUBMIT_CONTEXT_DEFAULT_CAPACITY;
+
+    if (!spsc_ring_create(&context->ring, sizeof(transfer_request), capacity)) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY);
+        }
+        return false;
+    }
+
+    atomic_init(&context->enqueued_count, 0);
+    atomic_init(&context->full_count, 0);
+    atomic_init(&context->dequeued_count, 0);
+
+    transfer_submit_context_registry* registry = &engine->submit_contexts;
+    pthread_mutex_lock(&registry->mutex);
+
+    b8 registered = registry->count < SUBMIT_CONTEXT_MAX_COUNT;
+    if (registered) {
+        registry->contexts[registry->count++] = context;
+        registry->capacity += context->ring.capacity;
+    }
+
+    pthread_mutex_unlock(&registry->mutex);
+
+    if (!registered) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_TOO_MANY_SUBMIT_CONTEXTS);
+        }
+        spsc_ring_destroy(&context->ring);
+        return false;
+    }
+
+    return true;
+}
+
+void transfer_submit_context_destroy(transfer_submit_context* context) {
+    assert(context);
+
+    transfer_engine* engine = context->engine;
+
+    // let the worker drain what this producer already handed off
+    while (spsc_ring_count(&context->ring) > 0 && !atomic_load(&engine->should_close)) {
+        transfer_request_queue_notify_worker(&engine->request_queue);
+        sched_yield();
+    }
+
+    transfer_submit_context_registry* registry = &engine->submit_contexts;
+    pthread_mutex_lock(&registry->mutex);
+
+    for (u32 i = 0; i < registry->count; ++i) {
+        if (registry->contexts[i] == context) {
+            registry->contexts[i] = registry->contexts[--registry->count];
+            registry->capacity -= context->ring.capacity;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&registry->mutex);
+
+    spsc_ring_destroy(&context->ring);
+}
+
+static void capture_request(transfer_submit_context* context, const transfer_request* request) {
+    transfer_engine* engine = context->engine;
+
+    if (atomic_load_explicit(&engine->capture_active, memory_order_relaxed)) {
+        transfer_capture_record_request(&engine->capture, request, context);
+    }
+}
+
+static b8 submit_context_enqueue(transfer_submit_context* context, transfer_request* request) {
+    transfer_engine* engine = context->engine;
+
+    // superseding and dedup entries can't be undone, so a full ring has to be caught before the request is filtered
+    if (spsc_ring_full(&context->ring)) {
+        atomic_fetch_add_explicit(&context->full_count, 1, memory_order_relaxed);
+        return false;
+    }
+
+    if (upload_dedup_try_complete_request(engine, request)) {
+        capture_request(context, request);
+        return true;
+    }
+
+    // status has to be visible before the worker can pop the request
+    request->handle_ticket = transfer_handle_pool_mark_pending(&engine->handle_pool, request->handle);
+    request->pending_write = PENDING_WRITE_NONE;
+
+    if (atomic_load(&engine->latest_wins_ready)) {
+        pending_write_table_track(&engine->pending_writes, &engine->handle_pool, request);
+    }
+
+    // only this thread pushes, the room checked above is still there
+    spsc_ring_push(&context->ring, request);
+
+    atomic_fetch_add_explicit(&context->enqueued_count, 1, memory_order_relaxed);
+
+    transfer_request_queue_notify_worker(&engine->request_queue);
+
+    // rejected attempts aren't captured, the caller retries them as a new enqueue
+    capture_request(context, request);
+
+    return true;
+}
+
+b8 transfer_submit_context_copy_buffer_to_buffer(transfer_submit_context* context, const buffer_to_buffer_request* buffer_transfer) {
+    assert(context);
+    assert(buffer_transfer);
+
+    transfer_handle_pool_reset_handle(&context->engine->handle_pool, buffer_transfer->handle);
+
+    transfer_request transfer_request;
+    transfer_build_buffer_to_buffer_request(buffer_transfer, &transfer_request);
+
+    return submit_context_enqueue(context, &transfer_request);
+}
+
+b8 transfer_submit_context_copy_host_to_buffer(transfer_submit_context* context, const host_to_buffer_request* host_transfer) {
+    assert(context);
+    assert(host_transfer);
+
+    transfer_handle_pool_reset_handle(&context->engine->handle_pool, host_transfer->handle);
+
+    transfer_request transfer_request;
+    transfer_build_host_to_buffer_request(host_transfer, &transfer_request);
+
+    return submit_context_enqueue(context, &transfer_request);
+}
+
+b8 transfer_submit_context_copy_compressed_to_buffer(transfer_submit_context*             context,
+                                                    const compressed_to_buffer_request* compressed_transfer) {
+    assert(context);
+    assert(compressed_transfer);
+
+    transfer_handle_pool_reset_handle(&context->engine->handle_pool, compressed_transfer->handle);
+
+    transfer_request transfer_request;
+    transfer_build_compressed_to_buffer_request(compressed_transfer, &transfer_request);
+
+    return submit_context_enqueue(context, &transfer_request);
+}
+
+b8 transfer_submit_context_copy_file_to_buffer(transfer_submit_context* context, const file_to_buffer_request* file_transfer) {
+    assert(context);
+    assert(file_transfer);
+
+    transfer_handle_pool_reset_handle(&context->engine->handle_pool, file_transfer->handle);
+
+    transfer_request transfer_request;
+    transfer_build_file_to_buffer_request(file_transfer, &transfer_request);
+
+    return submit_context_enqueue(context, &transfer_request);
+}
+
+b8 transfer_submit_context_copy_host_to_image(transfer_submit_context* context, const host_to_image_request* image_transfer) {
+    assert(context);
+    assert(image_transfer);
+
+    transfer_handle_pool_reset_handle(&context->engine->handle_pool, image_transfer->handle);
+
+    transfer_request transfer_request;
+    transfer_build_host_to_image_request(image_transfer, &transfer_request);
+
+    return submit_context_enqueue(context, &transfer_request);
+}
+
+void transfer_submit_context_get_stats(const transfer_submit_context* context, transfer_submit_context_stats* stats) {
+    assert(context);
+    assert(stats);
+
+    stats->enqueued_count = atomic_load_explicit(&context->enqueued_count, memory_order_relaxed);
+    stats->dequeued_count = atomic_load_explicit(&context->dequeued_count, memory_order_relaxed);
+    stats->full_count     = atomic_load_explicit(&context->full_count, memory_order_relaxed);
+}
+
+b8 transfer_submit_context_heap_upload(transfer_submit_context* context, const heap_upload_request* upload, transfer_allocation* allocation) {
+    assert(context);
+    assert(upload);
+    assert(allocation);
+
+    if (!transfer_engine_heap_allocate(context->engine, format_convert_dst_size(&upload->conversion, upload->size), allocation)) {
+        return false;
+    }
+
+    host_to_buffer_request host_transfer;
+    transfer_build_heap_upload_request(upload, allocation, &host_transfer);
+
+    if (!transfer_submit_context_copy_host_to_buffer(context, &host_transfer)) {
+        transfer_engine_heap_free(context->engine, allocation);
+        return false;
+    }
+
+    return true;
+}
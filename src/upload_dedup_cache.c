@@ -0,0 +1,326 @@
+#include "upload_dedup_cache.h"
+#include "content_hash.h"
+#include "format_convert.h"
+#include "transfer_handle_pool.h"
+
+static u64 hash_key(VkBuffer dst, VkDeviceSize offset, VkDeviceSize size) {
+    u64 key = (u64)(uintptr_t)dst * 0x9e3779b97f4a7c15ull;
+    key ^= offset + 0x632be59bd9b4e019ull + (key << 6) + (key >> 2);
+    key ^= size + 0x85ebca77c2b2ae63ull + (key << 6) + (key >> 2);
+    return key ^ (key >> 29);
+}
+
+static u32 dst_bucket(VkBuffer dst) {
+    u64 h = (u64)(uintptr_t)dst * 0xff51afd7ed558ccdull;
+    return (u32)(h >> 54) % UPLOAD_DEDUP_DST_BUCKET_COUNT;
+}
+
+static void link_entry(upload_dedup_cache* cache, u32 idx) {
+    upload_dedup_entry* entry = &cache->entries[idx];
+    u32*                head  = &cache->dst_buckets[dst_bucket(entry->dst)];
+
+    entry->dst_prev = UPLOAD_DEDUP_NONE;
+    entry->dst_next = *head;
+
+    if (*head != UPLOAD_DEDUP_NONE) {
+        cache->entries[*head].dst_prev = idx;
+    }
+    *head = idx;
+}
+
+// unlinks the entry and marks its slot empty
+static void drop_entry(upload_dedup_cache* cache, u32 idx) {
+    upload_dedup_entry* entry = &cache->entries[idx];
+
+    if (entry->dst_prev != UPLOAD_DEDUP_NONE) {
+        cache->entries[entry->dst_prev].dst_next = entry->dst_next;
+    } else {
+        cache->dst_buckets[dst_bucket(entry->dst)] = entry->dst_next;
+    }
+    if (entry->dst_next != UPLOAD_DEDUP_NONE) {
+        cache->entries[entry->dst_next].dst_prev = entry->dst_prev;
+    }
+
+    entry->dst = VK_NULL_HANDLE;
+}
+
+static upload_dedup_entry* get_set(upload_dedup_cache* cache, VkBuffer dst, VkDeviceSize offset, VkDeviceSize size) {
+    u32 set = (u32)hash_key(dst, offset, size) & cache->set_mask;
+    return &cache->entries[set * UPLOAD_DEDUP_WAYS];
+}
+
+static void invalidate_locked(upload_dedup_cache* cache, VkBuffer dst, VkDeviceSize offset, VkDeviceSize size) {
+    b8  whole = size == VK_WHOLE_SIZE;
+    u32 idx   = cache->dst_buckets[dst_bucket(dst)];
+
+    while (idx != UPLOAD_DEDUP_NONE) {
+        upload_dedup_entry* entry = &cache->entries[idx];
+        u32                 next  = entry->dst_next;
+
+        if (entry->dst == dst && (whole || (entry->offset < offset + size && offset < entry->offset + entry->size))) {
+            drop_entry(cache, idx);
+            atomic_fetch_add_explicit(&cache->invalidation_count, 1, memory_order_relaxed);
+        }
+
+        idx = next;
+    }
+}
+
+b8 upload_dedup_cache_create(upload_dedup_cache* cache, const transfer_upload_dedup_create_info* create_info) {
+    assert(cache);
+
+    memset(cache, 0, sizeof(upload_dedup_cache));
+
+    u32 capacity = create_info && create_info->capacity > 0 ? create_info->capacity : UPLOAD_DEDUP_DEFAULT_CAPACITY;
+    u32 set_count = 1;
+    while (set_count * UPLOAD_DEDUP_WAYS < capacity) {
+        set_count <<= 1;
+    }
+
+    cache->set_mask = set_count - 1;
+    cache->min_size = create_info ? create_info->min_size : 0;
+
+    cache->entries = calloc((size_t)set_count * UPLOAD_DEDUP_WAYS, sizeof(upload_dedup_entry));
+    if (!cache->entries) {
+        return false;
+    }
+
+    if (pthread_mutex_init(&cache->mutex, NULL) != 0) {
+        free(cache->entries);
+        cache->entries = NULL;
+        return false;
+    }
+
+    for (u32 i = 0; i < UPLOAD_DEDUP_DST_BUCKET_COUNT; ++i) {
+        cache->dst_buckets[i] = UPLOAD_DEDUP_NONE;
+    }
+
+    return true;
+}
+
+void upload_dedup_cache_destroy(upload_dedup_cache* cache) {
+    assert(cache);
+
+    free(cache->entries);
+    pthread_mutex_destroy(&cache->mutex);
+
+    memset(cache, 0, sizeof(upload_dedup_cache));
+}
+
+b8 upload_dedup_cache_filter_request(upload_dedup_cache* cache, transfer_request* request, transfer_handle_fence_ref* hit_fence_ref) {
+    assert(cache);
+    assert(request);
+    assert(hit_fence_ref);
+
+    request->dedup_id = 0;
+
+    // only buffer ranges are tracked
+    if (request->type == TRANSFER_TYPE_HOST_TO_IMAGE) {
+        return false;
+    }
+
+    if (request->type == TRANSFER_TYPE_PLAN) {
+        const struct transfer_plan* plan = request->plan;
+        for (u32 i = 0; i < plan->copy_count; ++i) {
+            for (u32 r = 0; r < plan->copies[i].region_count; ++r) {
+                const VkBufferCopy* region = &plan->copies[i].regions[r];
+                upload_dedup_cache_invalidate(cache, plan->copies[i].dst, region->dstOffset, region->size);
+            }
+        }
+        return false;
+    }
+
+    if (request->type != TRANSFER_TYPE_HOST_TO_BUFFER) {
+        // content isn't known up front, all we can do is forget the range. region copies may write anywhere
+        VkDeviceSize size = request->region_count > 0 ? VK_WHOLE_SIZE : request->size;
+        upload_dedup_cache_invalidate(cache, request->dst.buffer, request->dst_offset, size);
+        return false;
+    }
+
+    if (request->size < cache->min_size) {
+        upload_dedup_cache_invalidate(cache, request->dst.buffer, request->dst_offset, request->size);
+        return false;
+    }
+
+    // hash the source outside the lock, it's the expensive part. the conversion is part of the key since the same
+    // source bytes converted differently land as different content
+    const transfer_conversion* conversion = &request->conversion;
+    u64 src_size = request->size / format_convert_dst_element_size(conversion) * format_convert_src_element_size(conversion);
+    u64 conversion_key = (u64)conversion->type;
+    if (conversion->type == TRANSFER_CONVERSION_SWIZZLE_RGBA8) {
+        u32 swizzle;
+        memcpy(&swizzle, conversion->swizzle, sizeof(swizzle));
+        conversion_key |= (u64)swizzle << 32;
+    }
+
+    u64 content_hash = content_hash64(request->src.host, src_size, conversion_key);
+
+    VkBuffer     dst    = request->dst.buffer;
+    VkDeviceSize offset = request->dst_offset;
+    VkDeviceSize size   = request->size;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    cache->use_counter++;
+
+    upload_dedup_entry* set = get_set(cache, dst, offset, size);
+
+    for (u32 i = 0; i < UPLOAD_DEDUP_WAYS; ++i) {
+        upload_dedup_entry* entry = &set[i];
+
+        if (entry->dst != dst || entry->offset != offset || entry->size != size || entry->content_hash != content_hash) {
+            continue;
+        }
+
+        if (entry->fence_ref.vk_fence == VK_NULL_HANDLE) {
+            // identical upload is still queued, there's no fence to piggyback on yet. let this one go through untracked
+            pthread_mutex_unlock(&cache->mutex);
+            atomic_fetch_add_explicit(&cache->miss_count, 1, memory_order_relaxed);
+            return false;
+        }
+
+        entry->last_use = cache->use_counter;
+        *hit_fence_ref  = entry->fence_ref;
+
+        pthread_mutex_unlock(&cache->mutex);
+
+        atomic_fetch_add_explicit(&cache->hit_count, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&cache->bytes_saved, size, memory_order_relaxed);
+        return true;
+    }
+
+    // whatever overlapped this range, including a stale entry for the same key, is about to be overwritten
+    invalidate_locked(cache, dst, offset, size);
+
+    upload_dedup_entry* victim = &set[0];
+    for (u32 i = 0; i < UPLOAD_DEDUP_WAYS; ++i) {
+        if (set[i].dst == VK_NULL_HANDLE) {
+            victim = &set[i];
+            break;
+        }
+        if (set[i].last_use < victim->last_use) {
+            victim = &set[i];
+        }
+    }
+
+    u32 victim_idx = (u32)(victim - cache->entries);
+
+    if (victim->dst != VK_NULL_HANDLE) {
+        drop_entry(cache, victim_idx);
+        atomic_fetch_add_explicit(&cache->eviction_count, 1, memory_order_relaxed);
+    }
+
+    victim->dst          = dst;
+    victim->offset       = offset;
+    victim->size         = size;
+    victim->content_hash = content_hash;
+    victim->last_use     = cache->use_counter;
+    victim->dedup_id     = ++cache->next_dedup_id;
+    victim->fence_ref    = (transfer_handle_fence_ref){.vk_fence = VK_NULL_HANDLE, .fence_generation = 0, .fence_idx = 0};
+
+    request->dedup_id = victim->dedup_id;
+
+    link_entry(cache, victim_idx);
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    atomic_fetch_add_explicit(&cache->miss_count, 1, memory_order_relaxed);
+
+    return false;
+}
+
+static upload_dedup_entry* find_request_entry(upload_dedup_cache* cache, const transfer_request* request) {
+    upload_dedup_entry* set = get_set(cache, request->dst.buffer, request->dst_offset, request->size);
+
+    for (u32 i = 0; i < UPLOAD_DEDUP_WAYS; ++i) {
+        if (set[i].dst != VK_NULL_HANDLE && set[i].dedup_id == request->dedup_id) {
+            return &set[i];
+        }
+    }
+
+    // invalidated or evicted since the request was queued
+    return NULL;
+}
+
+void upload_dedup_cache_record_submission(upload_dedup_cache* cache, const transfer_request* request, const transfer_submission* submission) {
+    assert(cache);
+    assert(request);
+    assert(submission);
+
+    if (request->dedup_id == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+
+    upload_dedup_entry* entry = find_request_entry(cache, request);
+    if (entry) {
+        entry->fence_ref.vk_fence         = submission->fence;
+        entry->fence_ref.fence_generation = submission->fence_generation;
+        entry->fence_ref.fence_idx        = (u32)submission->cmd_idx;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void upload_dedup_cache_finish_request(upload_dedup_cache* cache, const transfer_request* request) {
+    assert(cache);
+    assert(request);
+
+    if (request->dedup_id == 0) {
+        return;
+    }
+
+    pthread_mutex_lock(&cache->mutex);
+
+    // never submitted means the upload failed, the range holds unknown content
+    upload_dedup_entry* entry = find_request_entry(cache, request);
+    if (entry && entry->fence_ref.vk_fence == VK_NULL_HANDLE) {
+        drop_entry(cache, (u32)(entry - cache->entries));
+        atomic_fetch_add_explicit(&cache->invalidation_count, 1, memory_order_relaxed);
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+b8 upload_dedup_try_complete_request(transfer_engine* engine, transfer_request* request) {
+    assert(engine);
+    assert(request);
+
+    request->dedup_id = 0;
+
+    if (!atomic_load(&engine->upload_dedup_ready)) {
+        return false;
+    }
+
+    transfer_handle_fence_ref hit_fence_ref;
+    if (!upload_dedup_cache_filter_request(&engine->upload_dedup, request, &hit_fence_ref)) {
+        return false;
+    }
+
+    // borrow the fence of the upload that wrote the same bytes, status checks resolve it like any other transfer
+    transfer_handle_pool_set_handle_fence(&engine->handle_pool, request->handle, hit_fence_ref.vk_fence, hit_fence_ref.fence_generation,
+                                          hit_fence_ref.fence_idx);
+    transfer_handle_pool_insert_status_barrier(&engine->handle_pool, request->handle, TRANSFER_STATUS_EXECUTING);
+
+    return true;
+}
+
+void upload_dedup_cache_invalidate(upload_dedup_cache* cache, VkBuffer dst, VkDeviceSize offset, VkDeviceSize size) {
+    assert(cache);
+
+    pthread_mutex_lock(&cache->mutex);
+    invalidate_locked(cache, dst, offset, size);
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void upload_dedup_cache_get_stats(upload_dedup_cache* cache, transfer_upload_dedup_stats* stats) {
+    assert(cache);
+    assert(stats);
+
+    stats->hit_count          = atomic_load_explicit(&cache->hit_count, memory_order_relaxed);
+    stats->miss_count         = atomic_load_explicit(&cache->miss_count, memory_order_relaxed);
+    stats->bytes_saved        = atomic_load_explicit(&cache->bytes_saved, memory_order_relaxed);
+    stats->invalidation_count = atomic_load_explicit(&cache->invalidation_count, memory_order_relaxed);
+    stats->eviction_count     = atomic_load_explicit(&cache->eviction_count, memory_order_relaxed);
+}
@@ -0,0 +1,515 @@
+#include "upload_heap.h"
+#include "vk_memory.h"
+
+static upload_heap_node* node_at(upload_heap* heap, u32 node_idx) {
+    return d_array_at(&heap->nodes, node_idx);
+}
+
+static upload_heap_block* block_at(upload_heap* heap, u32 block_idx) {
+    return d_array_at(&heap->blocks, block_idx);
+}
+
+static u32 msb64(u64 value) {
+    return 63 - (u32)__builtin_clzll(value);
+}
+
+// first level is the power of two range, second level splits it linearly into UPLOAD_HEAP_SL_COUNT classes.
+// sizes are counted in UPLOAD_HEAP_ALIGNMENT units, so the smallest classes are exact
+static void mapping_insert(VkDeviceSize size, u32* fl, u32* sl) {
+    u64 units = size / UPLOAD_HEAP_ALIGNMENT;
+
+    if (units < UPLOAD_HEAP_SL_COUNT) {
+        *fl = 0;
+        *sl = (u32)units;
+        return;
+    }
+
+    u32 msb = msb64(units);
+    *fl     = msb - UPLOAD_HEAP_SL_LOG2 + 1;
+    *sl     = (u32)(units >> (msb - UPLOAD_HEAP_SL_LOG2)) - UPLOAD_HEAP_SL_COUNT;
+}
+
+// rounds up to the next class so any block found there is big enough without walking the list
+static void mapping_search(VkDeviceSize size, u32* fl, u32* sl) {
+    u64 units = size / UPLOAD_HEAP_ALIGNMENT;
+
+    if (units >= UPLOAD_HEAP_SL_COUNT) {
+        units += (1ull << (msb64(units) - UPLOAD_HEAP_SL_LOG2)) - 1;
+    }
+
+    mapping_insert(units * UPLOAD_HEAP_ALIGNMENT, fl, sl);
+}
+
+// smallest size filed under the class mapping_search probes for size, so a block of it is found again once it's free
+static VkDeviceSize search_class_size(VkDeviceSize size) {
+    u64 units = size / UPLOAD_HEAP_ALIGNMENT;
+
+    if (units >= UPLOAD_HEAP_SL_COUNT) {
+        u32 shift = msb64(units) - UPLOAD_HEAP_SL_LOG2;
+        units     = (units + (1ull << shift) - 1) >> shift << shift;
+    }
+
+    return units * UPLOAD_HEAP_ALIGNMENT;
+}
+
+static void insert_free(upload_heap* heap, u32 node_idx) {
+    upload_heap_node* node = node_at(heap, node_idx);
+
+    u32 fl, sl;
+    mapping_insert(node->size, &fl, &sl);
+
+    u32 head        = heap->free_heads[fl][sl];
+    node->free      = true;
+    node->prev_free = UPLOAD_HEAP_NODE_NONE;
+    node->next_free = head;
+
+    if (head != UPLOAD_HEAP_NODE_NONE) {
+        node_at(heap, head)->prev_free = node_idx;
+    }
+
+    heap->free_heads[fl][sl] = node_idx;
+    heap->fl_bitmap |= 1u << fl;
+    heap->sl_bitmaps[fl] |= 1u << sl;
+}
+
+static void remove_free(upload_heap* heap, u32 node_idx) {
+    upload_heap_node* node = node_at(heap, node_idx);
+
+    u32 fl, sl;
+    mapping_insert(node->size, &fl, &sl);
+
+    if (node->prev_free != UPLOAD_HEAP_NODE_NONE) {
+        node_at(heap, node->prev_free)->next_free = node->next_free;
+    }
+
+    if (node->next_free != UPLOAD_HEAP_NODE_NONE) {
+        node_at(heap, node->next_free)->prev_free = node->prev_free;
+    }
+
+    if (heap->free_heads[fl][sl] == node_idx) {
+        heap->free_heads[fl][sl] = node->next_free;
+
+        if (node->next_free == UPLOAD_HEAP_NODE_NONE) {
+            heap->sl_bitmaps[fl] &= ~(1u << sl);
+
+            if (heap->sl_bitmaps[fl] == 0) {
+                heap->fl_bitmap &= ~(1u << fl);
+            }
+        }
+    }
+
+    node->free = false;
+}
+
+static u32 find_free(upload_heap* heap, VkDeviceSize size) {
+    u32 fl, sl;
+    mapping_search(size, &fl, &sl);
+
+    if (fl >= UPLOAD_HEAP_FL_COUNT) {
+        return UPLOAD_HEAP_NODE_NONE;
+    }
+
+    u32 sl_map = heap->sl_bitmaps[fl] & (~0u << sl);
+
+    if (sl_map == 0) {
+        u32 fl_map = fl + 1 < UPLOAD_HEAP_FL_COUNT ? heap->fl_bitmap & (~0u << (fl + 1)) : 0;
+
+        if (fl_map == 0) {
+            return UPLOAD_HEAP_NODE_NONE;
+        }
+
+        fl     = (u32)__builtin_ctz(fl_map);
+        sl_map = heap->sl_bitmaps[fl];
+    }
+
+    return heap->free_heads[fl][(u32)__builtin_ctz(sl_map)];
+}
+
+static u32 acquire_node(upload_heap* heap) {
+    if (heap->unused_nodes != UPLOAD_HEAP_NODE_NONE) {
+        u32 node_idx       = heap->unused_nodes;
+        heap->unused_nodes = node_at(heap, node_idx)->next_free;
+        return node_idx;
+    }
+
+    upload_heap_node node = {0};
+    if (!d_array_push_back(&heap->nodes, &node)) {
+        return UPLOAD_HEAP_NODE_NONE;
+    }
+
+    return heap->nodes.count - 1;
+}
+
+static void release_node(upload_heap* heap, u32 node_idx) {
+    upload_heap_node* node = node_at(heap, node_idx);
+
+    node->block_idx    = UPLOAD_HEAP_NODE_NONE;
+    node->free         = false;
+    node->next_free    = heap->unused_nodes;
+    heap->unused_nodes = node_idx;
+}
+
+// returns the new block's single free node, or UPLOAD_HEAP_NODE_NONE
+static u32 add_block(upload_heap* heap, VkDeviceSize min_size) {
+    if (heap->block_count >= heap->max_block_count) {
+        return UPLOAD_HEAP_NODE_NONE;
+    }
+
+    // trimmed slots are reused so block indices stay small
+    u32 block_idx = heap->blocks.count;
+    for (u32 i = 0; i < heap->blocks.count; ++i) {
+        if (block_at(heap, i)->buffer == VK_NULL_HANDLE) {
+            block_idx = i;
+            break;
+        }
+    }
+
+    upload_heap_block block = {.size = min_size > heap->block_size ? min_size : heap->block_size, .allocated = 0};
+
+    VkBufferCreateInfo buffer_ci = {
+        .sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+        .pNext       = NULL,
+        .size        = block.size,
+        .usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT | heap->usage,
+        .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+    };
+
+    if (vkCreateBuffer(heap->device, &buffer_ci, NULL, &block.buffer) != VK_SUCCESS) {
+        return UPLOAD_HEAP_NODE_NONE;
+    }
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(heap->device, block.buffer, &requirements);
+
+    u32                   memory_type_idx;
+    VkMemoryPropertyFlags memory_type_flags;
+
+    b8 created = vk_memory_find_type(heap->physical_device, requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0,
+                                     &memory_type_idx, &memory_type_flags);
+
+    if (created) {
+        VkMemoryAllocateInfo memory_ai = {
+            .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .pNext           = NULL,
+            .allocationSize  = requirements.size,
+            .memoryTypeIndex = memory_type_idx,
+        };
+
+        created = vkAllocateMemory(heap->device, &memory_ai, NULL, &block.memory) == VK_SUCCESS;
+    }
+
+    created = created && vkBindBufferMemory(heap->device, block.buffer, block.memory, 0) == VK_SUCCESS;
+
+    u32 node_idx = created ? acquire_node(heap) : UPLOAD_HEAP_NODE_NONE;
+
+    if (node_idx != UPLOAD_HEAP_NODE_NONE && block_idx == heap->blocks.count && !d_array_push_back(&heap->blocks, &block)) {
+        release_node(heap, node_idx);
+        node_idx = UPLOAD_HEAP_NODE_NONE;
+    }
+
+    if (node_idx == UPLOAD_HEAP_NODE_NONE) {
+        vkDestroyBuffer(heap->device, block.buffer, NULL);
+        vkFreeMemory(heap->device, block.memory, NULL);
+        return UPLOAD_HEAP_NODE_NONE;
+    }
+
+    block.first_node           = node_idx;
+    *block_at(heap, block_idx) = block;
+    heap->block_count++;
+
+    upload_heap_node* node = node_at(heap, node_idx);
+    node->offset           = 0;
+    node->size             = block.size;
+    node->block_idx        = block_idx;
+    node->prev_phys        = UPLOAD_HEAP_NODE_NONE;
+    node->next_phys        = UPLOAD_HEAP_NODE_NONE;
+
+    insert_free(heap, node_idx);
+
+    return node_idx;
+}
+
+// hands out the front of a free node, the tail goes back as a free node of its own. without a spare node the whole
+// free node is handed out instead
+static void take_node(upload_heap* heap, u32 node_idx, VkDeviceSize aligned_size, VkDeviceSize size, transfer_allocation* allocation) {
+    remove_free(heap, node_idx);
+
+    VkDeviceSize rest_size = node_at(heap, node_idx)->size - aligned_size;
+    u32          rest_idx  = rest_size >= UPLOAD_HEAP_ALIGNMENT ? acquire_node(heap) : UPLOAD_HEAP_NODE_NONE;
+
+    upload_heap_node* node = node_at(heap, node_idx);
+
+    if (rest_idx != UPLOAD_HEAP_NODE_NONE) {
+        upload_heap_node* rest = node_at(heap, rest_idx);
+        rest->offset           = node->offset + aligned_size;
+        rest->size             = rest_size;
+        rest->block_idx        = node->block_idx;
+        rest->prev_phys        = node_idx;
+        rest->next_phys        = node->next_phys;
+
+        if (node->next_phys != UPLOAD_HEAP_NODE_NONE) {
+            node_at(heap, node->next_phys)->prev_phys = rest_idx;
+        }
+
+        node->next_phys = rest_idx;
+        node->size      = aligned_size;
+
+        insert_free(heap, rest_idx);
+    }
+
+    upload_heap_block* block = block_at(heap, node->block_idx);
+    block->allocated += node->size;
+
+    allocation->buffer   = block->buffer;
+    allocation->offset   = node->offset;
+    allocation->size     = size;
+    allocation->node_idx = node_idx;
+
+    heap->allocation_count++;
+    heap->allocated_bytes += node->size;
+}
+
+static VkDeviceSize align_allocation_size(VkDeviceSize size) {
+    return size > 0 ? (size + UPLOAD_HEAP_ALIGNMENT - 1) & ~(UPLOAD_HEAP_ALIGNMENT - 1) : UPLOAD_HEAP_ALIGNMENT;
+}
+
+b8 upload_heap_create(upload_heap* heap, VkDevice device, const transfer_upload_heap_create_info* create_info) {
+    assert(heap);
+    assert(create_info);
+
+    memset(heap, 0, sizeof(upload_heap));
+
+    heap->device          = device;
+    heap->physical_device = create_info->physical_device;
+    heap->usage           = create_info->usage;
+    heap->max_block_count = create_info->max_block_count > 0 ? create_info->max_block_count : UPLOAD_HEAP_DEFAULT_MAX_BLOCK_COUNT;
+    heap->unused_nodes    = UPLOAD_HEAP_NODE_NONE;
+
+    VkDeviceSize block_size = create_info->block_size > 0 ? create_info->block_size : UPLOAD_HEAP_DEFAULT_BLOCK_SIZE;
+    heap->block_size        = (block_size + UPLOAD_HEAP_ALIGNMENT - 1) & ~(UPLOAD_HEAP_ALIGNMENT - 1);
+
+    for (u32 fl = 0; fl < UPLOAD_HEAP_FL_COUNT; ++fl) {
+        for (u32 sl = 0; sl < UPLOAD_HEAP_SL_COUNT; ++sl) {
+            heap->free_heads[fl][sl] = UPLOAD_HEAP_NODE_NONE;
+        }
+    }
+
+    if (!d_array_create(&heap->blocks, sizeof(upload_heap_block), 4) || !d_array_create(&heap->nodes, sizeof(upload_heap_node), 256) ||
+        pthread_mutex_init(&heap->mutex, NULL) != 0) {
+        d_array_destroy(&heap->blocks);
+        d_array_destroy(&heap->nodes);
+        return false;
+    }
+
+    return true;
+}
+
+void upload_heap_destroy(upload_heap* heap) {
+    assert(heap);
+
+    for (u32 i = 0; i < heap->blocks.count; ++i) {
+        upload_heap_block* block = block_at(heap, i);
+        vkDestroyBuffer(heap->device, block->buffer, NULL);
+        vkFreeMemory(heap->device, block->memory, NULL);
+    }
+
+    d_array_destroy(&heap->blocks);
+    d_array_destroy(&heap->nodes);
+    pthread_mutex_destroy(&heap->mutex);
+
+    memset(heap, 0, sizeof(upload_heap));
+}
+
+b8 upload_heap_allocate(upload_heap* heap, VkDeviceSize size, transfer_allocation* allocation) {
+    assert(heap);
+    assert(allocation);
+
+    VkDeviceSize aligned_size = align_allocation_size(size);
+
+    pthread_mutex_lock(&heap->mutex);
+
+    u32 node_idx = find_free(heap, aligned_size);
+
+    if (node_idx == UPLOAD_HEAP_NODE_NONE) {
+        node_idx = add_block(heap, search_class_size(aligned_size));
+    }
+
+    if (node_idx != UPLOAD_HEAP_NODE_NONE) {
+        take_node(heap, node_idx, aligned_size, size, allocation);
+    }
+
+    pthread_mutex_unlock(&heap->mutex);
+
+    return node_idx != UPLOAD_HEAP_NODE_NONE;
+}
+
+b8 upload_heap_allocate_in_block(upload_heap* heap, u32 block_idx, VkDeviceSize size, transfer_allocation* allocation) {
+    assert(heap);
+    assert(allocation);
+
+    VkDeviceSize aligned_size = align_allocation_size(size);
+
+    pthread_mutex_lock(&heap->mutex);
+
+    u32 node_idx = UPLOAD_HEAP_NODE_NONE;
+
+    if (block_idx < heap->blocks.count && block_at(heap, block_idx)->buffer != VK_NULL_HANDLE) {
+        // lowest address first, so data packs towards the front of the block
+        for (u32 i = block_at(heap, block_idx)->first_node; i != UPLOAD_HEAP_NODE_NONE; i = node_at(heap, i)->next_phys) {
+            upload_heap_node* node = node_at(heap, i);
+
+            if (node->free && node->size >= aligned_size) {
+                node_idx = i;
+                break;
+            }
+        }
+    }
+
+    if (node_idx != UPLOAD_HEAP_NODE_NONE) {
+        take_node(heap, node_idx, aligned_size, size, allocation);
+    }
+
+    pthread_mutex_unlock(&heap->mutex);
+
+    return node_idx != UPLOAD_HEAP_NODE_NONE;
+}
+
+void upload_heap_free(upload_heap* heap, const transfer_allocation* allocation) {
+    assert(heap);
+    assert(allocation);
+
+    pthread_mutex_lock(&heap->mutex);
+
+    u32               node_idx = allocation->node_idx;
+    upload_heap_node* node     = node_at(heap, node_idx);
+
+    assert(!node->free && node->block_idx != UPLOAD_HEAP_NODE_NONE && "double free");
+
+    heap->allocation_count--;
+    heap->allocated_bytes -= node->size;
+    block_at(heap, node->block_idx)->allocated -= node->size;
+
+    // coalesce with free neighbours so fragments grow back into large blocks
+    u32 next_idx = node->next_phys;
+    if (next_idx != UPLOAD_HEAP_NODE_NONE && node_at(heap, next_idx)->free) {
+        remove_free(heap, next_idx);
+
+        upload_heap_node* next = node_at(heap, next_idx);
+        node->size += next->size;
+        node->next_phys = next->next_phys;
+
+        if (next->next_phys != UPLOAD_HEAP_NODE_NONE) {
+            node_at(heap, next->next_phys)->prev_phys = node_idx;
+        }
+
+        release_node(heap, next_idx);
+    }
+
+    u32 prev_idx = node->prev_phys;
+    if (prev_idx != UPLOAD_HEAP_NODE_NONE && node_at(heap, prev_idx)->free) {
+        remove_free(heap, prev_idx);
+
+        upload_heap_node* prev = node_at(heap, prev_idx);
+        prev->size += node->size;
+        prev->next_phys = node->next_phys;
+
+        if (node->next_phys != UPLOAD_HEAP_NODE_NONE) {
+            node_at(heap, node->next_phys)->prev_phys = prev_idx;
+        }
+
+        release_node(heap, node_idx);
+        node_idx = prev_idx;
+    }
+
+    insert_free(heap, node_idx);
+
+    pthread_mutex_unlock(&heap->mutex);
+}
+
+u32 upload_heap_allocation_block(upload_heap* heap, const transfer_allocation* allocation) {
+    assert(heap);
+    assert(allocation);
+
+    pthread_mutex_lock(&heap->mutex);
+    u32 block_idx = node_at(heap, allocation->node_idx)->block_idx;
+    pthread_mutex_unlock(&heap->mutex);
+
+    return block_idx;
+}
+
+b8 upload_heap_get_block_usage(upload_heap* heap, d_array* usage) {
+    assert(heap);
+    assert(usage);
+
+    pthread_mutex_lock(&heap->mutex);
+
+    b8 resized = d_array_resize(usage, heap->blocks.count);
+
+    for (u32 i = 0; resized && i < heap->blocks.count; ++i) {
+        upload_heap_block*       block       = block_at(heap, i);
+        upload_heap_block_usage* block_usage = d_array_at(usage, i);
+
+        block_usage->size      = block->buffer != VK_NULL_HANDLE ? block->size : 0;
+        block_usage->allocated = block->allocated;
+    }
+
+    pthread_mutex_unlock(&heap->mutex);
+
+    return resized;
+}
+
+u32 upload_heap_detach_empty_blocks(upload_heap* heap, upload_heap_block* blocks, u32 max_count) {
+    assert(heap);
+    assert(blocks || max_count == 0);
+
+    pthread_mutex_lock(&heap->mutex);
+
+    u32 count = 0;
+
+    for (u32 i = 0; i < heap->blocks.count && count < max_count; ++i) {
+        upload_heap_block* block = block_at(heap, i);
+
+        if (block->buffer == VK_NULL_HANDLE || block->allocated > 0) {
+            continue;
+        }
+
+        // an empty block has coalesced back into its single free node
+        remove_free(heap, block->first_node);
+        release_node(heap, block->first_node);
+
+        blocks[count++] = *block;
+
+        *block = (upload_heap_block){.buffer = VK_NULL_HANDLE, .memory = VK_NULL_HANDLE, .size = 0, .allocated = 0};
+        heap->block_count--;
+    }
+
+    pthread_mutex_unlock(&heap->mutex);
+
+    return count;
+}
+
+void upload_heap_release_block(upload_heap* heap, const upload_heap_block* block) {
+    assert(heap);
+    assert(block);
+
+    vkDestroyBuffer(heap->device, block->buffer, NULL);
+    vkFreeMemory(heap->device, block->memory, NULL);
+}
+
+void upload_heap_get_stats(upload_heap* heap, transfer_upload_heap_stats* stats) {
+    assert(heap);
+    assert(stats);
+
+    pthread_mutex_lock(&heap->mutex);
+
+    stats->block_count      = heap->block_count;
+    stats->allocation_count = heap->allocation_count;
+    stats->allocated_bytes  = heap->allocated_bytes;
+    stats->reserved_bytes   = 0;
+
+    for (u32 i = 0; i < heap->blocks.count; ++i) {
+        stats->reserved_bytes += block_at(heap, i)->size;
+    }
+
+    pthread_mutex_unlock(&heap->mutex);
+}
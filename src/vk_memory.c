@@ -0,0 +1,46 @@
+#include "vk_memory.h"
+
+b8 vk_memory_find_type(VkPhysicalDevice physical_device, u32 type_bits, VkMemoryPropertyFlags required, VkMemoryPropertyFlags preferred,
+                       u32* memory_type_idx, VkMemoryPropertyFlags* memory_type_flags) {
+    assert(physical_device != VK_NULL_HANDLE);
+    assert(memory_type_idx);
+
+    VkPhysicalDeviceMemoryProperties memory_properties;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    i32 fallback_idx = -1;
+
+    for (u32 i = 0; i < memory_properties.memoryTypeCount; ++i) {
+        if (!(type_bits & (1u << i))) {
+            continue;
+        }
+
+        VkMemoryPropertyFlags flags = memory_properties.memoryTypes[i].propertyFlags;
+        if ((flags & required) != required) {
+            continue;
+        }
+
+        if ((flags & preferred) == preferred) {
+            *memory_type_idx = i;
+            if (memory_type_flags) {
+                *memory_type_flags = flags;
+            }
+            return true;
+        }
+
+        if (fallback_idx < 0) {
+            fallback_idx = (i32)i;
+        }
+    }
+
+    if (fallback_idx < 0) {
+        return false;
+    }
+
+    *memory_type_idx = (u32)fallback_idx;
+    if (memory_type_flags) {
+        *memory_type_flags = memory_properties.memoryTypes[fallback_idx].propertyFlags;
+    }
+
+    return true;
+}
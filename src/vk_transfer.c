@@ -1,5 +1,24 @@
 #include "vk_transfer.h"
+#include "format_convert.h"
+#include "host_image_copy.h"
+#include "host_import_cache.h"
+#include "pending_write_table.h"
+#include "staging_buffer.h"
+#include "transfer_capture.h"
+#include "transfer_defrag.h"
 #include "transfer_handle_pool.h"
+#include "transfer_mirrored_buffer.h"
+#include "transfer_plan.h"
+#include "transfer_request.h"
+#include "transfer_scheduler.h"
+#include "transfer_staged.h"
+#include "transfer_submission.h"
+#include "transfer_submit_context.h"
+#include "upload_dedup_cache.h"
+#include "upload_heap.h"
+
+#include <time.h>
+#include <unistd.h>
 
 static transfer_error fill_vulkan_err(VkResult vk_error) {
     transfer_error err;
@@ -17,34 +36,61 @@ static transfer_error fill_internal_err(transfer_internal_error internal_error)
     return err;
 }
 
-static b8 enqueue_request(transfer_engine* engine, const transfer_request* request) {
+static void capture_request(transfer_engine* engine, const transfer_request* request) {
+    if (atomic_load_explicit(&engine->capture_active, memory_order_relaxed)) {
+        transfer_capture_record_request(&engine->capture, request, NULL);
+    }
+}
+
+b8 transfer_engine_enqueue_request(transfer_engine* engine, transfer_request* request) {
     assert(request);
 
+    if (upload_dedup_try_complete_request(engine, request)) {
+        capture_request(engine, request);
+        return true;
+    }
+
+    // status has to be visible before the worker can pop the request
+    request->handle_ticket = transfer_handle_pool_mark_pending(&engine->handle_pool, request->handle);
+    request->pending_write = PENDING_WRITE_NONE;
+
+    if (atomic_load(&engine->latest_wins_ready)) {
+        pending_write_table_track(&engine->pending_writes, &engine->handle_pool, request);
+    }
+
     transfer_request_queue* request_queue = &engine->request_queue;
     pthread_mutex_lock(&request_queue->mutex);
 
     bool push_successful = d_queue_push(&request_queue->queue, request);
 
-    transfer_handle_pool_insert_status_barrier(&engine->handle_pool, request->handle, TRANSFER_STATUS_PENDING);
-
     pthread_cond_signal(&request_queue->worker_notify_cond);
     pthread_mutex_unlock(&request_queue->mutex);
 
-    return push_successful;
+    if (!push_successful) {
+        if (request->pending_write != PENDING_WRITE_NONE) {
+            pending_write_table_take(&engine->pending_writes, request->pending_write);
+        }
+        // identical uploads would otherwise keep waiting on an entry nothing is going to submit
+        upload_dedup_cache_finish_request(&engine->upload_dedup, request);
+        transfer_handle_pool_set_handle_error_internal(&engine->handle_pool, request->handle, TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY);
+        return false;
+    }
+
+    // a replay issues every record once, so only requests that actually got queued are captured
+    capture_request(engine, request);
+
+    return true;
 }
 
-static b8 dequeue_request(transfer_engine* engine, transfer_request* request) {
-    if (!request) {
-        return false;
+static b8 try_dequeue_request(transfer_engine* engine, transfer_request* request) {
+    // per producer contexts first: they never touch the shared mutex on the enqueue side
+    if (transfer_submit_context_registry_pop(&engine->submit_contexts, &engine->scheduler, request)) {
+        return true;
     }
 
     transfer_request_queue* request_queue = &engine->request_queue;
     pthread_mutex_lock(&request_queue->mutex);
 
-    while (request_queue->queue.count == 0 && !atomic_load(&engine->should_close)) {
-        pthread_cond_wait(&request_queue->worker_notify_cond, &request_queue->mutex);
-    }
-
     bool pop_successful = d_queue_pop(&request_queue->queue, request);
 
     pthread_mutex_unlock(&request_queue->mutex);
@@ -52,141 +98,256 @@ static b8 dequeue_request(transfer_engine* engine, transfer_request* request) {
     return pop_successful;
 }
 
-static VkResult get_available_command_buffer_idx(transfer_engine* engine, i32* cmd_idx) {
-    i32 i = 0;
-    while (1) {
-        VkResult vk_res = vkGetFenceStatus(engine->vk_device, engine->command_pool.fences[i]);
-        if (vk_res == VK_SUCCESS) {
-            atomic_fetch_add(&engine->command_pool.fence_generations[i], 1);
-            *cmd_idx = i;
-            return VK_SUCCESS;
+// the scheduler holds no more than the rings could plus SCHEDULER_BASE_LIMIT for the engine wide queue, so while the
+// budget holds requests back the rings fill up and producers see it
+static b8 scheduler_full(transfer_engine* engine) {
+    u32 limit = SCHEDULER_BASE_LIMIT + transfer_submit_context_registry_capacity(&engine->submit_contexts);
+    return transfer_scheduler_count(&engine->scheduler) >= limit;
+}
+
+static void schedule_incoming_requests(transfer_engine* engine) {
+    // everything that has arrived goes through the scheduler, so the earliest deadline wins regardless of which queue it came from
+    transfer_request request;
+    while (!scheduler_full(engine) && try_dequeue_request(engine, &request)) {
+        if (transfer_scheduler_push(&engine->scheduler, &request)) {
+            continue;
         }
-        if (vk_res == VK_NOT_READY) {
-            i = (i + 1) % CMD_BUF_COUNT;
+
+        transfer_handle_pool_set_handle_error_internal(&engine->handle_pool, request.handle, TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY);
+        transfer_submission_drop_request(engine, &request);
+    }
+}
+
+static b8 dequeue_request(transfer_engine* engine, transfer_request* request) {
+    if (!request) {
+        return false;
+    }
+
+    transfer_request_queue* request_queue = &engine->request_queue;
+
+    while (!atomic_load(&engine->should_close)) {
+        schedule_incoming_requests(engine);
+        transfer_submission_discard_dead_requests(engine);
+
+        u64                           wait_ns;
+        transfer_scheduler_pop_result pop_result = transfer_scheduler_pop(&engine->scheduler, request, &wait_ns);
+
+        if (pop_result == TRANSFER_SCHEDULER_POP_READY) {
+            // it may have died between the check and the pop
+            if (transfer_submission_claim_request(engine, request)) {
+                return true;
+            }
             continue;
         }
 
-        return vk_res;
+        pthread_mutex_lock(&request_queue->mutex);
+
+        atomic_store(&request_queue->worker_sleeping, true);
+        atomic_thread_fence(memory_order_seq_cst);
+
+        // re-check after publishing that we're going to sleep. see transfer_request_queue_notify_worker.
+        // frame ticks and budget changes notify the same way. queued requests can't be taken in while the scheduler is full
+        b8 incoming = !scheduler_full(engine) &&
+                      (request_queue->queue.count > 0 || transfer_submit_context_registry_has_pending(&engine->submit_contexts));
+
+        if (!incoming && !transfer_scheduler_budget_changed(&engine->scheduler) && !atomic_load(&engine->should_close)) {
+            if (wait_ns > 0) {
+                // the rate budget refills on its own
+                struct timespec deadline;
+                clock_gettime(CLOCK_REALTIME, &deadline);
+
+                u64 nsec         = (u64)deadline.tv_nsec + wait_ns;
+                deadline.tv_sec += (time_t)(nsec / 1000000000ull);
+                deadline.tv_nsec = (long)(nsec % 1000000000ull);
+
+                pthread_cond_timedwait(&request_queue->worker_notify_cond, &request_queue->mutex, &deadline);
+            } else {
+                pthread_cond_wait(&request_queue->worker_notify_cond, &request_queue->mutex);
+            }
+        }
+
+        atomic_store(&request_queue->worker_sleeping, false);
+
+        pthread_mutex_unlock(&request_queue->mutex);
     }
+
+    return false;
 }
 
 static void transfer_buffer_to_buffer(VkCommandBuffer cmd, const transfer_request* transfer_request) {
     VkBufferCopy buffer_copy = {
         .srcOffset = 0,
         .dstOffset = 0,
-        .size      = VK_WHOLE_SIZE,
+        .size      = transfer_request->size,
     };
 
-    VkAccessFlags dst_access = transfer_request->dst_access_mask;
-    if (dst_access == 0) {
-        dst_access = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+    if (transfer_request->region_count > 0) {
+        vkCmdCopyBuffer(cmd, transfer_request->src.buffer, transfer_request->dst.buffer, transfer_request->region_count,
+                        transfer_request->regions);
+    } else {
+        vkCmdCopyBuffer(cmd, transfer_request->src.buffer, transfer_request->dst.buffer, 1, &buffer_copy);
+    }
+
+    transfer_record_dst_buffer_barrier(cmd, transfer_request, transfer_request->dst.buffer, 0, VK_WHOLE_SIZE);
+}
+
+static void execute_buffer_to_buffer(transfer_engine* engine, const transfer_request* req) {
+    transfer_submission submission;
+    VkResult            vk_res = transfer_submission_begin(engine, req->flags & TRANSFER_REQUEST_FLAG_ORDERED, &submission);
+
+    if (vk_res == VK_SUCCESS) {
+        transfer_buffer_to_buffer(submission.cmd, req);
+
+        vk_res = transfer_submission_submit(engine, &submission);
     }
 
-    VkPipelineStageFlags dst_stage = transfer_request->dst_stage_mask;
-    if (dst_stage == 0) {
-        dst_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    if (req->flags & TRANSFER_REQUEST_FLAG_DEFRAG) {
+        transfer_defrag_record_submission(&engine->defrag, vk_res == VK_SUCCESS ? &submission : NULL);
     }
 
-    VkBufferMemoryBarrier buffer_memory_barrier = {
-        .sType               = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
-        .pNext               = NULL,
-        .srcAccessMask       = VK_ACCESS_TRANSFER_WRITE_BIT,
-        .dstAccessMask       = dst_access,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .buffer              = transfer_request->dst.buffer,
-        .offset              = 0,
-        .size                = VK_WHOLE_SIZE,
-    };
+    if (req->mirror) {
+        transfer_mirrored_buffer_record_submission(req->mirror, vk_res == VK_SUCCESS ? &submission : NULL);
+    }
 
-    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, dst_stage, 0, 0, NULL, 1, &buffer_memory_barrier, 0, NULL);
+    if (vk_res != VK_SUCCESS) {
+        transfer_handle_pool_set_handle_error_vulkan(&engine->handle_pool, req->handle, vk_res);
+        return;
+    }
 
-    vkCmdCopyBuffer(cmd, transfer_request->src.buffer, transfer_request->dst.buffer, 1, &buffer_copy);
+    transfer_submission_track_request(engine, &submission, req);
 }
 
-static void* worker(void* arg) {
-    transfer_engine* engine = arg;
+static b8 execute_host_to_buffer_imported(transfer_engine* engine, const transfer_request* req) {
+    // the GPU can't convert while it reads in place
+    if (!atomic_load(&engine->host_import_ready) || req->size < engine->host_import.min_import_size ||
+        req->conversion.type != TRANSFER_CONVERSION_NONE) {
+        return false;
+    }
 
-    while (!atomic_load(&engine->should_close)) {
-        transfer_request req;
-        if (!dequeue_request(engine, &req)) {
-            transfer_handle_pool_set_handle_error_internal(&engine->handle_pool, req.handle, TRANSFER_INTERNAL_ERROR_CANT_POP_REQUEST);
-            continue;
-        }
+    host_import_entry entry;
+    if (!host_import_cache_acquire(&engine->host_import, engine->vk_device, &engine->command_pool, req->src.host, req->size, &entry)) {
+        // unaligned range, foreign memory the driver refuses, etc. staging still works
+        return false;
+    }
 
-        if (atomic_load(&engine->should_close)) {
-            break;
-        }
+    transfer_submission submission;
+    VkResult            vk_res = transfer_submission_begin(engine, req->flags & TRANSFER_REQUEST_FLAG_ORDERED, &submission);
 
-        i32      cmd_idx;
-        VkResult vk_res = get_available_command_buffer_idx(engine, &cmd_idx);
+    if (vk_res != VK_SUCCESS) {
+        host_import_cache_retire(&engine->host_import, &entry, NULL);
+        transfer_handle_pool_set_handle_error_vulkan(&engine->handle_pool, req->handle, vk_res);
+        return true;
+    }
 
-        if (vk_res != VK_SUCCESS) {
-            transfer_handle_pool_set_handle_error_vulkan(&engine->handle_pool, req.handle, vk_res);
-            continue;
-        }
+    VkBufferCopy buffer_copy = {
+        .srcOffset = (uintptr_t)req->src.host - entry.base,
+        .dstOffset = req->dst_offset,
+        .size      = req->size,
+    };
 
-        VkFence         fence = engine->command_pool.fences[cmd_idx];
-        VkCommandBuffer cmd   = engine->command_pool.buffers[cmd_idx];
+    vkCmdCopyBuffer(submission.cmd, entry.buffer, req->dst.buffer, 1, &buffer_copy);
 
-        vk_res = vkResetFences(engine->vk_device, 1, &fence);
+    transfer_record_dst_buffer_barrier(submission.cmd, req, req->dst.buffer, req->dst_offset, req->size);
 
-        if (vk_res != VK_SUCCESS) {
-            transfer_handle_pool_set_handle_error_vulkan(&engine->handle_pool, req.handle, vk_res);
-            continue;
-        }
+    vk_res = transfer_submission_submit(engine, &submission);
 
-        VkCommandBufferBeginInfo cmd_buf_bi = {
-            .sType            = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-            .pNext            = NULL,
-            .flags            = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
-            .pInheritanceInfo = NULL,
-        };
+    host_import_cache_retire(&engine->host_import, &entry, vk_res == VK_SUCCESS ? &submission : NULL);
 
-        vk_res = vkBeginCommandBuffer(cmd, &cmd_buf_bi);
-        if (vk_res != VK_SUCCESS) {
-            transfer_handle_pool_set_handle_error_vulkan(&engine->handle_pool, req.handle, vk_res);
-            continue;
-        }
+    if (vk_res != VK_SUCCESS) {
+        transfer_handle_pool_set_handle_error_vulkan(&engine->handle_pool, req->handle, vk_res);
+        return true;
+    }
 
-        switch (req.type) {
-        case TRANSFER_TYPE_BUFFER_TO_BUFFER:
-            transfer_buffer_to_buffer(cmd, &req);
-            continue;
-        default:
-            assert(0 && "unhandled transfer type");
-        }
+    transfer_submission_track_request(engine, &submission, req);
 
-        vk_res = vkEndCommandBuffer(cmd);
+    return true;
+}
 
-        if (vk_res != VK_SUCCESS) {
-            transfer_handle_pool_set_handle_error_vulkan(&engine->handle_pool, req.handle, vk_res);
-            continue;
-        }
+static void execute_host_to_image(transfer_engine* engine, const transfer_request* req) {
+    host_image_copy* copy = atomic_load(&engine->host_image_copy_ready) ? &engine->host_image_copy : NULL;
 
-        VkSubmitInfo submit_info = {
-            .sType                = VK_STRUCTURE_TYPE_COMMAND_BUFFER_SUBMIT_INFO,
-            .pNext                = NULL,
-            .waitSemaphoreCount   = 0,
-            .pWaitSemaphores      = NULL,
-            .pWaitDstStageMask    = NULL,
-            .commandBufferCount   = 1,
-            .pCommandBuffers      = &cmd,
-            .signalSemaphoreCount = 0,
-            .pSignalSemaphores    = NULL,
-        };
+    b8 queue_possible = atomic_load(&engine->staging_ready) && req->size <= engine->staging.chunk_size;
 
-        vk_res = vkQueueSubmit(engine->vk_queue, 1, &submit_info, fence);
+    if (copy && host_image_copy_choose_host(copy, req, queue_possible) && host_image_copy_execute(copy, &engine->handle_pool, req)) {
+        return;
+    }
 
-        if (vk_res != VK_SUCCESS) {
-            transfer_handle_pool_set_handle_error_vulkan(&engine->handle_pool, req.handle, vk_res);
+    u64                 start_ns = copy ? host_image_copy_timestamp() : 0;
+    transfer_submission submission;
+
+    if (transfer_staged_execute_image(engine, req, &submission) && copy) {
+        host_image_copy_record_queue_upload(copy, req, &submission, start_ns);
+    }
+}
+
+static void execute_plan(transfer_engine* engine, const transfer_request* req) {
+    transfer_plan* plan = req->plan;
+
+    // one of its buffers was destroyed after the submit was queued
+    if (!atomic_load(&plan->valid)) {
+        transfer_plan_record_submission(plan, NULL);
+        transfer_handle_pool_set_handle_error_internal(&engine->handle_pool, req->handle, TRANSFER_INTERNAL_ERROR_PLAN_INVALIDATED);
+        return;
+    }
+
+    transfer_submission submission;
+    VkResult            vk_res = transfer_submission_begin(engine, req->flags & TRANSFER_REQUEST_FLAG_ORDERED, &submission);
+
+    if (vk_res == VK_SUCCESS) {
+        vkCmdExecuteCommands(submission.cmd, 1, &plan->cmd);
+
+        vk_res = transfer_submission_submit(engine, &submission);
+    }
+
+    transfer_plan_record_submission(plan, vk_res == VK_SUCCESS ? &submission : NULL);
+
+    if (vk_res != VK_SUCCESS) {
+        transfer_handle_pool_set_handle_error_vulkan(&engine->handle_pool, req->handle, vk_res);
+        return;
+    }
+
+    transfer_submission_track_request(engine, &submission, req);
+}
+
+static void* worker(void* arg) {
+    transfer_engine* engine = arg;
+
+    while (!atomic_load(&engine->should_close)) {
+        transfer_request req;
+        if (!dequeue_request(engine, &req)) {
+            // only fails once the engine is closing
             continue;
         }
 
-        u64 fence_generation = engine->command_pool.fence_generations[cmd_idx];
-        transfer_handle_pool_set_handle_fence(&engine->handle_pool, req.handle, fence, fence_generation, cmd_idx);
+        if (atomic_load(&engine->host_image_copy_ready)) {
+            host_image_copy_poll(&engine->host_image_copy, &engine->command_pool);
+        }
 
-        transfer_handle_pool_insert_status_barrier(&engine->handle_pool, req.handle, TRANSFER_STATUS_EXECUTING);
+        switch (req.type) {
+        case TRANSFER_TYPE_BUFFER_TO_BUFFER:
+            execute_buffer_to_buffer(engine, &req);
+            break;
+        case TRANSFER_TYPE_FILE_TO_BUFFER:
+        case TRANSFER_TYPE_COMPRESSED_TO_BUFFER:
+            transfer_staged_execute(engine, &req);
+            break;
+        case TRANSFER_TYPE_HOST_TO_BUFFER:
+            if (!execute_host_to_buffer_imported(engine, &req) && !transfer_staged_execute_batch(engine, &req)) {
+                transfer_staged_execute(engine, &req);
+            }
+            if (atomic_load(&engine->upload_dedup_ready)) {
+                upload_dedup_cache_finish_request(&engine->upload_dedup, &req);
+            }
+            break;
+        case TRANSFER_TYPE_HOST_TO_IMAGE:
+            execute_host_to_image(engine, &req);
+            break;
+        case TRANSFER_TYPE_PLAN:
+            execute_plan(engine, &req);
+            break;
+        default:
+            assert(0 && "unhandled transfer type");
+        }
     }
 
     return NULL;
@@ -196,7 +357,9 @@ b8 transfer_engine_init(transfer_engine* engine, VkDevice device, u32 transfer_q
     assert(engine);
     assert(device != VK_NULL_HANDLE);
 
+    memset(engine, 0, sizeof(transfer_engine));
     atomic_store(&engine->should_close, false);
+    engine->vk_device = device;
 
     VkCommandPoolCreateInfo pool_ci = {
         .sType            = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
@@ -234,6 +397,7 @@ b8 transfer_engine_init(transfer_engine* engine, VkDevice device, u32 transfer_q
     }
 
     vkGetDeviceQueue(device, transfer_queue_family, 0, &engine->vk_queue);
+    engine->queue_family = transfer_queue_family;
 
     VkFenceCreateInfo fence_ci = {
         .sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
@@ -253,15 +417,36 @@ b8 transfer_engine_init(transfer_engine* engine, VkDevice device, u32 transfer_q
         }
     }
 
-    d_queue_create(&engine->request_queue.queue, sizeof(transfer_request), 50);
+    if (!transfer_handle_pool_create(&engine->handle_pool) ||
+        !d_queue_create(&engine->request_queue.queue, sizeof(transfer_request), QUEUE_ENTRIES_COUNT) ||
+        !transfer_scheduler_create(&engine->scheduler) || !transfer_capture_create(&engine->capture) ||
+        !transfer_defrag_create(&engine->defrag)) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY);
+        }
+        transfer_engine_deinit(engine);
+        return false;
+    }
+
+    atomic_store(&engine->request_queue.worker_sleeping, false);
 
-    engine->vk_device = device;
+    // synchronization primitives must exist before the worker can touch them
+    i32 cond_create_res     = pthread_cond_init(&engine->request_queue.worker_notify_cond, NULL);
+    i32 mutex_create_res    = pthread_mutex_init(&engine->request_queue.mutex, NULL);
+    i32 registry_create_res = transfer_submit_context_registry_create(&engine->submit_contexts) ? 0 : 1;
+    i32 plans_create_res    = transfer_plan_registry_create(&engine->plans) ? 0 : 1;
 
-    i32 thread_create_res = pthread_create(&engine->worker_thread, NULL, worker, engine);
-    i32 cond_create_res   = pthread_cond_init(&engine->request_queue.worker_notify_cond, NULL);
-    i32 mutex_create_res  = pthread_mutex_init(&engine->request_queue.mutex, NULL);
+    if (cond_create_res + mutex_create_res + registry_create_res + plans_create_res > 0) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_PTHREAD_CANNOT_CREATE);
+        }
+        transfer_engine_deinit(engine);
+        return false;
+    }
 
-    if (thread_create_res + cond_create_res + mutex_create_res > 0) {
+    engine->worker_started = pthread_create(&engine->worker_thread, NULL, worker, engine) == 0;
+
+    if (!engine->worker_started) {
         if (error) {
             *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_PTHREAD_CANNOT_CREATE);
         }
@@ -275,16 +460,67 @@ b8 transfer_engine_init(transfer_engine* engine, VkDevice device, u32 transfer_q
 void transfer_engine_deinit(transfer_engine* engine) {
     atomic_store(&engine->should_close, true);
 
-    pthread_mutex_lock(&engine->request_queue.mutex);
-    pthread_cond_broadcast(&engine->request_queue.worker_notify_cond);
-    pthread_mutex_unlock(&engine->request_queue.mutex);
+    if (engine->worker_started) {
+        pthread_mutex_lock(&engine->request_queue.mutex);
+        pthread_cond_broadcast(&engine->request_queue.worker_notify_cond);
+        pthread_mutex_unlock(&engine->request_queue.mutex);
+
+        pthread_join(engine->worker_thread, NULL);
+        engine->worker_started = false;
+    }
+
+    // host copies still running complete their handles
+    if (atomic_load(&engine->host_image_copy_ready)) {
+        host_image_copy_destroy(&engine->host_image_copy);
+        atomic_store(&engine->host_image_copy_ready, false);
+    }
+
+    // nothing may still be reading staging memory or waiting on the fences below
+    if (engine->command_pool.fences[0] != VK_NULL_HANDLE) {
+        vkWaitForFences(engine->vk_device, CMD_BUF_COUNT, engine->command_pool.fences, VK_TRUE, UINT64_MAX);
+    }
+
+    if (atomic_load(&engine->upload_heap_ready)) {
+        upload_heap_destroy(&engine->upload_heap);
+        atomic_store(&engine->upload_heap_ready, false);
+    }
+
+    if (atomic_load(&engine->upload_dedup_ready)) {
+        upload_dedup_cache_destroy(&engine->upload_dedup);
+        atomic_store(&engine->upload_dedup_ready, false);
+    }
+
+    if (atomic_load(&engine->latest_wins_ready)) {
+        pending_write_table_destroy(&engine->pending_writes);
+        atomic_store(&engine->latest_wins_ready, false);
+    }
+
+    if (atomic_load(&engine->decompression_ready)) {
+        task_pool_destroy(&engine->decompression_pool);
+        atomic_store(&engine->decompression_ready, false);
+    }
+
+    if (atomic_load(&engine->host_import_ready)) {
+        host_import_cache_destroy(&engine->host_import, engine->vk_device, &engine->command_pool);
+        atomic_store(&engine->host_import_ready, false);
+    }
+
+    if (atomic_load(&engine->staging_ready)) {
+        staging_buffer_destroy(&engine->staging, engine->vk_device);
+        file_reader_destroy(&engine->file_reader);
+        atomic_store(&engine->staging_ready, false);
+    }
 
     pthread_mutex_destroy(&engine->request_queue.mutex);
     pthread_cond_destroy(&engine->request_queue.worker_notify_cond);
-
-    pthread_join(engine->worker_thread, NULL);
+    transfer_submit_context_registry_destroy(&engine->submit_contexts);
+    transfer_plan_registry_destroy(&engine->plans);
 
     d_queue_destroy(&engine->request_queue.queue);
+    transfer_scheduler_destroy(&engine->scheduler);
+    transfer_capture_destroy(&engine->capture);
+    transfer_defrag_destroy(&engine->defrag);
+    transfer_handle_pool_destroy(&engine->handle_pool);
 
     for (i32 i = 0; i < CMD_BUF_COUNT; ++i) {
         vkDestroyFence(engine->vk_device, engine->command_pool.fences[i], NULL);
@@ -293,22 +529,416 @@ void transfer_engine_deinit(transfer_engine* engine) {
     vkDestroyCommandPool(engine->vk_device, engine->command_pool.pool, NULL);
 }
 
+b8 transfer_engine_init_staging(transfer_engine* engine, const transfer_staging_create_info* create_info, transfer_error* error) {
+    assert(engine);
+    assert(create_info);
+
+    if (atomic_load(&engine->staging_ready)) {
+        return true;
+    }
+
+    if (!staging_buffer_create(&engine->staging, engine->vk_device, create_info, error)) {
+        return false;
+    }
+
+    file_reader_create(&engine->file_reader, FILE_READER_QUEUE_DEPTH);
+
+    engine->vk_physical_device = create_info->physical_device;
+
+    // publishes staging and the reader to the worker
+    atomic_store(&engine->staging_ready, true);
+
+    return true;
+}
+
+b8 transfer_engine_init_decompression(transfer_engine* engine, const transfer_decompression_create_info* create_info,
+                                      transfer_error* error) {
+    assert(engine);
+
+    if (atomic_load(&engine->decompression_ready)) {
+        return true;
+    }
+
+    u32 thread_count = create_info ? create_info->thread_count : 0;
+    if (thread_count == 0) {
+        i64 cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count  = cpu_count > 1 ? (u32)(cpu_count / 2) : 1;
+    }
+
+    if (!task_pool_create(&engine->decompression_pool, thread_count)) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_PTHREAD_CANNOT_CREATE);
+        }
+        return false;
+    }
+
+    atomic_store(&engine->decompression_ready, true);
+
+    return true;
+}
+
+b8 transfer_engine_enable_upload_dedup(transfer_engine* engine, const transfer_upload_dedup_create_info* create_info, transfer_error* error) {
+    assert(engine);
+
+    if (atomic_load(&engine->upload_dedup_ready)) {
+        return true;
+    }
+
+    if (!upload_dedup_cache_create(&engine->upload_dedup, create_info)) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY);
+        }
+        return false;
+    }
+
+    atomic_store(&engine->upload_dedup_ready, true);
+
+    return true;
+}
+
+void transfer_engine_get_upload_dedup_stats(transfer_engine* engine, transfer_upload_dedup_stats* stats) {
+    assert(engine);
+    assert(stats);
+
+    if (!atomic_load(&engine->upload_dedup_ready)) {
+        memset(stats, 0, sizeof(transfer_upload_dedup_stats));
+        return;
+    }
+
+    upload_dedup_cache_get_stats(&engine->upload_dedup, stats);
+}
+
+b8 transfer_engine_enable_latest_wins(transfer_engine* engine, transfer_error* error) {
+    assert(engine);
+
+    if (atomic_load(&engine->latest_wins_ready)) {
+        return true;
+    }
+
+    if (!pending_write_table_create(&engine->pending_writes)) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY);
+        }
+        return false;
+    }
+
+    atomic_store(&engine->latest_wins_ready, true);
+
+    return true;
+}
+
+void transfer_engine_get_latest_wins_stats(transfer_engine* engine, transfer_latest_wins_stats* stats) {
+    assert(engine);
+    assert(stats);
+
+    if (!atomic_load(&engine->latest_wins_ready)) {
+        memset(stats, 0, sizeof(transfer_latest_wins_stats));
+        return;
+    }
+
+    pending_write_table_get_stats(&engine->pending_writes, stats);
+}
+
+b8 transfer_handle_cancel(transfer_engine* engine, transfer_handle handle) {
+    assert(engine);
+
+    // the worker drops the request once it reaches the front of the queue
+    return transfer_handle_pool_cancel_current(&engine->handle_pool, handle, TRANSFER_STATUS_CANCELLED);
+}
+
+void transfer_engine_invalidate_buffer_range(transfer_engine* engine, VkBuffer buffer, VkDeviceSize offset, VkDeviceSize size) {
+    assert(engine);
+
+    if (atomic_load(&engine->upload_dedup_ready)) {
+        upload_dedup_cache_invalidate(&engine->upload_dedup, buffer, offset, size);
+    }
+}
+
+void transfer_engine_notify_buffer_destroyed(transfer_engine* engine, VkBuffer buffer) {
+    assert(engine);
+
+    // the driver is free to hand the same VkBuffer value out again
+    transfer_engine_invalidate_buffer_range(engine, buffer, 0, VK_WHOLE_SIZE);
+    transfer_plan_registry_buffer_destroyed(&engine->plans, buffer);
+}
+
+void transfer_engine_set_budget(transfer_engine* engine, const transfer_budget* budget) {
+    assert(engine);
+
+    transfer_scheduler_set_budget(&engine->scheduler, budget);
+    transfer_request_queue_notify_worker(&engine->request_queue);
+}
+
+void transfer_engine_frame_tick(transfer_engine* engine) {
+    assert(engine);
+
+    if (atomic_load_explicit(&engine->capture_active, memory_order_relaxed)) {
+        transfer_capture_record_frame_tick(&engine->capture);
+    }
+
+    transfer_scheduler_frame_tick(&engine->scheduler);
+
+    // the next defrag step is enqueued after the tick so it's metered against the new frame
+    transfer_request defrag_request;
+    if (atomic_load(&engine->upload_heap_ready) &&
+        transfer_defrag_step(&engine->defrag, &engine->upload_heap, engine->vk_device, &engine->command_pool, &defrag_request) &&
+        !transfer_engine_enqueue_request(engine, &defrag_request)) {
+        transfer_defrag_record_submission(&engine->defrag, NULL);
+    }
+
+    transfer_request_queue_notify_worker(&engine->request_queue);
+}
+
+void transfer_engine_get_scheduler_stats(transfer_engine* engine, transfer_scheduler_stats* stats) {
+    assert(engine);
+
+    transfer_scheduler_get_stats(&engine->scheduler, stats);
+}
+
+b8 transfer_engine_begin_capture(transfer_engine* engine, const char* path, transfer_error* error) {
+    assert(engine);
+    assert(path);
+
+    if (!transfer_capture_begin(&engine->capture, path, atomic_load(&engine->scheduler.current_frame))) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_CAPTURE_FILE_FAILED);
+        }
+        return false;
+    }
+
+    atomic_store(&engine->capture_active, true);
+
+    return true;
+}
+
+b8 transfer_engine_end_capture(transfer_engine* engine) {
+    assert(engine);
+
+    atomic_store(&engine->capture_active, false);
+
+    return transfer_capture_end(&engine->capture);
+}
+
+b8 transfer_engine_enable_host_import(transfer_engine* engine, const transfer_host_import_create_info* create_info, transfer_error* error) {
+    assert(engine);
+    assert(create_info);
+
+    if (atomic_load(&engine->host_import_ready)) {
+        return true;
+    }
+
+    if (!host_import_cache_create(&engine->host_import, engine->vk_device, create_info, error)) {
+        return false;
+    }
+
+    atomic_store(&engine->host_import_ready, true);
+
+    return true;
+}
+
+void transfer_engine_release_host_memory(transfer_engine* engine, const void* ptr, VkDeviceSize size) {
+    assert(engine);
+
+    if (!atomic_load(&engine->host_import_ready)) {
+        return;
+    }
+
+    host_import_cache_release(&engine->host_import, engine->vk_device, &engine->command_pool, ptr, size);
+}
+
+b8 transfer_engine_enable_host_image_copy(transfer_engine* engine, const transfer_host_image_copy_create_info* create_info,
+                                         transfer_error* error) {
+    assert(engine);
+    assert(create_info);
+
+    if (atomic_load(&engine->host_image_copy_ready)) {
+        return true;
+    }
+
+    if (!host_image_copy_create(&engine->host_image_copy, engine->vk_device, create_info, error)) {
+        return false;
+    }
+
+    atomic_store(&engine->host_image_copy_ready, true);
+
+    return true;
+}
+
+void transfer_engine_get_host_image_copy_stats(transfer_engine* engine, transfer_host_image_copy_stats* stats) {
+    assert(engine);
+    assert(stats);
+
+    if (!atomic_load(&engine->host_image_copy_ready)) {
+        memset(stats, 0, sizeof(transfer_host_image_copy_stats));
+        return;
+    }
+
+    host_image_copy_get_stats(&engine->host_image_copy, stats);
+}
+
+b8 transfer_engine_enable_upload_heap(transfer_engine* engine, const transfer_upload_heap_create_info* create_info, transfer_error* error) {
+    assert(engine);
+    assert(create_info);
+
+    if (atomic_load(&engine->upload_heap_ready)) {
+        return true;
+    }
+
+    if (!upload_heap_create(&engine->upload_heap, engine->vk_device, create_info)) {
+        if (error) {
+            *error = fill_internal_err(TRANSFER_INTERNAL_ERROR_OUT_OF_MEMORY);
+        }
+        return false;
+    }
+
+    atomic_store(&engine->upload_heap_ready, true);
+
+    return true;
+}
+
+b8 transfer_engine_heap_allocate(transfer_engine* engine, VkDeviceSize size, transfer_allocation* allocation) {
+    assert(engine);
+    assert(allocation);
+
+    if (!atomic_load(&engine->upload_heap_ready)) {
+        return false;
+    }
+
+    return upload_heap_allocate(&engine->upload_heap, size, allocation);
+}
+
+void transfer_engine_heap_free(transfer_engine* engine, const transfer_allocation* allocation) {
+    assert(engine);
+    assert(allocation);
+    assert(atomic_load(&engine->upload_heap_ready));
+
+    // the next owner of the range must not be matched against the old contents
+    transfer_engine_invalidate_buffer_range(engine, allocation->buffer, allocation->offset, allocation->size);
+
+    upload_heap_free(&engine->upload_heap, allocation);
+}
+
+b8 transfer_engine_heap_upload(transfer_engine* engine, const heap_upload_request* upload, transfer_allocation* allocation) {
+    assert(engine);
+    assert(upload);
+    assert(allocation);
+
+    if (!transfer_engine_heap_allocate(engine, format_convert_dst_size(&upload->conversion, upload->size), allocation)) {
+        return false;
+    }
+
+    host_to_buffer_request host_transfer;
+    transfer_build_heap_upload_request(upload, allocation, &host_transfer);
+
+    transfer_engine_copy_host_to_buffer(engine, &host_transfer);
+
+    return true;
+}
+
+void transfer_engine_get_upload_heap_stats(transfer_engine* engine, transfer_upload_heap_stats* stats) {
+    assert(engine);
+    assert(stats);
+
+    if (!atomic_load(&engine->upload_heap_ready)) {
+        memset(stats, 0, sizeof(transfer_upload_heap_stats));
+        return;
+    }
+
+    upload_heap_get_stats(&engine->upload_heap, stats);
+}
+
+u32 transfer_engine_heap_trim(transfer_engine* engine) {
+    assert(engine);
+
+    if (!atomic_load(&engine->upload_heap_ready)) {
+        return 0;
+    }
+
+    upload_heap_block blocks[UPLOAD_HEAP_TRIM_BATCH];
+    u32               released_count = 0;
+    u32               count;
+
+    while ((count = upload_heap_detach_empty_blocks(&engine->upload_heap, blocks, UPLOAD_HEAP_TRIM_BATCH)) > 0) {
+        for (u32 i = 0; i < count; ++i) {
+            transfer_engine_notify_buffer_destroyed(engine, blocks[i].buffer);
+            upload_heap_release_block(&engine->upload_heap, &blocks[i]);
+        }
+
+        released_count += count;
+    }
+
+    return released_count;
+}
+
+b8 transfer_engine_defrag_begin(transfer_engine* engine, const transfer_allocation* allocations, u32 count,
+                                const transfer_defrag_create_info* create_info) {
+    assert(engine);
+
+    if (!atomic_load(&engine->upload_heap_ready)) {
+        return false;
+    }
+
+    return transfer_defrag_begin(&engine->defrag, &engine->upload_heap, allocations, count, create_info);
+}
+
+u32 transfer_engine_defrag_take_relocations(transfer_engine* engine, transfer_relocation* relocations, u32 max_count) {
+    assert(engine);
+
+    return transfer_defrag_take_relocations(&engine->defrag, relocations, max_count);
+}
+
+void transfer_engine_get_defrag_stats(transfer_engine* engine, transfer_defrag_stats* stats) {
+    assert(engine);
+
+    transfer_defrag_get_stats(&engine->defrag, stats);
+}
+
 void transfer_engine_copy_buffer_to_buffer(transfer_engine* engine, const buffer_to_buffer_request* buffer_transfer) {
     transfer_handle_pool_reset_handle(&engine->handle_pool, buffer_transfer->handle);
 
-    transfer_request transfer_request = {
-        .handle          = buffer_transfer->handle,
-        .src             = buffer_transfer->src,
-        .dst             = buffer_transfer->dst,
-        .type            = TRANSFER_TYPE_BUFFER_TO_BUFFER,
-        .dst_access_mask = buffer_transfer->dst_access_mask,
-        .dst_stage_mask  = buffer_transfer->dst_stage_mask,
-    };
+    transfer_request transfer_request;
+    transfer_build_buffer_to_buffer_request(buffer_transfer, &transfer_request);
+
+    transfer_engine_enqueue_request(engine, &transfer_request);
+}
+
+void transfer_engine_copy_host_to_buffer(transfer_engine* engine, const host_to_buffer_request* host_transfer) {
+    transfer_handle_pool_reset_handle(&engine->handle_pool, host_transfer->handle);
+
+    transfer_request transfer_request;
+    transfer_build_host_to_buffer_request(host_transfer, &transfer_request);
+
+    transfer_engine_enqueue_request(engine, &transfer_request);
+}
+
+void transfer_engine_copy_compressed_to_buffer(transfer_engine* engine, const compressed_to_buffer_request* compressed_transfer) {
+    transfer_handle_pool_reset_handle(&engine->handle_pool, compressed_transfer->handle);
+
+    transfer_request transfer_request;
+    transfer_build_compressed_to_buffer_request(compressed_transfer, &transfer_request);
 
-    enqueue_request(engine, &transfer_request);
+    transfer_engine_enqueue_request(engine, &transfer_request);
 }
 
-b8 _transfer_handle_pool_get_handle_status(transfer_engine* engine, transfer_handle handle, u64 fence_generation, transfer_status* status) {
+void transfer_engine_copy_file_to_buffer(transfer_engine* engine, const file_to_buffer_request* file_transfer) {
+    transfer_handle_pool_reset_handle(&engine->handle_pool, file_transfer->handle);
+
+    transfer_request transfer_request;
+    transfer_build_file_to_buffer_request(file_transfer, &transfer_request);
+
+    transfer_engine_enqueue_request(engine, &transfer_request);
+}
+
+void transfer_engine_copy_host_to_image(transfer_engine* engine, const host_to_image_request* image_transfer) {
+    transfer_handle_pool_reset_handle(&engine->handle_pool, image_transfer->handle);
+
+    transfer_request transfer_request;
+    transfer_build_host_to_image_request(image_transfer, &transfer_request);
+
+    transfer_engine_enqueue_request(engine, &transfer_request);
+}
+
+b8 _transfer_handle_pool_get_handle_status(transfer_engine* engine, transfer_handle handle, transfer_status* status) {
     assert(engine);
     assert(status);
     assert(engine->vk_device != VK_NULL_HANDLE);
@@ -328,7 +958,12 @@ b8 _transfer_handle_pool_get_handle_status(transfer_engine* engine, transfer_han
     transfer_handle_fence_ref* fence_ref = transfer_handle_pool_get_handle_fence_ref(&engine->handle_pool, handle);
 
     assert(fence_ref);
-    assert(fence_ref->vk_fence != VK_NULL_HANDLE);
+
+    if (fence_ref->vk_fence == VK_NULL_HANDLE) {
+        // claimed by the worker but not submitted yet, or a host image copy whose CPU thread completes the handle
+        *status = TRANSFER_STATUS_EXECUTING;
+        return true;
+    }
 
     if (fence_ref->fence_generation != engine->command_pool.fence_generations[fence_ref->fence_idx]) {
         // we haven't checked this handle in a while, but it hasn't produced an error, therefore it's complete
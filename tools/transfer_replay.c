@@ -0,0 +1,764 @@
+#include "vk_memory.h"
+#include "vk_transfer.h"
+
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+
+// transfer_replay <capture> [--speed factor] [--frame-budget bytes] [--ms-budget bytes] [--device index]
+//
+// regenerates the load recorded by transfer_engine_begin_capture on any Vulkan device. every captured buffer becomes a
+// synthetic device local buffer big enough for the ranges written to it, every producer thread and submit context is
+// recreated, and requests and frame ticks are issued at their captured times (scaled by --speed, 0 replays as fast as
+// possible). payloads were never captured, so sources hold a fixed pattern:
+// - file requests read from sparse temp files, storage latency isn't reproduced
+// - compressed requests are replayed as host uploads of their decompressed size, since there is nothing to decompress
+// - image uploads are replayed as host uploads of the same size into a buffer standing in for the image
+// - plan submits are replayed as host uploads of the plan's total size into a buffer standing in for the plan
+// - region copies (mirror flushes, defrag steps) are replayed with the captured number of regions laid out back to back
+
+#define REPLAY_DEFAULT_BUFFER_SIZE (64ull * 1024)
+#define REPLAY_POLL_INTERVAL_NS 1000000ull
+#define REPLAY_MAX_EXTRA_FRAMES 100000ull
+
+typedef struct replay_options {
+    const char*     capture_path;
+    f64             speed;
+    transfer_budget budget;
+    u32             device_idx;
+} replay_options;
+
+typedef struct replay_buffer {
+    VkBuffer       buffer;
+    VkDeviceMemory memory;
+    VkDeviceSize   size;
+} replay_buffer;
+
+typedef struct replay replay;
+
+typedef struct replay_producer {
+    replay*                  replay;
+    u32                      producer_id;
+    pthread_t                thread;
+    transfer_submit_context* contexts;
+    b8*                      context_created;
+    u64                      request_count;
+    u64                      full_retry_count;
+    atomic_bool              finished;
+} replay_producer;
+
+struct replay {
+    replay_options options;
+
+    transfer_capture_header  header;
+    transfer_capture_record* records;
+    u64                      record_count;
+
+    VkInstance       instance;
+    VkPhysicalDevice physical_device;
+    VkDevice         device;
+    u32              queue_family;
+
+    replay_buffer* buffers;
+    u32            buffer_count;
+    i32*           fds;
+    u32            file_count;
+    u8*            host;
+    VkDeviceSize   host_size;
+    // synthetic regions of every region copy, a record's first one is at region_first[record index]
+    VkBufferCopy* regions;
+    u64*          region_first;
+
+    u32              context_count;
+    replay_producer* producers;
+    u32              producer_count;
+
+    transfer_engine engine;
+    u64             start_time_ns;
+    atomic_bool     stopping;
+};
+
+static u64 monotonic_time_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64)ts.tv_sec * 1000000000ull + (u64)ts.tv_nsec;
+}
+
+static void sleep_until_ns(u64 time_ns) {
+    struct timespec ts = {.tv_sec = (time_t)(time_ns / 1000000000ull), .tv_nsec = (long)(time_ns % 1000000000ull)};
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0) {
+    }
+}
+
+static void wait_for_record(replay* replay, const transfer_capture_record* record) {
+    if (replay->options.speed <= 0.0) {
+        return;
+    }
+
+    sleep_until_ns(replay->start_time_ns + (u64)((f64)record->timestamp_ns / replay->options.speed));
+}
+
+static b8 parse_options(int argc, char** argv, replay_options* options) {
+    memset(options, 0, sizeof(replay_options));
+    options->speed = 1.0;
+
+    for (int i = 1; i < argc; ++i) {
+        b8 has_value = i + 1 < argc;
+
+        if (strcmp(argv[i], "--speed") == 0 && has_value) {
+            options->speed = strtod(argv[++i], NULL);
+        } else if (strcmp(argv[i], "--frame-budget") == 0 && has_value) {
+            options->budget.bytes_per_frame = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--ms-budget") == 0 && has_value) {
+            options->budget.bytes_per_ms = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--device") == 0 && has_value) {
+            options->device_idx = (u32)strtoul(argv[++i], NULL, 10);
+        } else if (argv[i][0] != '-' && !options->capture_path) {
+            options->capture_path = argv[i];
+        } else {
+            return false;
+        }
+    }
+
+    return options->capture_path != NULL;
+}
+
+static b8 read_records(replay* replay, FILE* file) {
+    u64 capacity    = 1024;
+    replay->records = malloc(capacity * sizeof(transfer_capture_record));
+
+    while (replay->records) {
+        if (replay->record_count == capacity) {
+            capacity *= 2;
+            transfer_capture_record* temp = realloc(replay->records, capacity * sizeof(transfer_capture_record));
+            if (!temp) {
+                break;
+            }
+            replay->records = temp;
+        }
+
+        if (fread(&replay->records[replay->record_count], sizeof(transfer_capture_record), 1, file) != 1) {
+            // a truncated trailing record is dropped
+            return true;
+        }
+
+        replay->record_count++;
+    }
+
+    fprintf(stderr, "out of memory reading %s\n", replay->options.capture_path);
+    return false;
+}
+
+static b8 load_capture(replay* replay) {
+    FILE* file = fopen(replay->options.capture_path, "rb");
+    if (!file) {
+        fprintf(stderr, "can't open %s\n", replay->options.capture_path);
+        return false;
+    }
+
+    b8 loaded = fread(&replay->header, sizeof(replay->header), 1, file) == 1 && replay->header.magic == TRANSFER_CAPTURE_MAGIC &&
+                replay->header.version == TRANSFER_CAPTURE_VERSION && replay->header.record_size == sizeof(transfer_capture_record);
+
+    if (!loaded) {
+        fprintf(stderr, "%s is not a version %u transfer capture\n", replay->options.capture_path, TRANSFER_CAPTURE_VERSION);
+    } else {
+        loaded = read_records(replay, file);
+    }
+
+    fclose(file);
+    return loaded;
+}
+
+static u64 max_u64(u64 a, u64 b) {
+    return a > b ? a : b;
+}
+
+// splits each region copy's captured total into its captured number of equal back to back regions
+static b8 plan_regions(replay* replay) {
+    u64 region_count = 0;
+    for (u64 i = 0; i < replay->record_count; ++i) {
+        region_count += replay->records[i].region_count;
+    }
+
+    replay->regions      = malloc(max_u64(region_count, 1) * sizeof(VkBufferCopy));
+    replay->region_first = malloc(max_u64(replay->record_count, 1) * sizeof(u64));
+    if (!replay->regions || !replay->region_first) {
+        return false;
+    }
+
+    u64 next = 0;
+    for (u64 i = 0; i < replay->record_count; ++i) {
+        const transfer_capture_record* record = &replay->records[i];
+
+        replay->region_first[i] = next;
+        if (record->event != TRANSFER_CAPTURE_EVENT_REQUEST || record->region_count == 0) {
+            continue;
+        }
+
+        // captured regions hold at least a byte each, so every piece does too
+        VkDeviceSize piece  = record->size / record->region_count;
+        VkDeviceSize offset = 0;
+
+        for (u32 r = 0; r < record->region_count; ++r) {
+            VkDeviceSize size = r + 1 < record->region_count ? piece : record->size - offset;
+
+            replay->regions[next++] = (VkBufferCopy){.srcOffset = offset, .dstOffset = record->dst_offset + offset, .size = size};
+            offset += size;
+        }
+    }
+
+    return true;
+}
+
+static b8 plan_resources(replay* replay) {
+    // ids are dense and start at 1, the largest one seen is the count
+    for (u64 i = 0; i < replay->record_count; ++i) {
+        const transfer_capture_record* record = &replay->records[i];
+
+        replay->producer_count = (u32)max_u64(replay->producer_count, record->producer_id);
+
+        if (record->event != TRANSFER_CAPTURE_EVENT_REQUEST) {
+            continue;
+        }
+
+        replay->buffer_count  = (u32)max_u64(replay->buffer_count, record->dst_id);
+        replay->context_count = (u32)max_u64(replay->context_count, record->context_id);
+
+        if (record->type == TRANSFER_TYPE_BUFFER_TO_BUFFER) {
+            replay->buffer_count = (u32)max_u64(replay->buffer_count, record->src_id);
+        } else if (record->type == TRANSFER_TYPE_FILE_TO_BUFFER) {
+            replay->file_count = (u32)max_u64(replay->file_count, record->src_id);
+        }
+    }
+
+    replay->buffers   = calloc(replay->buffer_count + 1, sizeof(replay_buffer));
+    replay->fds       = calloc(replay->file_count + 1, sizeof(i32));
+    replay->producers = calloc(replay->producer_count + 1, sizeof(replay_producer));
+
+    if (!replay->buffers || !replay->fds || !replay->producers) {
+        return false;
+    }
+
+    for (u32 i = 0; i < replay->file_count; ++i) {
+        replay->fds[i] = -1;
+    }
+
+    VkDeviceSize* file_sizes = calloc(replay->file_count + 1, sizeof(VkDeviceSize));
+    if (!file_sizes) {
+        return false;
+    }
+
+    for (u32 i = 0; i < replay->buffer_count; ++i) {
+        replay->buffers[i].size = REPLAY_DEFAULT_BUFFER_SIZE;
+    }
+
+    for (u64 i = 0; i < replay->record_count; ++i) {
+        const transfer_capture_record* record = &replay->records[i];
+
+        if (record->event != TRANSFER_CAPTURE_EVENT_REQUEST) {
+            continue;
+        }
+
+        replay_buffer* dst = &replay->buffers[record->dst_id - 1];
+        dst->size          = max_u64(dst->size, record->dst_offset + record->size);
+
+        switch (record->type) {
+        case TRANSFER_TYPE_BUFFER_TO_BUFFER:
+            replay->buffers[record->src_id - 1].size = max_u64(replay->buffers[record->src_id - 1].size, record->size);
+            break;
+        case TRANSFER_TYPE_FILE_TO_BUFFER:
+            file_sizes[record->src_id - 1] = max_u64(file_sizes[record->src_id - 1], record->src_offset + record->src_size);
+            break;
+        case TRANSFER_TYPE_HOST_TO_BUFFER:
+            replay->host_size = max_u64(replay->host_size, record->src_size);
+            break;
+        case TRANSFER_TYPE_COMPRESSED_TO_BUFFER:
+        case TRANSFER_TYPE_HOST_TO_IMAGE:
+        case TRANSFER_TYPE_PLAN:
+            replay->host_size = max_u64(replay->host_size, record->size);
+            break;
+        default:
+            break;
+        }
+    }
+
+    b8 created = true;
+
+    for (u32 i = 0; i < replay->file_count && created; ++i) {
+        char path[] = "/tmp/transfer_replay_XXXXXX";
+
+        replay->fds[i] = mkstemp(path);
+        if (replay->fds[i] < 0) {
+            created = false;
+            break;
+        }
+
+        unlink(path);
+        created = ftruncate(replay->fds[i], (off_t)file_sizes[i]) == 0;
+    }
+
+    free(file_sizes);
+
+    if (!created) {
+        fprintf(stderr, "can't create the synthetic source files\n");
+        return false;
+    }
+
+    replay->host = malloc(max_u64(replay->host_size, 1));
+    if (!replay->host) {
+        return false;
+    }
+
+    for (VkDeviceSize i = 0; i < replay->host_size; ++i) {
+        replay->host[i] = (u8)(i * 131 + (i >> 12));
+    }
+
+    if (!plan_regions(replay)) {
+        return false;
+    }
+
+    return true;
+}
+
+static b8 create_device(replay* replay) {
+    VkApplicationInfo app_info = {
+        .sType            = VK_STRUCTURE_TYPE_APPLICATION_INFO,
+        .pApplicationName = "transfer_replay",
+        .apiVersion       = VK_API_VERSION_1_1,
+    };
+
+    VkInstanceCreateInfo instance_ci = {
+        .sType            = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO,
+        .pApplicationInfo = &app_info,
+    };
+
+    if (vkCreateInstance(&instance_ci, NULL, &replay->instance) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateInstance failed\n");
+        return false;
+    }
+
+    u32 device_count = 0;
+    vkEnumeratePhysicalDevices(replay->instance, &device_count, NULL);
+
+    if (replay->options.device_idx >= device_count) {
+        fprintf(stderr, "device %u doesn't exist, %u found\n", replay->options.device_idx, device_count);
+        return false;
+    }
+
+    VkPhysicalDevice* physical_devices = malloc(device_count * sizeof(VkPhysicalDevice));
+    if (!physical_devices) {
+        return false;
+    }
+
+    vkEnumeratePhysicalDevices(replay->instance, &device_count, physical_devices);
+    replay->physical_device = physical_devices[replay->options.device_idx];
+    free(physical_devices);
+
+    u32 family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(replay->physical_device, &family_count, NULL);
+
+    VkQueueFamilyProperties* families = malloc(family_count * sizeof(VkQueueFamilyProperties));
+    if (!families) {
+        return false;
+    }
+
+    vkGetPhysicalDeviceQueueFamilyProperties(replay->physical_device, &family_count, families);
+
+    // a dedicated transfer family is what the engine is meant to run on, anything else can copy too
+    replay->queue_family = UINT32_MAX;
+    for (u32 i = 0; i < family_count; ++i) {
+        VkQueueFlags flags = families[i].queueFlags;
+
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            replay->queue_family = i;
+            break;
+        }
+
+        if (replay->queue_family == UINT32_MAX && (flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            replay->queue_family = i;
+        }
+    }
+
+    free(families);
+
+    if (replay->queue_family == UINT32_MAX) {
+        fprintf(stderr, "device has no queue family that can copy\n");
+        return false;
+    }
+
+    f32                     priority = 1.0f;
+    VkDeviceQueueCreateInfo queue_ci = {
+        .sType            = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+        .queueFamilyIndex = replay->queue_family,
+        .queueCount       = 1,
+        .pQueuePriorities = &priority,
+    };
+
+    VkDeviceCreateInfo device_ci = {
+        .sType                = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
+        .queueCreateInfoCount = 1,
+        .pQueueCreateInfos    = &queue_ci,
+    };
+
+    if (vkCreateDevice(replay->physical_device, &device_ci, NULL, &replay->device) != VK_SUCCESS) {
+        fprintf(stderr, "vkCreateDevice failed\n");
+        return false;
+    }
+
+    return true;
+}
+
+static b8 create_buffers(replay* replay) {
+    for (u32 i = 0; i < replay->buffer_count; ++i) {
+        replay_buffer* buffer = &replay->buffers[i];
+
+        VkBufferCreateInfo buffer_ci = {
+            .sType       = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
+            .size        = buffer->size,
+            .usage       = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            .sharingMode = VK_SHARING_MODE_EXCLUSIVE,
+        };
+
+        if (vkCreateBuffer(replay->device, &buffer_ci, NULL, &buffer->buffer) != VK_SUCCESS) {
+            return false;
+        }
+
+        VkMemoryRequirements requirements;
+        vkGetBufferMemoryRequirements(replay->device, buffer->buffer, &requirements);
+
+        u32                   memory_type_idx;
+        VkMemoryPropertyFlags memory_type_flags;
+        if (!vk_memory_find_type(replay->physical_device, requirements.memoryTypeBits, 0, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
+                                 &memory_type_idx, &memory_type_flags)) {
+            return false;
+        }
+
+        VkMemoryAllocateInfo memory_ai = {
+            .sType           = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize  = requirements.size,
+            .memoryTypeIndex = memory_type_idx,
+        };
+
+        if (vkAllocateMemory(replay->device, &memory_ai, NULL, &buffer->memory) != VK_SUCCESS ||
+            vkBindBufferMemory(replay->device, buffer->buffer, buffer->memory, 0) != VK_SUCCESS) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void destroy_resources(replay* replay) {
+    for (u32 i = 0; i < replay->buffer_count && replay->device; ++i) {
+        vkDestroyBuffer(replay->device, replay->buffers[i].buffer, NULL);
+        vkFreeMemory(replay->device, replay->buffers[i].memory, NULL);
+    }
+
+    for (u32 i = 0; i < replay->file_count; ++i) {
+        if (replay->fds[i] >= 0) {
+            close(replay->fds[i]);
+        }
+    }
+
+    if (replay->device) {
+        vkDestroyDevice(replay->device, NULL);
+    }
+
+    if (replay->instance) {
+        vkDestroyInstance(replay->instance, NULL);
+    }
+
+    free(replay->buffers);
+    free(replay->fds);
+    free(replay->host);
+    free(replay->regions);
+    free(replay->region_first);
+    free(replay->producers);
+    free(replay->records);
+}
+
+static b8 issue_request(replay_producer* producer, const transfer_capture_record* record) {
+    replay*                  replay  = producer->replay;
+    transfer_submit_context* context = NULL;
+
+    if (record->context_id != 0) {
+        // contexts belong to the thread that created them, which is this one
+        u32 context_idx = record->context_id - 1;
+        context         = &producer->contexts[context_idx];
+
+        if (!producer->context_created[context_idx]) {
+            transfer_submit_context_create_info context_ci = {.flags = record->context_flags};
+
+            if (!transfer_submit_context_create(&replay->engine, &context_ci, context, NULL)) {
+                return false;
+            }
+
+            producer->context_created[context_idx] = true;
+        }
+    }
+
+    VkBuffer dst = replay->buffers[record->dst_id - 1].buffer;
+
+    while (1) {
+        b8 enqueued = true;
+
+        switch (record->type) {
+        case TRANSFER_TYPE_BUFFER_TO_BUFFER: {
+            buffer_to_buffer_request request = {
+                .src             = replay->buffers[record->src_id - 1].buffer,
+                .dst             = dst,
+                .size            = record->size,
+                .regions         = &replay->regions[replay->region_first[record - replay->records]],
+                .region_count    = record->region_count,
+                .dst_access_mask = record->dst_access_mask,
+                .dst_stage_mask  = record->dst_stage_mask,
+                .deadline_frame  = record->deadline_frame,
+                .handle          = TRANSFER_HANDLE_INVALID,
+            };
+
+            if (context) {
+                enqueued = transfer_submit_context_copy_buffer_to_buffer(context, &request);
+            } else {
+                transfer_engine_copy_buffer_to_buffer(&replay->engine, &request);
+            }
+            break;
+        }
+        case TRANSFER_TYPE_FILE_TO_BUFFER: {
+            file_to_buffer_request request = {
+                .fd              = replay->fds[record->src_id - 1],
+                .file_offset     = record->src_offset,
+                .size            = record->size,
+                .dst             = dst,
+                .dst_offset      = record->dst_offset,
+                .dst_access_mask = record->dst_access_mask,
+                .dst_stage_mask  = record->dst_stage_mask,
+                .deadline_frame  = record->deadline_frame,
+                .handle          = TRANSFER_HANDLE_INVALID,
+            };
+
+            if (context) {
+                enqueued = transfer_submit_context_copy_file_to_buffer(context, &request);
+            } else {
+                transfer_engine_copy_file_to_buffer(&replay->engine, &request);
+            }
+            break;
+        }
+        case TRANSFER_TYPE_HOST_TO_BUFFER:
+        case TRANSFER_TYPE_COMPRESSED_TO_BUFFER:
+        case TRANSFER_TYPE_HOST_TO_IMAGE:
+        case TRANSFER_TYPE_PLAN: {
+            b8 converted = record->type == TRANSFER_TYPE_HOST_TO_BUFFER;
+
+            host_to_buffer_request request = {
+                .src             = replay->host,
+                .size            = converted ? record->src_size : record->size,
+                .dst             = dst,
+                .dst_offset      = record->dst_offset,
+                .conversion      = {.type = converted ? (transfer_conversion_type)record->conversion : TRANSFER_CONVERSION_NONE},
+                .dst_access_mask = record->dst_access_mask,
+                .dst_stage_mask  = record->dst_stage_mask,
+                .deadline_frame  = record->deadline_frame,
+                .handle          = TRANSFER_HANDLE_INVALID,
+            };
+            memcpy(request.conversion.swizzle, record->swizzle, sizeof(record->swizzle));
+
+            if (context) {
+                enqueued = transfer_submit_context_copy_host_to_buffer(context, &request);
+            } else {
+                transfer_engine_copy_host_to_buffer(&replay->engine, &request);
+            }
+            break;
+        }
+        default:
+            fprintf(stderr, "skipping request of unknown type %u\n", record->type);
+            return true;
+        }
+
+        if (enqueued) {
+            producer->request_count++;
+            return true;
+        }
+
+        // ring full, same as a producer that spins until the worker catches up
+        if (atomic_load(&producer->replay->stopping)) {
+            return true;
+        }
+
+        producer->full_retry_count++;
+        sched_yield();
+    }
+}
+
+static void* run_producer(void* arg) {
+    replay_producer* producer = arg;
+    replay*          replay   = producer->replay;
+
+    for (u64 i = 0; i < replay->record_count; ++i) {
+        const transfer_capture_record* record = &replay->records[i];
+
+        if (atomic_load(&replay->stopping)) {
+            break;
+        }
+
+        if (record->event != TRANSFER_CAPTURE_EVENT_REQUEST || record->producer_id != producer->producer_id) {
+            continue;
+        }
+
+        wait_for_record(replay, record);
+
+        if (!issue_request(producer, record)) {
+            fprintf(stderr, "producer %u can't create a submit context\n", producer->producer_id);
+            break;
+        }
+    }
+
+    for (u32 i = 0; i < replay->context_count; ++i) {
+        if (producer->context_created[i]) {
+            transfer_submit_context_destroy(&producer->contexts[i]);
+        }
+    }
+
+    atomic_store(&producer->finished, true);
+
+    return NULL;
+}
+
+static b8 run_replay(replay* replay) {
+    transfer_error error;
+
+    if (!transfer_engine_init(&replay->engine, replay->device, replay->queue_family, &error)) {
+        fprintf(stderr, "transfer_engine_init failed\n");
+        return false;
+    }
+
+    transfer_staging_create_info staging_ci = {.physical_device = replay->physical_device};
+    if (!transfer_engine_init_staging(&replay->engine, &staging_ci, &error)) {
+        fprintf(stderr, "transfer_engine_init_staging failed\n");
+        transfer_engine_deinit(&replay->engine);
+        return false;
+    }
+
+    if (replay->options.budget.bytes_per_frame > 0 || replay->options.budget.bytes_per_ms > 0) {
+        transfer_engine_set_budget(&replay->engine, &replay->options.budget);
+    }
+
+    // deadlines were captured against the engine's frame counter at the time
+    for (u64 i = 0; i < replay->header.start_frame; ++i) {
+        transfer_engine_frame_tick(&replay->engine);
+    }
+
+    replay->start_time_ns = monotonic_time_ns();
+
+    u32 started_count = 0;
+    for (u32 i = 0; i < replay->producer_count; ++i) {
+        replay_producer* producer = &replay->producers[i];
+        producer->replay          = replay;
+        producer->producer_id     = i + 1;
+        producer->contexts        = calloc(replay->context_count + 1, sizeof(transfer_submit_context));
+        producer->context_created = calloc(replay->context_count + 1, sizeof(b8));
+
+        if (!producer->contexts || !producer->context_created || pthread_create(&producer->thread, NULL, run_producer, producer) != 0) {
+            fprintf(stderr, "can't start producer %u\n", i + 1);
+            break;
+        }
+
+        started_count++;
+    }
+
+    u64 frame_count = 0;
+    for (u64 i = 0; i < replay->record_count; ++i) {
+        if (replay->records[i].event == TRANSFER_CAPTURE_EVENT_FRAME_TICK) {
+            wait_for_record(replay, &replay->records[i]);
+            transfer_engine_frame_tick(&replay->engine);
+            frame_count++;
+        }
+    }
+
+    // the capture's ticks can run out while the frame budget still holds requests back, and producers spinning on full
+    // rings behind them, so keep ticking whenever a poll sees no progress until everything has been dispatched
+    u64                      extra_frame_count = 0;
+    u64                      last_dispatched   = 0;
+    u64                      request_count     = 0;
+    transfer_scheduler_stats stats;
+    while (1) {
+        sleep_until_ns(monotonic_time_ns() + REPLAY_POLL_INTERVAL_NS);
+        transfer_engine_get_scheduler_stats(&replay->engine, &stats);
+
+        b8 finished   = true;
+        request_count = 0;
+        for (u32 i = 0; i < started_count; ++i) {
+            if (!atomic_load(&replay->producers[i].finished)) {
+                finished = false;
+                break;
+            }
+            request_count += replay->producers[i].request_count;
+        }
+
+        // everything has been handed to the worker once the scheduler has dispatched it all, deinit then waits for the GPU
+        if (finished && stats.dispatched_count >= request_count) {
+            break;
+        }
+
+        if (stats.dispatched_count != last_dispatched || replay->options.budget.bytes_per_frame == 0) {
+            last_dispatched = stats.dispatched_count;
+            continue;
+        }
+
+        if (extra_frame_count == REPLAY_MAX_EXTRA_FRAMES) {
+            fprintf(stderr, "replay still has undispatched requests after %llu extra frames, giving up with %llu dispatched\n",
+                    (unsigned long long)extra_frame_count, (unsigned long long)stats.dispatched_count);
+            atomic_store(&replay->stopping, true);
+            break;
+        }
+
+        transfer_engine_frame_tick(&replay->engine);
+        extra_frame_count++;
+    }
+
+    request_count        = 0;
+    u64 full_retry_count = 0;
+    for (u32 i = 0; i < started_count; ++i) {
+        pthread_join(replay->producers[i].thread, NULL);
+        request_count += replay->producers[i].request_count;
+        full_retry_count += replay->producers[i].full_retry_count;
+    }
+
+    transfer_engine_deinit(&replay->engine);
+
+    f64 elapsed_ms = (f64)(monotonic_time_ns() - replay->start_time_ns) / 1e6;
+
+    u64 captured_ns = replay->record_count > 0 ? replay->records[replay->record_count - 1].timestamp_ns : 0;
+
+    printf("replayed %llu requests from %u producers over %llu frames (%llu past the capture)\n", (unsigned long long)request_count,
+           started_count, (unsigned long long)(frame_count + extra_frame_count), (unsigned long long)extra_frame_count);
+    printf("  wall time        %.2f ms (captured %.2f ms)\n", elapsed_ms, (f64)captured_ns / 1e6);
+    printf("  bytes            %llu\n", (unsigned long long)stats.dispatched_bytes);
+    printf("  throughput       %.3f GB/s\n", (f64)stats.dispatched_bytes / (elapsed_ms * 1e6));
+    printf("  deadline misses  %llu of %llu\n", (unsigned long long)stats.deadline_miss_count, (unsigned long long)stats.deadline_count);
+    printf("  budget stalls    %llu\n", (unsigned long long)stats.budget_stall_count);
+    printf("  ring full spins  %llu\n", (unsigned long long)full_retry_count);
+
+    for (u32 i = 0; i < replay->producer_count; ++i) {
+        free(replay->producers[i].contexts);
+        free(replay->producers[i].context_created);
+    }
+
+    return started_count == replay->producer_count && !atomic_load(&replay->stopping);
+}
+
+int main(int argc, char** argv) {
+    replay replay;
+    memset(&replay, 0, sizeof(replay));
+
+    if (!parse_options(argc, argv, &replay.options)) {
+        fprintf(stderr, "usage: %s <capture> [--speed factor] [--frame-budget bytes] [--ms-budget bytes] [--device index]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    b8 succeeded = load_capture(&replay) && plan_resources(&replay) && create_device(&replay) && create_buffers(&replay) &&
+                   run_replay(&replay);
+
+    destroy_resources(&replay);
+
+    return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
+}